@@ -0,0 +1,196 @@
+/*
+Header file for QuantumMechanics::GreensFormalism::BatchedGreensSolver: 
+
+This file solves the first or last block of many independent block tridiagonal matrices
+with the same block sizes, e.g. one per energy, k-point or disorder realization. Instead of
+one small inversion and two small products per block and problem, every step of the
+self-energy recursion is done for all problems at once with the packed batched kernels.
+The problems are split in chunks that are solved in parallel.
+
+With an AutoTuner and no explicit chunk size, the chunk size is benchmarked on the first run
+of a signature: small chunks run many problems in parallel with sequential kernels, while a
+single chunk of all problems leaves the parallelism to the kernels (the BLAS) alone.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _GREENSFORMALISM_BATCHEDGREENSSOLVER_H_
+#define _GREENSFORMALISM_BATCHEDGREENSSOLVER_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+#include "../Misc/AutoTuner"
+#include "../LinearAlgebra/BatchedKernels"
+#include "GreensSolver"
+
+#include <tbb/tbb.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace QuantumMechanics {
+
+namespace GreensFormalism {
+
+class BatchedGreensSolver {
+
+	const std::vector<BlockMatrixXcd> &H;
+
+	std::vector<MatrixXcd> G;
+
+	std::atomic<long> singular_count;
+
+	// not owned, null disables tuning.
+	AutoTuner *tuner;
+
+	static LoggingObject log;
+
+public:
+	// the number of problems solved together in one packed batch, zero chooses it automatically.
+	long chunk_size;
+
+	BatchedGreensSolver(const std::vector<BlockMatrixXcd> &problems) : H(problems), singular_count(0), tuner(nullptr), chunk_size(0) { }
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+	// tunes the chunk size, unless it is set explicitly.
+	void setAutoTuner(AutoTuner *auto_tuner)
+	{
+		tuner = auto_tuner;
+	}
+
+protected:
+	LinearAlgebra::PackedBatch pack(const long &first, const long &count, const long &row, const long &col) const
+	{
+		LinearAlgebra::PackedBatch result(H[first].block(row, col).rows(), H[first].block(row, col).cols(), count);
+
+		for (long k = 0; k < count; k++)
+			result.set(k, H[first + k].block(row, col));
+
+		return result;
+	}
+
+	// the self-energy recursion from the block start towards the block stop, in steps of direction.
+	void compute_chunk(const long &first, const long &count, const long &start, const long &stop, const long &direction)
+	{
+		using namespace LinearAlgebra;
+
+		PackedBatch sigma(H[first].block(start, start).rows(), H[first].block(start, start).cols(), count);
+		PackedBatch g, product;
+
+		for (long b = start; b != stop; b += direction)
+		{
+			g = pack(first, count, b, b);
+			g.subtract(sigma);
+
+			singular_count += batchedInverse(g);
+
+			batchedMultiply(g, pack(first, count, b, b + direction), product);
+			batchedMultiply(pack(first, count, b + direction, b), product, sigma);
+		}
+
+		g = pack(first, count, stop, stop);
+		g.subtract(sigma);
+
+		singular_count += batchedInverse(g);
+
+		for (long k = 0; k < count; k++)
+			G[first + k] = g.get(k);
+	}
+
+	void compute_batched(const long &start, const long &stop, const long &direction, const long &size)
+	{
+		const long problems = H.size();
+		const long chunks = (problems + size - 1) / size;
+
+		G.assign(problems, MatrixXcd());
+		singular_count = 0;
+
+		tbb::parallel_for(0L, chunks, [&](const long &c) {
+			const long first = c * size;
+
+			compute_chunk(first, std::min(size, problems - first), start, stop, direction);
+		});
+
+		if (singular_count > 0)
+			log() << singular_count << " singular blocks were met." << std::endl;
+	}
+
+	// the tuned chunk size, every candidate solves all problems.
+	long tune(const GreenMatrixSubType &action, const long &start, const long &stop, const long &direction)
+	{
+		const long problems = H.size();
+
+		AutoTuner::CandidateList candidates;
+
+		for (long size = 8; size < problems; size *= 4)
+			candidates.push_back(std::make_pair(std::to_string(size), std::function<void()>([=]() { compute_batched(start, stop, direction, size); })));
+
+		candidates.push_back(std::make_pair(std::to_string(problems), std::function<void()>([=]() { compute_batched(start, stop, direction, problems); })));
+
+		ArrayXi sizes(block_count());
+
+		for (long b = 0; b < sizes.size(); b++)
+			sizes[b] = H[0].block(b, b).rows();
+
+		const std::string winner = tuner->tune(std::string("BatchedGreensSolver:") + (action == FirstBlock ? "FirstBlock" : "LastBlock") + ":problems:" + std::to_string(problems) + ":" + AutoTuner::problemSignature(sizes), candidates);
+
+		log() << "The tuned chunk size is " << winner << "." << std::endl;
+
+		return std::atol(winner.c_str());
+	}
+
+	long block_count() const {
+		return (H[0].isSquare() || H[0].blockRows() < H[0].blockCols() ? H[0].blockRows() : H[0].blockCols());
+	}
+
+public:
+	// only the FirstBlock and LastBlock are solved in batches.
+	void compute(const GreenMatrixSubType &action)
+	{
+		if (H.empty())
+			return;
+
+		if (action != FirstBlock && action != LastBlock)
+		{
+			log() << "Only the first and last block are solved in batches." << std::endl;
+			G.clear();
+			return;
+		}
+
+		const long start = (action == FirstBlock ? block_count() - 1 : 0);
+		const long stop = (action == FirstBlock ? 0 : block_count() - 1);
+		const long direction = (action == FirstBlock ? -1 : 1);
+
+		long size = chunk_size;
+
+		if (size <= 0)
+			size = (tuner != nullptr ? tune(action, start, stop, direction) : 64);
+
+		log() << "Preparing to solve " << H.size() << " problems of " << block_count() << " blocks in chunks of " << size << "." << std::endl;
+
+		compute_batched(start, stop, direction, std::max(1L, size));
+	}
+
+	// the number of singular blocks met in the last compute().
+	long singularCount() const {
+		return singular_count;
+	}
+
+	const std::vector<MatrixXcd> &greensMatrices() const {
+		return G;
+	}
+};
+
+LoggingObject BatchedGreensSolver::log("GreensFormalism::BatchedGreensSolver", false);
+
+}
+
+}
+
+#endif
@@ -4,6 +4,24 @@ Header file for QuantumMechanics::GreensFormalism::ChainSolver:
 This file solves a list of one or more matrices stored in a c-style array, stl-style vector,
 or a return from a function(int). When not using vector (or a single matrix) the 
 
+When the principal layer is a block tridiagonal stack and the hopping only couples its last
+block to the first block of the next layer, the decimation only changes the first and last
+diagonal blocks. The inner blocks are then eliminated once, and every decimation step
+inverts the reduced first and last block problem instead of the whole layer.
+
+With an initial guess, e.g. the surface greens matrix of the previous energy in a sweep, the
+Dyson equation g = (h - v g v*)^-1 is first solved by a Newton iteration from it. The
+decimation is only used when the iteration stops contracting, does not converge in time or
+converges to a root that grows into the chain, i.e. when the spectral radius of g v* is not
+below one. Without broadening inside a band that radius is one, and the decimation is used.
+The warm start is opt-in for direct users, and SurfaceGreensCache seeds it on a miss from the
+stored surface of the nearest lead with the same hopping.
+
+The surface solved by SurfaceGreensMatrix is the one of a chain continuing through V, i.e.
+the left surface. AllGreensMatrices also keeps the right surface, of a chain continuing
+through V*, and the bulk layer from the same decimation, where the right surface is updated
+by the beta G alpha already formed for the bulk.
+
 ---
 Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
  */
@@ -12,13 +30,17 @@ Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
 
 #include <Math/Dense>
 #include "../misc/LoggingObject"
+#include "../Misc/NumaTopology"
+#include "../LinearAlgebra/TiledInverse"
+#include "../LinearAlgebra/ComplexProduct"
 
 namespace QuantumMechanics {
 
 namespace GreensFormalism {
 
 	enum ResultType {
-		SurfaceGreensMatrix
+		SurfaceGreensMatrix,
+		AllGreensMatrices
 	};
 	
 class ChainSolver{
@@ -27,69 +49,386 @@ class ChainSolver{
 	const BlockMatrixXcd V;
 	BlockMatrixXcd G;
 
+	// the right surface and the bulk of AllGreensMatrices.
+	BlockMatrixXcd G_right;
+	BlockMatrixXcd G_bulk;
+
+	// the start of the Newton iteration, empty when not given.
+	MatrixXcd guess;
+
+	long warm_start_iterations;
+
+	NumaPolicy numa_policy;
+
 	static LoggingObject log;
 
 public:
 
 	long max_iterations;
 
-	ChainSolver(const BlockMatrixXcd &h, const BlockMatrixXcd &v) : H(h), V(v), max_iterations(1000) { }
+	// the inversion of epsilon in every decimation step.
+	LinearAlgebra::InversionBackend inversion_backend;
+
+	// the triple products of every decimation step.
+	LinearAlgebra::ProductSettings product_settings;
+
+	// decimate the reduced first and last block problem, when the hopping allows it.
+	bool block_decimation;
 
-	ChainSolver(const MatrixXcd &h, const MatrixXcd &v) : H(h), V(v), max_iterations(1000) { }
+	// the Newton iteration of a warm start, the tolerance is on the residual g (h - v g v*) - 1.
+	long max_warm_start_iterations;
+	double warm_start_tolerance;
+
+	ChainSolver(const BlockMatrixXcd &h, const BlockMatrixXcd &v) : H(h), V(v), warm_start_iterations(0), numa_policy(NumaFirstTouch), max_iterations(1000), inversion_backend(LinearAlgebra::VendorInversion), product_settings(), block_decimation(true), max_warm_start_iterations(20), warm_start_tolerance(1e-10) { }
+
+	ChainSolver(const MatrixXcd &h, const MatrixXcd &v) : H(h), V(v), warm_start_iterations(0), numa_policy(NumaFirstTouch), max_iterations(1000), inversion_backend(LinearAlgebra::VendorInversion), product_settings(), block_decimation(true), max_warm_start_iterations(20), warm_start_tolerance(1e-10) { }
 
 	static inline void enableLog()
 	{
 		log.enable();
 	}
 
+	// placement of the decimation matrices, of wide leads on multi-socket nodes or on the node of the calling thread.
+	void setNumaPolicy(const NumaPolicy &policy)
+	{
+		numa_policy = policy;
+	}
+
+	// the surface greens matrix of a nearby energy, used as the start of the iteration.
+	void setInitialGuess(const MatrixXcd &initial_guess)
+	{
+		guess = initial_guess;
+	}
+
 protected:
-	void compute_matrix()
+	// writes into the storage of G, such that a NUMA placement of G is kept.
+	void invert(const MatrixXcd &M)
+	{
+		if (inversion_backend == LinearAlgebra::TiledInversion)
+			G.noalias() = LinearAlgebra::tiledInverse(M);
+		else
+			G = M.inverse();
+	}
+
+	MatrixXcd product(const MatrixXcd &A, const MatrixXcd &B, const MatrixXcd &C) const
+	{
+		return LinearAlgebra::multiply(A, B, C, product_settings);
+	}
+
+	void compute_matrix(const bool &all_results)
 	{
 		const long block_count = (H.isSquare() || H.blockRows() < H.blockCols() ? H.blockRows() : H.blockCols());
 
 		log() << "Preparing to calculate the surface solution of " << block_count << "-by-" << block_count << " blocks chain parts." << std::endl;
 
-		MatrixXcd epsilon = H;
-		G = epsilon.inverse();
-		MatrixXcd epsilonsurf = epsilon;
+		NumaTopology topology;
+
+		MatrixXcd epsilon, epsilonsurf, epsilonright, alpha, beta;
+
+		// the working matrices are placed before their first touch and keep their size below.
+		topology.prepare(epsilon, H.rows(), H.cols(), numa_policy);
+		topology.prepare(epsilonsurf, H.rows(), H.cols(), numa_policy);
+		topology.prepare(alpha, V.rows(), V.cols(), numa_policy);
+		topology.prepare(beta, V.cols(), V.rows(), numa_policy);
+		topology.prepare(G, H.rows(), H.cols(), numa_policy);
 
-		MatrixXcd alpha = V;
-		MatrixXcd beta = V.adjoint();
+		epsilon = H;
+		invert(epsilon);
+		epsilonsurf = epsilon;
+
+		if (all_results)
+			epsilonright = epsilon;
+
+		alpha = V;
+		beta = V.adjoint();
 
 		auto valid = [&]() {
 
 			if (alpha.isZero(1.0e-12) && beta.isZero(1.0e-12))
-				return true;
+				return false;
+
+			return true;
+		};
+
+		for (int iter = 0; iter < max_iterations && valid(); iter++)
+		{
+			// alpha G beta and beta G alpha are shared by the bulk and the surfaces.
+			const MatrixXcd surface_term = product(alpha, G, beta);
+			const MatrixXcd right_term = product(beta, G, alpha);
+
+			epsilon -= (right_term + surface_term);
+			epsilonsurf -= surface_term;
+
+			if (all_results)
+				epsilonright -= right_term;
+
+			alpha = product(alpha, G, alpha);
+			beta = product(beta, G, beta);
+
+			invert(epsilon);
+		}
+
+		epsilonsurf -= product(alpha, G, beta);
+
+		if (all_results)
+		{
+			epsilonright -= product(beta, G, alpha);
+
+			G_bulk = G;
+			G_right = LinearAlgebra::inverse(epsilonright, inversion_backend);
+		}
+
+		invert(epsilonsurf);
+	}
+
+	// X - A X B = C by the complex Schur forms of A and B (Bartels-Stewart), column by column.
+	static MatrixXcd solve_stein(const MatrixXcd &A, const MatrixXcd &B, const MatrixXcd &C)
+	{
+		const ComplexSchur<MatrixXcd> schur_a(A), schur_b(B);
+
+		const MatrixXcd &U = schur_a.matrixU(), &T = schur_a.matrixT();
+		const MatrixXcd &W = schur_b.matrixU(), &S = schur_b.matrixT();
+
+		const MatrixXcd D = U.adjoint() * C * W;
+
+		MatrixXcd Y(D.rows(), D.cols());
+
+		for (long j = 0; j < D.cols(); j++)
+		{
+			VectorXcd rhs = D.col(j);
+
+			if (j > 0)
+				rhs += T * (Y.leftCols(j) * S.col(j).head(j));
+
+			const MatrixXcd system = MatrixXcd::Identity(T.rows(), T.cols()) - S(j, j) * T;
+
+			Y.col(j) = system.triangularView<Upper>().solve(rhs);
+		}
+
+		return U * Y * W.adjoint();
+	}
+
+	/*
+	The Newton iteration on the Dyson equation g = (h - v g v*)^-1 from the guess. The step X
+	solves g^-1 X g^-1 - v X v* = -(h - v g v* - g^-1), which becomes the Stein equation
+	X - (g v) X (v* g) = -R g with the residual R = g (h - v g v*) - 1. The iteration fails,
+	and the decimation takes over, when the residual stops decreasing. The Dyson equation also
+	has non-physical roots, which a guess far from the solution may reach, so a converged g is
+	only accepted when the spectral radius of g v* is below one.
+	*/
+	bool compute_warm_start()
+	{
+		if (guess.rows() != H.rows() || guess.cols() != H.cols())
+			return false;
+
+		const MatrixXcd V_adjoint = V.adjoint();
+		const MatrixXcd identity = MatrixXcd::Identity(H.rows(), H.cols());
+
+		MatrixXcd g = guess;
+
+		double last_residual = 0;
+
+		for (warm_start_iterations = 1; warm_start_iterations <= max_warm_start_iterations; warm_start_iterations++)
+		{
+			const MatrixXcd R = g * (H - product(V, g, V_adjoint)) - identity;
+			const double residual = R.norm();
+
+			if (residual <= warm_start_tolerance)
+				break;
 
+			if (warm_start_iterations > 1 && residual >= last_residual)
+			{
+				log() << "The warm started iteration does not contract after " << warm_start_iterations << " steps." << std::endl;
+				return false;
+			}
+
+			g += solve_stein(g * V, V_adjoint * g, - R * g);
+
+			last_residual = residual;
+		}
+
+		if (warm_start_iterations > max_warm_start_iterations)
+		{
+			log() << "The warm started iteration did not converge in " << max_warm_start_iterations << " steps." << std::endl;
 			return false;
+		}
+
+		// G_{n+1,0} = - g v* G_{n,0} into the chain, which only decays for the retarded root.
+		const double radius = ComplexEigenSolver<MatrixXcd>(g * V_adjoint, false).eigenvalues().cwiseAbs().maxCoeff();
+
+		if (radius >= 1)
+		{
+			log() << "The warm started iteration converged to a root growing into the chain, with a spectral radius of g v* of " << radius << "." << std::endl;
+			return false;
+		}
+
+		G = g;
+
+		return true;
+	}
+
+	// true when V only couples the last block of a layer to the first block of the next, and H is block tridiagonal.
+	bool corner_coupled() const
+	{
+		const long block_count = H.blockRows();
+
+		if (block_count < 2 || !H.isSquare() || V.blockRows() != block_count || V.blockCols() != block_count)
+			return false;
+
+		for (long i = 0; i < block_count; i++)
+			for (long j = 0; j < block_count; j++)
+				if ((i != block_count - 1 || j != 0) && !V.block(i, j).isZero(0))
+					return false;
+
+		// the elimination of the inner blocks only follows the nearest neighbour couplings of H.
+		for (long i = 0; i < block_count; i++)
+			for (long j = 0; j < block_count; j++)
+				if (std::abs(i - j) > 1 && !H.block(i, j).isZero(0))
+					return false;
+
+		return true;
+	}
+
+	/*
+	The decimation of a corner coupled layer: with a = V_{last,first} and b = a*, the updates
+	beta G alpha and alpha G beta only reach the first and last diagonal blocks, and alpha and
+	beta stay in their corners. Only the corner blocks of G are needed, which are found from
+	the Schur complement of the inner blocks, formed once by eliminating them in order.
+	*/
+	void compute_block_matrix(const bool &all_results)
+	{
+		const long block_count = H.blockRows();
+		const long first_size = H.block(0, 0).rows();
+		const long last_size = H.block(-1, -1).rows();
+
+		log() << "Preparing to calculate the surface solution by decimating the first and last of " << block_count << " blocks." << std::endl;
+
+		MatrixXcd first = H.block(0, 0), last = H.block(1, 1);
+		MatrixXcd first_to_last = H.block(0, 1), last_to_first = H.block(1, 0);
+
+		for (long b = 1; b < block_count - 1; b++)
+		{
+			const MatrixXcd g = last.inverse();
+			const MatrixXcd g_to_first = g * last_to_first;
+
+			first -= first_to_last * g_to_first;
+			first_to_last = - product(first_to_last, g, H.block(b, b + 1));
+			last_to_first = - H.block(b + 1, b) * g_to_first;
+			last = H.block(b + 1, b + 1) - product(H.block(b + 1, b), g, H.block(b, b + 1));
+		}
+
+		MatrixXcd reduced(first_size + last_size, first_size + last_size);
+
+		reduced << first, first_to_last, last_to_first, last;
+
+		MatrixXcd alpha = V.block(-1, 0);
+		MatrixXcd beta = alpha.adjoint();
+
+		MatrixXcd epsilon = reduced;
+		MatrixXcd surface = MatrixXcd::Zero(last_size, last_size);
+		MatrixXcd right = MatrixXcd::Zero(first_size, first_size);
+
+		MatrixXcd corners = LinearAlgebra::inverse(epsilon, inversion_backend);
+
+		auto valid = [&]() {
+
+			if (alpha.isZero(1.0e-12) && beta.isZero(1.0e-12))
+				return false;
+
+			return true;
 		};
 
 		for (int iter = 0; iter < max_iterations && valid(); iter++)
 		{
-			epsilon += (beta * G * alpha + alpha * G * beta);
-			epsilonsurf += (alpha * G * beta);
+			const MatrixXcd G_first = corners.topLeftCorner(first_size, first_size);
+			const MatrixXcd G_last = corners.bottomRightCorner(last_size, last_size);
+
+			const MatrixXcd surface_term = product(alpha, G_first, beta);
+			const MatrixXcd right_term = product(beta, G_last, alpha);
+
+			epsilon.topLeftCorner(first_size, first_size) -= right_term;
+			epsilon.bottomRightCorner(last_size, last_size) -= surface_term;
+			surface -= surface_term;
+			right -= right_term;
 
-			alpha = (alpha * G * alpha);
-			beta = (beta * G * beta);
+			const MatrixXcd next_alpha = product(alpha, corners.topRightCorner(first_size, last_size), alpha);
 
-			G = epsilon.inverse();
+			beta = product(beta, corners.bottomLeftCorner(last_size, first_size), beta);
+			alpha = next_alpha;
+
+			corners = LinearAlgebra::inverse(epsilon, inversion_backend);
 		}
 
-		epsilonsurf += (alpha * G * beta);
+		if (all_results)
+		{
+			// the bulk layer carries the updates of both ends.
+			MatrixXcd epsilonbulk = H;
+
+			epsilonbulk.topLeftCorner(first_size, first_size) += right;
+			epsilonbulk.bottomRightCorner(last_size, last_size) += surface;
+
+			G_bulk = LinearAlgebra::inverse(epsilonbulk, inversion_backend);
 
-		G = epsilonsurf.inverse();
+			right -= product(beta, corners.bottomRightCorner(last_size, last_size), alpha);
+
+			MatrixXcd epsilonright = H;
+
+			epsilonright.topLeftCorner(first_size, first_size) += right;
+
+			G_right = LinearAlgebra::inverse(epsilonright, inversion_backend);
+		}
+
+		surface -= product(alpha, corners.topLeftCorner(first_size, first_size), beta);
+
+		// the surface layer itself is inverted once.
+		MatrixXcd epsilonsurf = H;
+
+		epsilonsurf.bottomRightCorner(last_size, last_size) += surface;
+
+		NumaTopology topology;
+
+		topology.prepare(G, H.rows(), H.cols(), numa_policy);
+
+		invert(epsilonsurf);
 	}
 		
 public:
 	inline void compute(const ResultType &action)
 	{
-		if (action == SurfaceGreensMatrix)
-			compute_matrix();
+		warm_start_iterations = 0;
+
+		if (action == SurfaceGreensMatrix && guess.size() > 0 && compute_warm_start())
+			return;
+
+		warm_start_iterations = 0;
+
+		G_right = MatrixXcd();
+		G_bulk = MatrixXcd();
+
+		if (block_decimation && corner_coupled())
+			compute_block_matrix(action == AllGreensMatrices);
+		else
+			compute_matrix(action == AllGreensMatrices);
 	}
 
+	// the left surface.
 	const BlockMatrixXcd &greensMatrix() const {
 		return G;
 	}
+
+	// only set by AllGreensMatrices.
+	const BlockMatrixXcd &rightSurfaceGreensMatrix() const {
+		return G_right;
+	}
+
+	const BlockMatrixXcd &bulkGreensMatrix() const {
+		return G_bulk;
+	}
+
+	// the steps of the warm started iteration, zero if it was not used or failed.
+	long warmStartIterations() const {
+		return warm_start_iterations;
+	}
 };
 
 LoggingObject ChainSolver::log("GreensFormalism::ChainSolver", false);
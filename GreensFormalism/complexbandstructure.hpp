@@ -0,0 +1,264 @@
+/*
+Header file for QuantumMechanics::GreensFormalism::ComplexBandStructure: 
+
+This file finds the complex band structure of a lead with the hamilton matrix h of a layer
+and the hopping v to the next layer, i.e. all Bloch factors lambda = exp(ik) at an energy E
+that solve the quadratic eigenvalue problem (h - E + v lambda + v* / lambda) psi = 0,
+including the evanescent modes with |lambda| != 1.
+
+The orbitals without hopping are eliminated first, (E - h_uu)^-1 is applied through the
+eigendecomposition of h_uu that is found once and reused for every energy. The remaining
+problem is linearized to a companion pencil A - lambda B of twice the number of coupled
+orbitals, which is solved as the ordinary eigenvalue problem (A - sigma B)^-1 B with a fixed
+shift sigma, such that a singular hopping only gives infinite lambda instead of a singular B.
+
+The velocities of the propagating modes (|lambda| = 1) are dE/dk = psi* i(v lambda - v* / lambda) psi,
+where modes of the same lambda are first diagonalized within their degenerate subspace.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _GREENSFORMALISM_COMPLEXBANDSTRUCTURE_H_
+#define _GREENSFORMALISM_COMPLEXBANDSTRUCTURE_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+#include "../LinearAlgebra/IndexSelection"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace QuantumMechanics {
+
+namespace GreensFormalism {
+
+class ComplexBandStructure {
+
+	const MatrixXcd h;
+	const MatrixXcd v;
+
+	double tolerance;
+
+	std::vector<long> coupled;
+	std::vector<long> uncoupled;
+
+	MatrixXcd h_cc;
+	MatrixXcd v_cc;
+
+	// h_uu = Q diag(D) Q*, and W = Q* h_uc.
+	VectorXd D;
+	MatrixXcd Q;
+	MatrixXcd W;
+
+	VectorXcd lambda;
+	VectorXd propagating_k;
+	VectorXd velocity;
+
+	static LoggingObject log;
+
+public:
+	// orbitals with hopping below 1e-12 of its largest element are uncoupled, and modes with
+	// ||lambda| - 1| below the mode tolerance propagate.
+	ComplexBandStructure(const MatrixXcd &hamilton, const MatrixXcd &hopping, const double &mode_tolerance = 1e-8) :
+		h(hamilton), v(hopping), tolerance(mode_tolerance)
+	{
+		const long n = h.rows();
+		const double threshold = 1e-12 * (v.size() > 0 ? v.cwiseAbs().maxCoeff() : 0.0);
+
+		for (long i = 0; i < n; i++)
+		{
+			if (v.row(i).cwiseAbs().maxCoeff() > threshold || v.col(i).cwiseAbs().maxCoeff() > threshold)
+				coupled.push_back(i);
+			else
+				uncoupled.push_back(i);
+		}
+
+		h_cc = LinearAlgebra::select(h, coupled, coupled);
+		v_cc = LinearAlgebra::select(v, coupled, coupled);
+
+		if (!uncoupled.empty())
+		{
+			SelfAdjointEigenSolver<MatrixXcd> eigen(LinearAlgebra::select(h, uncoupled, uncoupled));
+
+			D = eigen.eigenvalues();
+			Q = eigen.eigenvectors();
+			W = Q.adjoint() * LinearAlgebra::select(h, uncoupled, coupled);
+		}
+
+		log() << coupled.size() << " of " << n << " orbitals are coupled to the next layer." << std::endl;
+	}
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+protected:
+	// the mode on all orbitals of the layer, from its coupled part.
+	VectorXcd full_mode(const VectorXcd &psi_c, const double &energy) const
+	{
+		VectorXcd psi(h.rows());
+
+		for (std::size_t i = 0; i < coupled.size(); i++)
+			psi[coupled[i]] = psi_c[i];
+
+		if (!uncoupled.empty())
+		{
+			const VectorXcd psi_u = Q * ((energy - D.array()).inverse().matrix().cast<std::complex<double> >().asDiagonal() * (W * psi_c));
+
+			for (std::size_t i = 0; i < uncoupled.size(); i++)
+				psi[uncoupled[i]] = psi_u[i];
+		}
+
+		return psi;
+	}
+
+public:
+	void compute(const double &energy)
+	{
+		const long m = coupled.size();
+
+		lambda.resize(0);
+		propagating_k.resize(0);
+		velocity.resize(0);
+
+		if (m == 0)
+			return;
+
+		MatrixXcd h_eff = h_cc;
+
+		if (!uncoupled.empty())
+			h_eff += W.adjoint() * (energy - D.array()).inverse().matrix().cast<std::complex<double> >().asDiagonal() * W;
+
+		// A x = lambda B x for x = [psi; lambda psi].
+		MatrixXcd A = MatrixXcd::Zero(2 * m, 2 * m), B = MatrixXcd::Zero(2 * m, 2 * m);
+
+		A.topRightCorner(m, m).setIdentity();
+		A.bottomLeftCorner(m, m) = - v_cc.adjoint();
+		A.bottomRightCorner(m, m) = MatrixXcd::Identity(m, m) * energy - h_eff;
+
+		B.topLeftCorner(m, m).setIdentity();
+		B.bottomRightCorner(m, m) = v_cc;
+
+		const std::complex<double> sigma(0.43, 0.27);
+
+		const ComplexEigenSolver<MatrixXcd> eigen((A - sigma * B).partialPivLu().solve(B));
+
+		const VectorXcd &mu = eigen.eigenvalues();
+		const double largest = mu.cwiseAbs().maxCoeff();
+
+		std::vector<std::complex<double> > factors;
+		std::vector<VectorXcd> modes;
+
+		for (long e = 0; e < 2 * m; e++)
+		{
+			// mu = 1 / (lambda - sigma) vanishes for infinite lambda.
+			if (std::abs(mu[e]) <= 1e-12 * largest)
+				continue;
+
+			factors.push_back(sigma + 1.0 / mu[e]);
+			modes.push_back(eigen.eigenvectors().col(e).head(m));
+		}
+
+		lambda.resize(factors.size());
+
+		for (std::size_t e = 0; e < factors.size(); e++)
+			lambda[e] = factors[e];
+
+		// the propagating modes, grouped by their wavenumber.
+		std::vector<std::pair<double, long> > open;
+
+		for (std::size_t e = 0; e < factors.size(); e++)
+			if (std::abs(std::abs(factors[e]) - 1) < tolerance)
+				open.push_back(std::make_pair(std::arg(factors[e]), (long) e));
+
+		std::sort(open.begin(), open.end());
+
+		propagating_k.resize(open.size());
+		velocity.resize(open.size());
+
+		for (std::size_t first = 0; first < open.size(); )
+		{
+			std::size_t last = first + 1;
+
+			while (last < open.size() && open[last].first - open[first].first < tolerance)
+				last++;
+
+			const std::complex<double> l = factors[open[first].second];
+
+			MatrixXcd psi(h.rows(), last - first);
+
+			for (std::size_t e = first; e < last; e++)
+				psi.col(e - first) = full_mode(modes[open[e].second], energy);
+
+			const MatrixXcd basis = HouseholderQR<MatrixXcd>(psi).householderQ() * MatrixXcd::Identity(h.rows(), last - first);
+
+			const std::complex<double> i_unit(0, 1);
+			const MatrixXcd dh_dk = i_unit * (v * l - v.adjoint() / l);
+
+			const MatrixXcd projected = basis.adjoint() * dh_dk * basis;
+
+			const VectorXd speeds = SelfAdjointEigenSolver<MatrixXcd>(projected).eigenvalues();
+
+			for (std::size_t e = first; e < last; e++)
+			{
+				propagating_k[e] = open[first].first;
+				velocity[e] = speeds[e - first];
+			}
+
+			first = last;
+		}
+
+		log() << "At the energy " << energy << " there are " << factors.size() << " finite modes, of which " << open.size() << " propagate." << std::endl;
+	}
+
+	// the finite Bloch factors exp(ik) of the last energy.
+	const VectorXcd &blochFactors() const {
+		return lambda;
+	}
+
+	// k = -i log(lambda), with the decay in the imaginary part.
+	VectorXcd wavenumbers() const
+	{
+		VectorXcd result(lambda.size());
+
+		for (long e = 0; e < lambda.size(); e++)
+			result[e] = std::complex<double>(std::arg(lambda[e]), - std::log(std::abs(lambda[e])));
+
+		return result;
+	}
+
+	long propagatingModeCount() const {
+		return velocity.size();
+	}
+
+	// the wavenumbers and velocities of the propagating modes, in the same order.
+	const VectorXd &propagatingWavenumbers() const {
+		return propagating_k;
+	}
+
+	const VectorXd &velocities() const {
+		return velocity;
+	}
+
+	// the open channels in one direction, i.e. the modes with a positive velocity.
+	long channelCount() const
+	{
+		long count = 0;
+
+		for (long e = 0; e < velocity.size(); e++)
+			if (velocity[e] > 0)
+				count++;
+
+		return count;
+	}
+};
+
+LoggingObject ComplexBandStructure::log("GreensFormalism::ComplexBandStructure", false);
+
+}
+
+}
+
+#endif
@@ -12,7 +12,18 @@ Copyright (C) 2014, S
 
 #include <Math/Dense>
 #include "../misc/LoggingObject"
-
+#include "../Misc/NumaTopology"
+#include "../Misc/AutoTuner"
+#include "../LinearAlgebra/TiledMatrix"
+#include "../LinearAlgebra/TiledLU"
+#include "../LinearAlgebra/TiledInverse"
+#include "../LinearAlgebra/HierarchicalMatrix"
+#include "../LinearAlgebra/ComplexProduct"
+#include "SolverPlanner"
+
+#include <tbb/tbb.h>
+
+#include <memory>
 #include <vector>
 
 namespace QuantumMechanics {
@@ -26,6 +37,13 @@ namespace GreensFormalism {
 		FirstBlockColumn,
 		LastBlockColumn
 	};
+
+	// how the self-energy recursions of FirstBlock and LastBlock apply the inverse of a block.
+	enum BlockInversion {
+		ExplicitInverse,
+		LUSolve,
+		HierarchicalInverse
+	};
 	
 class GreensSolver {
 
@@ -33,18 +51,164 @@ class GreensSolver {
 	MatrixXcd sigma;
 	BlockMatrixXcd G;
 
+	// the FullMatrix of the out-of-core inverse, left in its scratch file.
+	std::shared_ptr<LinearAlgebra::TiledMatrix> tiled_G;
+
+	NumaPolicy numa_policy;
+
+	// in bytes, zero disables the planning step.
+	double memory_budget;
+
+	BlockInversion block_inversion;
+
+	// set by setBlockInversion(), the tuner then keeps the given inversion.
+	bool block_inversion_fixed;
+
+	// not owned, null disables tuning.
+	AutoTuner *tuner;
+
+	// used by the out-of-core inverse.
+	std::string scratch_directory;
+	long tile_size;
+
+	// used by the dense inverse of FullMatrix.
+	LinearAlgebra::InversionBackend inversion_backend;
+	long inversion_tile_size;
+
+	// used by the HierarchicalInverse block inversion.
+	double hierarchical_tolerance;
+	long hierarchical_leaf_size;
+
+	// the rank of the final self-energy of the HierarchicalInverse recursion, -1 when it was formed densely.
+	long self_energy_rank;
+
+	// used by the self-energy products.
+	LinearAlgebra::ProductSettings product_settings;
+
 	static LoggingObject log;
 
 public:
-	GreensSolver(const BlockMatrixXcd &M) : H(M), sigma(), G() {}
+	GreensSolver(const BlockMatrixXcd &M) : H(M), sigma(), G(), tiled_G(), numa_policy(NumaFirstTouch), memory_budget(0), block_inversion(ExplicitInverse), block_inversion_fixed(false), tuner(nullptr), scratch_directory(), tile_size(1024), inversion_backend(LinearAlgebra::VendorInversion), inversion_tile_size(128), hierarchical_tolerance(1e-10), hierarchical_leaf_size(64), self_energy_rank(-1), product_settings() {}
 
-	GreensSolver(const MatrixXcd &M) : H(M), sigma(), G() {}
+	GreensSolver(const MatrixXcd &M) : H(M), sigma(), G(), tiled_G(), numa_policy(NumaFirstTouch), memory_budget(0), block_inversion(ExplicitInverse), block_inversion_fixed(false), tuner(nullptr), scratch_directory(), tile_size(1024), inversion_backend(LinearAlgebra::VendorInversion), inversion_tile_size(128), hierarchical_tolerance(1e-10), hierarchical_leaf_size(64), self_energy_rank(-1), product_settings() {}
 
 	static inline void enableLog()
 	{
 		log.enable();
 	}
 
+	// placement of the large dense matrices of FullMatrix on multi-socket nodes.
+	void setNumaPolicy(const NumaPolicy &policy)
+	{
+		numa_policy = policy;
+	}
+
+	// with a budget, compute() first plans the algorithm and refuses to run if nothing fits.
+	void setMemoryBudget(const double &bytes)
+	{
+		memory_budget = bytes;
+	}
+
+	// the out-of-core inverse is only chosen by the planner, when the dense inverse does not fit.
+	void setScratchDirectory(const std::string &directory, const long &tile = 1024)
+	{
+		scratch_directory = directory;
+		tile_size = tile;
+	}
+
+	// the tiled backend schedules the inverse of FullMatrix as a TBB task graph.
+	void setInversionBackend(const LinearAlgebra::InversionBackend &backend, const long &tile = 128)
+	{
+		inversion_backend = backend;
+		inversion_tile_size = tile;
+	}
+
+	// an explicit choice is never overridden by the tuner.
+	void setBlockInversion(const BlockInversion &inversion)
+	{
+		block_inversion = inversion;
+		block_inversion_fixed = true;
+	}
+
+	BlockInversion blockInversion() const {
+		return block_inversion;
+	}
+
+	// the relative tolerance of the low-rank parts and the size of the dense leafs.
+	void setHierarchicalTolerance(const double &tolerance, const long &leaf_size = 64)
+	{
+		hierarchical_tolerance = tolerance;
+		hierarchical_leaf_size = leaf_size;
+	}
+
+	// the rank of the self-energy kept in low-rank form by the last HierarchicalInverse solve, -1 if it was dense.
+	long selfEnergyRank() const {
+		return self_energy_rank;
+	}
+
+	// the 3M product is used for the self-energies of blocks above the threshold.
+	void setProductSettings(const LinearAlgebra::ProductSettings &settings)
+	{
+		product_settings = settings;
+	}
+
+	// with a tuner, compute() picks the algorithm and, unless set explicitly, the block inversion
+	// from the tuning file, or benchmarks the candidates (within the memory budget) on the first
+	// run of a signature. The batch width and the energy against BLAS parallelism of many
+	// problems are tuned by BatchedGreensSolver.
+	void setAutoTuner(AutoTuner *auto_tuner)
+	{
+		tuner = auto_tuner;
+	}
+
+	ArrayXi blockSizes() const
+	{
+		const long block_count = (H.isSquare() || H.blockRows() < H.blockCols() ? H.blockRows() : H.blockCols());
+
+		ArrayXi sizes(block_count);
+
+		for (long b = 0; b < block_count; b++)
+			sizes[b] = H.block(b, b).rows();
+
+		return sizes;
+	}
+
+	SolverPlanner plan(const GreenMatrixSubType &action) const
+	{
+		const ArrayXi sizes = blockSizes();
+		const long n = sizes.sum();
+
+		long rows = n, cols = n;
+
+		switch(action)
+		{
+		case FullMatrix:
+			break;
+		case FirstBlock:
+			rows = cols = sizes[0];
+			break;
+		case LastBlock:
+			rows = cols = sizes[sizes.size() - 1];
+			break;
+		case FirstBlockColumn:
+			cols = sizes[0];
+			break;
+		case LastBlockColumn:
+			cols = sizes[sizes.size() - 1];
+			break;
+		}
+
+		SolverPlanner planner(memory_budget);
+
+		planner.add(SolverPlanner::denseInverse(sizes, rows, cols));
+		planner.add(SolverPlanner::recursiveGreens(sizes, rows, cols));
+		planner.add(SolverPlanner::outOfCoreInverse(sizes, rows, cols, tile_size, tbb::this_task_arena::max_concurrency()));
+
+		planner.choose();
+
+		return planner;
+	}
+
 protected:
 	void compute_full_matrix() 
 	{
@@ -56,11 +220,171 @@ protected:
 
 		log() << "The reduced sigma has been set to zeros." << std::endl;
 
-		G = H.inverse();
+		if (numa_policy != NumaFirstTouch)
+		{
+			NumaTopology topology;
+
+			// both the factorization and the result are placed before they are first touched.
+			MatrixXcd factors;
+
+			topology.prepare(factors, H.rows(), H.cols(), numa_policy);
+			topology.prepare(G, H.rows(), H.cols(), numa_policy);
+
+			log() << "The matrices are placed over " << topology.nodeCount() << " NUMA nodes." << std::endl;
+
+			factors = H;
+
+			// factorizes in place, such that the LU factors stay in the placed storage.
+			PartialPivLU<Ref<MatrixXcd> > lu(factors);
+
+			// G already has the right size, so the assignment writes into the placed storage.
+			G = lu.inverse();
+			G.withBlocks(H);
+		}
+		else if (inversion_backend == LinearAlgebra::TiledInversion)
+		{
+			G = LinearAlgebra::tiledInverse(H, inversion_tile_size);
+			G.withBlocks(H);
+		}
+		else
+			G = H.inverse();
 
 		log() << "The solution is saved." << std::endl;
 	}
 
+	void compute_full_matrix_recursive()
+	{
+		const long block_count = (H.isSquare() || H.blockRows() < H.blockCols() ? H.blockRows() : H.blockCols());
+
+		log() << "Preparing to calculate the full solution of " << block_count << "-by-" << block_count << " blocks recursively." << std::endl;
+
+		std::vector<MatrixXcd> left(block_count, MatrixXcd());
+		std::vector<MatrixXcd> right(block_count, MatrixXcd());
+
+		log() << "The algorithm wil recursively find the isolated greens matrices connected to the left and to the right." << std::endl;
+
+		sigma = H.block(0, 0).asZero();
+
+		for (long b = 0; b < block_count; b++)
+		{
+			left[b] = (H.block(b, b) - sigma).inverse();
+
+			if (b + 1 < block_count)
+				sigma = product(H.block(b + 1, b), left[b], H.block(b, b + 1));
+		}
+
+		sigma = H.block(-1, -1).asZero();
+
+		for (long b = block_count - 1; b >= 0; b--)
+		{
+			right[b] = (H.block(b, b) - sigma).inverse();
+
+			if (b > 0)
+				sigma = product(H.block(b - 1, b), right[b], H.block(b, b - 1));
+		}
+
+		G = H.blocks(0, 0, block_count, block_count).asZero();
+
+		log() << "The block columns are calculated from the intermediate greens matrices." << std::endl;
+
+		tbb::parallel_for(0L, block_count, [&](const long &j) {
+
+			MatrixXcd self_energy = H.block(j, j).asZero();
+
+			if (j > 0)
+				self_energy += product(H.block(j, j - 1), left[j - 1], H.block(j - 1, j));
+			if (j + 1 < block_count)
+				self_energy += product(H.block(j, j + 1), right[j + 1], H.block(j + 1, j));
+
+			G.block(j, j) = (H.block(j, j) - self_energy).inverse();
+
+			for (long i = j + 1; i < block_count; i++)
+				G.block(i, j) = - right[i] * H.block(i, i - 1) * G.block(i - 1, j);
+
+			for (long i = j - 1; i >= 0; i--)
+				G.block(i, j) = - left[i] * H.block(i, i + 1) * G.block(i + 1, j);
+		});
+
+		log() << "The solution is finished." << std::endl;
+	}
+
+	MatrixXcd product(const MatrixXcd &A, const MatrixXcd &B) const
+	{
+		return LinearAlgebra::multiply(A, B, product_settings);
+	}
+
+	MatrixXcd product(const MatrixXcd &A, const MatrixXcd &B, const MatrixXcd &C) const
+	{
+		return LinearAlgebra::multiply(A, B, C, product_settings);
+	}
+
+	// the isolated greens matrix of a block applied to its coupling, A^-1 X.
+	MatrixXcd isolated_solve(const MatrixXcd &A, const MatrixXcd &X) const
+	{
+		switch(block_inversion)
+		{
+		case LUSolve:
+			return A.partialPivLu().solve(X);
+		default:
+			return A.inverse() * X;
+		}
+	}
+
+	/*
+	The self-energy recursion of HierarchicalInverse over count blocks from begin, in steps of
+	step. Every block minus its self-energy is compressed and inverted hierarchically. While the
+	couplings are low-rank, H(b + step, b) = P Q* and H(b, b + step) = R S*, the self-energy
+	stays the low-rank product P (Q* g R) S*: it is added to the next block as a low-rank
+	update and never formed densely. A coupling of more than a quarter of the block rank, like
+	the t I between the slices of a 2D device, ends that, and the rest of the recursion forms
+	sigma densely with only the inversions compressed.
+	*/
+	void hierarchical_self_energy(const long &begin, const long &step, const long &count)
+	{
+		MatrixXcd sigma_u, sigma_v;
+
+		bool low_rank = true;
+
+		for (long k = 0, b = begin; k < count; k++, b += step)
+		{
+			LinearAlgebra::HierarchicalMatrix A(low_rank ? MatrixXcd(H.block(b, b)) : MatrixXcd(H.block(b, b) - sigma), hierarchical_tolerance, hierarchical_leaf_size);
+
+			if (low_rank && sigma_u.cols() > 0)
+				A.addLowRank(- sigma_u, sigma_v);
+
+			const LinearAlgebra::HierarchicalMatrix g = A.inverse();
+
+			if (low_rank)
+			{
+				MatrixXcd P, Q, R, S;
+
+				LinearAlgebra::HierarchicalMatrix::approximate(H.block(b + step, b), hierarchical_tolerance, P, Q);
+				LinearAlgebra::HierarchicalMatrix::approximate(H.block(b, b + step), hierarchical_tolerance, R, S);
+
+				if (4 * std::max(Q.cols(), R.cols()) <= g.rows())
+				{
+					sigma_u = P * (g.adjointMultiply(Q).adjoint() * R);
+					sigma_v = S;
+
+					LinearAlgebra::HierarchicalMatrix::recompress(sigma_u, sigma_v, hierarchical_tolerance);
+
+					continue;
+				}
+
+				log() << "The coupling of block " << b << " is not low-rank, the self-energy is formed densely from here." << std::endl;
+
+				low_rank = false;
+			}
+
+			sigma = product(H.block(b + step, b), g.multiply(H.block(b, b + step)));
+		}
+
+		self_energy_rank = (low_rank ? sigma_u.cols() : -1);
+
+		if (low_rank && count > 0)
+			sigma = sigma_u * sigma_v.adjoint();
+	}
+
 	void compute_last_block()
 	{
 		const long block_count = (H.isSquare() || H.blockRows() < H.blockCols() ? H.blockRows() : H.blockCols());
@@ -71,8 +395,11 @@ protected:
 
 		log() << "The algorithm wil recursively find the self-energy of the left cells." << std::endl;
 
-		for (long b = 0; b < block_count - 1; b++)
-			sigma = H.block(b + 1, b) * (H.block(b, b) - sigma).inverse() * H.block(b, b + 1);
+		if (block_inversion == HierarchicalInverse)
+			hierarchical_self_energy(0, 1, block_count - 1);
+		else
+			for (long b = 0; b < block_count - 1; b++)
+				sigma = product(H.block(b + 1, b), isolated_solve(H.block(b, b) - sigma, H.block(b, b + 1)));
 
 		log() << "The final self-energy became:" << std::endl << std::endl << sigma << std::endl << std::endl;
 
@@ -94,8 +421,11 @@ protected:
 
 		log() << "The algorithm wil recursively find the self-energy of the left cells." << std::endl;
 
-		for (long b = -1; b >= -(block_count - 1); b--)
-			sigma = H.block(b - 1, b) * (H.block(b, b) - sigma).inverse() * H.block(b, b - 1);
+		if (block_inversion == HierarchicalInverse)
+			hierarchical_self_energy(-1, -1, block_count - 1);
+		else
+			for (long b = -1; b >= -(block_count - 1); b--)
+				sigma = product(H.block(b - 1, b), isolated_solve(H.block(b, b) - sigma, H.block(b, b - 1)));
 
 		log() << "The final self-energy became:" << std::endl << std::endl << sigma << std::endl << std::endl;
 
@@ -122,7 +452,7 @@ protected:
 		for (long b = -1; b > -block_count; b--)
 		{
 			g[-b - 1] = (H.block(b, b) - sigma).inverse();
-			sigma = H.block(b - 1, b) * g[-b - 1] * H.block(b, b - 1);
+			sigma = product(H.block(b - 1, b), g[-b - 1], H.block(b, b - 1));
 		}
 
 		log() << "The final self-energy became:" << std::endl << std::endl << sigma << std::endl << std::endl;
@@ -161,7 +491,7 @@ protected:
 		for (long b = 0; b < block_count - 1; b++)
 		{
 			g[b] = (H.block(b, b) - sigma).inverse();
-			sigma = H.block(b + 1, b) * g[b] * H.block(b, b + 1);
+			sigma = product(H.block(b + 1, b), g[b], H.block(b, b + 1));
 		}
 
 		log() << "The final self-energy became:" << std::endl << std::endl << sigma << std::endl << std::endl;
@@ -185,13 +515,123 @@ protected:
 		log() << "The solution is finished." << std::endl;
 	}
 	
-public:
-	void compute(const GreenMatrixSubType &action)
+	// the inverse is found in a scratch file, from which only the requested part is read back.
+	void compute_out_of_core(const GreenMatrixSubType &action)
 	{
+		using namespace LinearAlgebra;
+
+		const ArrayXi sizes = blockSizes();
+		const long n = sizes.sum();
+
+		log() << "Preparing to calculate the solution out of core in tiles of " << tile_size << "." << std::endl;
+
+		G = BlockMatrixXcd();
+
+		TiledMatrix A(n, tile_size, scratch_directory);
+		std::shared_ptr<TiledMatrix> result(new TiledMatrix(n, tile_size, scratch_directory));
+
+		TiledMatrix &inverse = *result;
+
+		if (!A.valid() || !inverse.valid())
+		{
+			log() << "The scratch files could not be created, nothing is computed." << std::endl;
+			return;
+		}
+
+		A.setFrom([this](const long &row, const long &col, Map<MatrixXcd> tile) {
+			tile = H.matrix().block(row, col, tile.rows(), tile.cols());
+		});
+
+		TiledLU lu(A);
+
+		lu.factorize();
+
+		if (lu.isSingular())
+		{
+			log() << "The matrix is singular, nothing is computed." << std::endl;
+			return;
+		}
+
+		lu.inverse(inverse);
+
+		const long first = sizes[0], last = sizes[sizes.size() - 1];
+
+		// the full inverse would not fit in memory either, so it is streamed from the scratch file.
+		if (action == FullMatrix)
+		{
+			log() << "The solution is kept in the scratch file, see tiledGreensMatrix()." << std::endl;
+
+			tiled_G = result;
+			return;
+		}
+
+		log() << "The solution is read back from the scratch file." << std::endl;
+
 		switch(action)
 		{
 		case FullMatrix:
-			compute_full_matrix();
+			break;
+		case FirstBlock:
+			G = inverse.block(0, 0, first, first);
+			break;
+		case LastBlock:
+			G = inverse.block(n - last, n - last, last, last);
+			break;
+		case FirstBlockColumn:
+			G = inverse.block(0, 0, n, first);
+			break;
+		case LastBlockColumn:
+			G = inverse.block(0, n - last, n, last);
+			break;
+		}
+	}
+
+	// the dense algorithm for a partial result, extracted from the full inverse.
+	void compute_dense_part(const GreenMatrixSubType &action)
+	{
+		const long block_count = (H.isSquare() || H.blockRows() < H.blockCols() ? H.blockRows() : H.blockCols());
+
+		compute_full_matrix();
+
+		G.withBlocks(H);
+
+		switch(action)
+		{
+		case FullMatrix:
+			break;
+		case FirstBlock:
+			G = BlockMatrixXcd(G.blocks(0, 0, 1, 1));
+			break;
+		case LastBlock:
+			G = BlockMatrixXcd(G.blocks(-1, -1, 1, 1));
+			break;
+		case FirstBlockColumn:
+			G = BlockMatrixXcd(G.blocks(0, 0, block_count, 1));
+			break;
+		case LastBlockColumn:
+			G = BlockMatrixXcd(G.blocks(0, -1, block_count, 1));
+			break;
+		}
+	}
+
+	void execute(const GreenMatrixSubType &action, const GreensAlgorithm &algorithm)
+	{
+		if (algorithm == DenseInverse)
+		{
+			compute_dense_part(action);
+			return;
+		}
+
+		if (algorithm == OutOfCoreInverse)
+		{
+			compute_out_of_core(action);
+			return;
+		}
+
+		switch(action)
+		{
+		case FullMatrix:
+			compute_full_matrix_recursive();
 			break;
 		case FirstBlock:
 			compute_first_block();
@@ -208,6 +648,78 @@ public:
 		}
 	}
 
+	GreensAlgorithm tune(const GreenMatrixSubType &action, const SolverPlanner &planner)
+	{
+		static const char *action_names[] = { "FullMatrix", "FirstBlock", "LastBlock", "FirstBlockColumn", "LastBlockColumn" };
+
+		AutoTuner::CandidateList candidates;
+
+		for (auto &estimate : planner.candidates())
+		{
+			if (!planner.fits(estimate))
+				continue;
+
+			if (estimate.algorithm == DenseInverse)
+				candidates.push_back(std::make_pair(std::string("dense"), std::function<void()>([this, action]() { execute(action, DenseInverse); })));
+			else if (estimate.algorithm == OutOfCoreInverse)
+				candidates.push_back(std::make_pair(std::string("out-of-core"), std::function<void()>([this, action]() { execute(action, OutOfCoreInverse); })));
+			else if (block_inversion_fixed)
+				candidates.push_back(std::make_pair(std::string("recursive"), std::function<void()>([this, action]() { execute(action, RecursiveGreens); })));
+			else
+			{
+				candidates.push_back(std::make_pair(std::string("recursive-inverse"), std::function<void()>([this, action]() { block_inversion = ExplicitInverse; execute(action, RecursiveGreens); })));
+
+				if (action == FirstBlock || action == LastBlock)
+					candidates.push_back(std::make_pair(std::string("recursive-lu"), std::function<void()>([this, action]() { block_inversion = LUSolve; execute(action, RecursiveGreens); })));
+			}
+		}
+
+		// a fixed inversion is part of the problem, its winners are kept apart.
+		const std::string fixed = (block_inversion_fixed ? ":inversion" + std::to_string(block_inversion) : std::string());
+
+		const std::string winner = tuner->tune(std::string("GreensSolver:") + action_names[action] + fixed + ":" + AutoTuner::problemSignature(blockSizes()), candidates);
+
+		log() << "The tuned configuration is " << winner << "." << std::endl;
+
+		if (!block_inversion_fixed)
+			block_inversion = (winner == "recursive-lu" ? LUSolve : ExplicitInverse);
+
+		if (winner == "dense")
+			return DenseInverse;
+		if (winner == "out-of-core")
+			return OutOfCoreInverse;
+
+		return RecursiveGreens;
+	}
+
+public:
+	void compute(const GreenMatrixSubType &action)
+	{
+		tiled_G.reset();
+
+		// as default, the full matrix is inverted densely and every part is found recursively.
+		GreensAlgorithm algorithm = (action == FullMatrix ? DenseInverse : RecursiveGreens);
+
+		if (memory_budget > 0 || tuner != nullptr)
+		{
+			SolverPlanner planner = plan(action);
+
+			if (memory_budget > 0)
+				SolverPlanner::log() << std::endl << planner;
+
+			if (!planner.feasible())
+			{
+				log() << "Nothing is computed, since no algorithm fits the memory budget." << std::endl;
+				G = BlockMatrixXcd();
+				return;
+			}
+
+			algorithm = (tuner != nullptr ? tune(action, planner) : planner.choice().algorithm);
+		}
+
+		execute(action, algorithm);
+	}
+
 	const MatrixXcd &reducedSigma() {
 		return sigma;
 	}
@@ -216,6 +728,11 @@ public:
 	const BlockMatrixXcd &greensMatrix() const {
 		return G;
 	}
+
+	// the FullMatrix when the out-of-core inverse was used, G is then empty. Null otherwise.
+	const LinearAlgebra::TiledMatrix *tiledGreensMatrix() const {
+		return tiled_G.get();
+	}
 };
 
 LoggingObject GreensSolver::log("GreensFormalism::GreensSolver", false);
@@ -0,0 +1,215 @@
+/*
+Header file for QuantumMechanics::GreensFormalism::PrincipalLayer: 
+
+This file finds the thinnest principal layer of a lead given by a (possibly thick) layer h
+and its hopping v to the next layer. The smallest cell size for which h and v are block
+Toeplitz is found, i.e. h_ij = t_{j-i} and v_ij = t_{j-i+K} for the K cells of the layer,
+and the hopping range R is the largest distance d with a nonzero t_d. A layer of R cells then
+only couples to its nearest layers, and the decimation of it costs (R/K)^3 of the original.
+
+The surface greens matrix g of the minimal layer is mapped back to the original layer by one
+inversion, (h - P v' g v'* P^T)^-1, where P places the minimal hopping v' on the last R cells.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _GREENSFORMALISM_PRINCIPALLAYER_H_
+#define _GREENSFORMALISM_PRINCIPALLAYER_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+#include "ChainSolver"
+
+#include <algorithm>
+#include <map>
+
+namespace QuantumMechanics {
+
+namespace GreensFormalism {
+
+class PrincipalLayer {
+
+	const MatrixXcd h;
+	const MatrixXcd v;
+
+	long cell_size;
+	long cell_count;
+	long hopping_range;
+
+	// t_d between cells at distance d, from h for |d| < K and from v above.
+	std::map<long, MatrixXcd> hoppings;
+
+	static LoggingObject log;
+
+public:
+	PrincipalLayer(const MatrixXcd &hamilton, const MatrixXcd &hopping, const double &tolerance = 1e-12) :
+		h(hamilton), v(hopping), cell_size(hamilton.rows()), cell_count(1), hopping_range(1)
+	{
+		analyze(tolerance);
+	}
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+protected:
+	// the hoppings of cells of size m, or false if h and v are not block Toeplitz for that size.
+	bool collect(const long &m, const double &threshold, std::map<long, MatrixXcd> &result) const
+	{
+		const long K = h.rows() / m;
+
+		result.clear();
+
+		auto add = [&](const long &d, const MatrixXcd &block) {
+
+			std::map<long, MatrixXcd>::const_iterator it = result.find(d);
+
+			if (it == result.end())
+			{
+				result[d] = block;
+				return true;
+			}
+
+			return (it->second - block).cwiseAbs().maxCoeff() <= threshold;
+		};
+
+		for (long i = 0; i < K; i++)
+			for (long j = 0; j < K; j++)
+			{
+				if (!add(j - i, h.block(i * m, j * m, m, m)))
+					return false;
+
+				if (!add(j - i + K, v.block(i * m, j * m, m, m)))
+					return false;
+			}
+
+		return true;
+	}
+
+	void analyze(const double &tolerance)
+	{
+		const long n = h.rows();
+
+		if (n == 0 || v.rows() != n || v.cols() != n)
+			return;
+
+		const double scale = std::max(h.cwiseAbs().maxCoeff(), v.cwiseAbs().maxCoeff());
+		const double threshold = tolerance * scale;
+
+		// the smallest cell size is tried first, the whole layer always matches.
+		for (long m = 1; m <= n; m++)
+		{
+			if (n % m != 0 || !collect(m, threshold, hoppings))
+				continue;
+
+			cell_size = m;
+			cell_count = n / m;
+			break;
+		}
+
+		hopping_range = 1;
+
+		for (std::map<long, MatrixXcd>::const_iterator it = hoppings.begin(); it != hoppings.end(); ++it)
+			if (it->first > hopping_range && it->second.cwiseAbs().maxCoeff() > threshold)
+				hopping_range = it->first;
+
+		log() << "The lead of " << cell_count << " cells of size " << cell_size << " has a hopping range of " << hopping_range << " cells." << std::endl;
+	}
+
+	// the hopping over a distance d, zero beyond the range.
+	MatrixXcd hopping(const long &d) const
+	{
+		std::map<long, MatrixXcd>::const_iterator it = hoppings.find(d);
+
+		if (it == hoppings.end() || d > hopping_range || d < - hopping_range)
+			return MatrixXcd::Zero(cell_size, cell_size);
+
+		return it->second;
+	}
+
+public:
+	long cellSize() const {
+		return cell_size;
+	}
+
+	// the number of cells in the given layer.
+	long cellCount() const {
+		return cell_count;
+	}
+
+	// the number of cells in the minimal layer.
+	long range() const {
+		return hopping_range;
+	}
+
+	bool isReducible() const {
+		return hopping_range < cell_count;
+	}
+
+	BlockMatrixXcd minimalHamiltonian() const
+	{
+		if (!isReducible())
+			return h;
+
+		MatrixXcd layer = MatrixXcd::Zero(hopping_range * cell_size, hopping_range * cell_size);
+
+		for (long i = 0; i < hopping_range; i++)
+			for (long j = 0; j < hopping_range; j++)
+				layer.block(i * cell_size, j * cell_size, cell_size, cell_size) = hopping(j - i);
+
+		BlockMatrixXcd result = layer;
+
+		result.setBlocks(ArrayXi::Constant(hopping_range, cell_size));
+
+		return result;
+	}
+
+	BlockMatrixXcd minimalHopping() const
+	{
+		if (!isReducible())
+			return v;
+
+		MatrixXcd layer = MatrixXcd::Zero(hopping_range * cell_size, hopping_range * cell_size);
+
+		for (long i = 0; i < hopping_range; i++)
+			for (long j = 0; j < hopping_range; j++)
+				layer.block(i * cell_size, j * cell_size, cell_size, cell_size) = hopping(j - i + hopping_range);
+
+		BlockMatrixXcd result = layer;
+
+		result.setBlocks(ArrayXi::Constant(hopping_range, cell_size));
+
+		return result;
+	}
+
+	// a chain solver of the minimal layer, to be configured and computed by the caller.
+	ChainSolver chain() const
+	{
+		return ChainSolver(minimalHamiltonian(), minimalHopping());
+	}
+
+	// the surface greens matrix of the given layer from the one of the minimal layer.
+	MatrixXcd surfaceGreensMatrix(const MatrixXcd &minimal_surface) const
+	{
+		if (!isReducible())
+			return minimal_surface;
+
+		const MatrixXcd v_minimal = minimalHopping();
+		const long size = v_minimal.rows();
+
+		MatrixXcd argument = h;
+
+		argument.bottomRightCorner(size, size) -= v_minimal * minimal_surface * v_minimal.adjoint();
+
+		return argument.inverse();
+	}
+};
+
+LoggingObject PrincipalLayer::log("GreensFormalism::PrincipalLayer", false);
+
+}
+
+}
+
+#endif
@@ -0,0 +1,207 @@
+/*
+Header file for QuantumMechanics::GreensFormalism::SolverPlanner: 
+
+This file estimates the peak memory and the number of floating point operations of the
+algorithms that can produce a requested greens matrix, and picks the fastest one which fits
+a memory budget. The estimates count complex doubles (16 bytes) and real flops, including
+the dense input matrix, and are meant for choosing between algorithms, not for exact
+accounting.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _GREENSFORMALISM_SOLVERPLANNER_H_
+#define _GREENSFORMALISM_SOLVERPLANNER_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace QuantumMechanics {
+
+namespace GreensFormalism {
+
+	enum GreensAlgorithm {
+		DenseInverse,
+		RecursiveGreens,
+		OutOfCoreInverse
+	};
+
+struct AlgorithmEstimate {
+
+	GreensAlgorithm algorithm;
+	std::string name;
+
+	double bytes;
+	double flops;
+
+	AlgorithmEstimate(const GreensAlgorithm &a, const std::string &n, const double &b, const double &f) : algorithm(a), name(n), bytes(b), flops(f) { }
+};
+
+class SolverPlanner {
+
+	std::vector<AlgorithmEstimate> estimates;
+
+	double budget;
+	long chosen;
+
+public:
+	static LoggingObject log;
+
+	// a budget of zero means unlimited.
+	SolverPlanner(const double &memory_budget) : estimates(), budget(memory_budget), chosen(-1) { }
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+	static inline void disableLog()
+	{
+		log.disable();
+	}
+
+	static double physicalMemory()
+	{
+		return double(sysconf(_SC_PHYS_PAGES)) * double(sysconf(_SC_PAGESIZE));
+	}
+
+	// the cost models, in terms of the diagonal block sizes and the size of the requested result.
+	static AlgorithmEstimate denseInverse(const ArrayXi &sizes, const long &result_rows, const long &result_cols)
+	{
+		const double n = sizes.cast<double>().sum();
+
+		// input, LU factors and the full inverse; the result is copied out of the inverse.
+		const double bytes = 16.0 * (3.0 * n * n + (result_rows * result_cols < n * n ? double(result_rows) * result_cols : 0.0));
+
+		// LU (2/3 n^3) and inversion from LU (4/3 n^3) complex multiply-adds of 8 flops each.
+		const double flops = 8.0 * 2.0 * n * n * n;
+
+		return AlgorithmEstimate(DenseInverse, "dense inverse", bytes, flops);
+	}
+
+	static AlgorithmEstimate recursiveGreens(const ArrayXi &sizes, const long &result_rows, const long &result_cols)
+	{
+		const ArrayXd b = sizes.cast<double>();
+		const double n = b.sum();
+		const long count = b.size();
+
+		const bool full = (result_rows == n && result_cols == n);
+		const bool column = (!full && (result_rows == n || result_cols == n));
+
+		// one sweep of block inversions and triple products; a full matrix needs sweeps from both sides.
+		double sweep = 0;
+
+		for (long i = 0; i < count; i++)
+			sweep += 2.0 * b[i] * b[i] * b[i] + (i + 1 < count ? 2.0 * b[i] * b[i + 1] * b[i + 1] : 0.0);
+
+		double flops = 8.0 * sweep;
+		double bytes = 16.0 * (n * n + 2.0 * b.maxCoeff() * b.maxCoeff());
+
+		if (column)
+		{
+			const double width = std::min(result_rows, result_cols);
+
+			flops += 8.0 * 2.0 * n * b.maxCoeff() * width;
+			bytes += 16.0 * ((b * b).sum() + n * width);
+		}
+		else if (full)
+		{
+			// every off-diagonal block is one block product away from its neighbour.
+			flops += 8.0 * (sweep + 2.0 * n * n * b.mean());
+			bytes += 16.0 * (2.0 * (b * b).sum() + n * n);
+		}
+
+		return AlgorithmEstimate(RecursiveGreens, "recursive greens", bytes, flops);
+	}
+
+	// the tiles are factorized and inverted in a scratch file; only the input, a partial result,
+	// one panel of n times the tile size and a few tiles per thread stay in memory. A full
+	// result stays in the scratch file. The flops equal the dense inverse, so the dense inverse
+	// wins whenever it fits.
+	static AlgorithmEstimate outOfCoreInverse(const ArrayXi &sizes, const long &result_rows, const long &result_cols, const long &tile_size, const long &threads)
+	{
+		const double n = sizes.cast<double>().sum();
+		const double tile = std::min(double(tile_size), n);
+		const double result = (result_rows == n && result_cols == n ? 0.0 : double(result_rows) * result_cols);
+
+		const double bytes = 16.0 * (n * n + result + n * tile + 4.0 * tile * tile * threads);
+		const double flops = 8.0 * 2.0 * n * n * n;
+
+		return AlgorithmEstimate(OutOfCoreInverse, "out-of-core inverse", bytes, flops);
+	}
+
+	void add(const AlgorithmEstimate &estimate)
+	{
+		estimates.push_back(estimate);
+		chosen = -1;
+	}
+
+	// the index of the fastest estimate within the budget, or -1 when none fits.
+	long choose()
+	{
+		chosen = -1;
+
+		for (std::size_t e = 0; e < estimates.size(); e++)
+			if (fits(estimates[e]) && (chosen < 0 || estimates[e].flops < estimates[chosen].flops))
+				chosen = (long) e;
+
+		return chosen;
+	}
+
+	bool fits(const AlgorithmEstimate &estimate) const {
+		return budget <= 0 || estimate.bytes <= budget;
+	}
+
+	bool feasible() const {
+		return chosen >= 0;
+	}
+
+	const AlgorithmEstimate &choice() const {
+		return estimates[chosen];
+	}
+
+	const std::vector<AlgorithmEstimate> &candidates() const {
+		return estimates;
+	}
+
+	double memoryBudget() const {
+		return budget;
+	}
+
+	friend std::ostream &operator<<(std::ostream &out, const SolverPlanner &plan)
+	{
+		out << "Plan for a memory budget of " << (plan.budget > 0 ? plan.budget / 1073741824.0 : 0.0) << " GiB" << (plan.budget > 0 ? "" : " (unlimited)") << ":" << std::endl;
+
+		for (std::size_t e = 0; e < plan.estimates.size(); e++)
+		{
+			const AlgorithmEstimate &estimate = plan.estimates[e];
+
+			out << (long(e) == plan.chosen ? "  * " : "    ") << std::left << std::setw(20) << estimate.name << std::right
+				<< std::setw(12) << std::setprecision(4) << estimate.bytes / 1073741824.0 << " GiB"
+				<< std::setw(12) << std::setprecision(4) << estimate.flops / 1.0e9 << " GFlop"
+				<< (plan.fits(estimate) ? "" : "  (exceeds budget)") << std::endl;
+		}
+
+		if (plan.chosen < 0)
+			out << "No algorithm fits the budget." << std::endl;
+
+		return out;
+	}
+};
+
+// the plan is printed before executing unless disabled.
+LoggingObject SolverPlanner::log("GreensFormalism::SolverPlanner", true);
+
+}
+
+}
+
+#endif
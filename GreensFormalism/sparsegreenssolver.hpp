@@ -0,0 +1,302 @@
+/*
+Header file for QuantumMechanics::GreensFormalism::SparseGreensSolver: 
+
+This file solves the first or last block of a block tridiagonal greens matrix, where the
+diagonal and coupling blocks are kept sparse. Only the self-energy is dense, and only on
+the rows and columns of a block that are coupled to the previous block. In each step the
+isolated greens matrix g is found by a sparse LU of (H_bb - sigma) for the columns that the
+coupling to the next block touches, and only the coupled rows of these are used to form
+the next self-energy H_{b+1,b} g H_{b,b+1}.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _GREENSFORMALISM_SPARSEGREENSSOLVER_H_
+#define _GREENSFORMALISM_SPARSEGREENSSOLVER_H_
+
+#include <Math/Dense>
+#include <Math/Sparse>
+#include "../Misc/LoggingObject"
+#include "GreensSolver"
+
+#include <vector>
+
+namespace QuantumMechanics {
+
+namespace GreensFormalism {
+
+	typedef SparseMatrix<std::complex<double> > SparseMatrixXcd;
+
+class SparseGreensSolver {
+
+	typedef Triplet<std::complex<double> > Entry;
+
+	// H_bb, H_{b,b+1} and H_{b+1,b}.
+	std::vector<SparseMatrixXcd> diagonal;
+	std::vector<SparseMatrixXcd> upper;
+	std::vector<SparseMatrixXcd> lower;
+
+	// the dense self-energy on the coupled rows and columns of a block.
+	MatrixXcd sigma;
+	std::vector<long> sigma_rows;
+	std::vector<long> sigma_cols;
+
+	MatrixXcd G;
+
+	static LoggingObject log;
+
+public:
+	SparseGreensSolver(const std::vector<SparseMatrixXcd> &diagonal_blocks, const std::vector<SparseMatrixXcd> &upper_blocks, const std::vector<SparseMatrixXcd> &lower_blocks) :
+		diagonal(diagonal_blocks), upper(upper_blocks), lower(lower_blocks) { }
+
+	// the blocks are taken from a block tridiagonal matrix, dropping its zeros.
+	SparseGreensSolver(const BlockMatrixXcd &H)
+	{
+		const long block_count = (H.isSquare() || H.blockRows() < H.blockCols() ? H.blockRows() : H.blockCols());
+
+		for (long b = 0; b < block_count; b++)
+		{
+			diagonal.push_back(MatrixXcd(H.block(b, b)).sparseView());
+
+			if (b + 1 < block_count)
+			{
+				upper.push_back(MatrixXcd(H.block(b, b + 1)).sparseView());
+				lower.push_back(MatrixXcd(H.block(b + 1, b)).sparseView());
+			}
+		}
+	}
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+protected:
+	static std::vector<long> nonzero_rows(const SparseMatrixXcd &M)
+	{
+		std::vector<bool> used(M.rows(), false);
+
+		for (long k = 0; k < M.outerSize(); k++)
+			for (SparseMatrixXcd::InnerIterator it(M, k); it; ++it)
+				if (it.value() != std::complex<double>(0))
+					used[it.row()] = true;
+
+		std::vector<long> result;
+
+		for (long i = 0; i < M.rows(); i++)
+			if (used[i])
+				result.push_back(i);
+
+		return result;
+	}
+
+	static std::vector<long> nonzero_cols(const SparseMatrixXcd &M)
+	{
+		std::vector<bool> used(M.cols(), false);
+
+		for (long k = 0; k < M.outerSize(); k++)
+			for (SparseMatrixXcd::InnerIterator it(M, k); it; ++it)
+				if (it.value() != std::complex<double>(0))
+					used[it.col()] = true;
+
+		std::vector<long> result;
+
+		for (long j = 0; j < M.cols(); j++)
+			if (used[j])
+				result.push_back(j);
+
+		return result;
+	}
+
+	// the dense M(rows, cols).
+	static MatrixXcd compact(const SparseMatrixXcd &M, const std::vector<long> &rows, const std::vector<long> &cols)
+	{
+		std::vector<long> row_position(M.rows(), -1), col_position(M.cols(), -1);
+
+		for (std::size_t i = 0; i < rows.size(); i++)
+			row_position[rows[i]] = i;
+		for (std::size_t j = 0; j < cols.size(); j++)
+			col_position[cols[j]] = j;
+
+		MatrixXcd result = MatrixXcd::Zero(rows.size(), cols.size());
+
+		for (long k = 0; k < M.outerSize(); k++)
+			for (SparseMatrixXcd::InnerIterator it(M, k); it; ++it)
+				if (row_position[it.row()] >= 0 && col_position[it.col()] >= 0)
+					result(row_position[it.row()], col_position[it.col()]) = it.value();
+
+		return result;
+	}
+
+	// H_bb - sigma, with sigma scattered into its coupled rows and columns.
+	SparseMatrixXcd isolated_argument(const long &b) const
+	{
+		std::vector<Entry> entries;
+
+		entries.reserve(diagonal[b].nonZeros() + sigma.size());
+
+		for (long k = 0; k < diagonal[b].outerSize(); k++)
+			for (SparseMatrixXcd::InnerIterator it(diagonal[b], k); it; ++it)
+				entries.push_back(Entry(it.row(), it.col(), it.value()));
+
+		for (std::size_t j = 0; j < sigma_cols.size(); j++)
+			for (std::size_t i = 0; i < sigma_rows.size(); i++)
+				entries.push_back(Entry(sigma_rows[i], sigma_cols[j], - sigma(i, j)));
+
+		SparseMatrixXcd result(diagonal[b].rows(), diagonal[b].cols());
+
+		result.setFromTriplets(entries.begin(), entries.end());
+
+		return result;
+	}
+
+	MatrixXcd dense_sigma(const long &size) const
+	{
+		MatrixXcd result = MatrixXcd::Zero(size, size);
+
+		for (std::size_t j = 0; j < sigma_cols.size(); j++)
+			for (std::size_t i = 0; i < sigma_rows.size(); i++)
+				result(sigma_rows[i], sigma_cols[j]) = sigma(i, j);
+
+		return result;
+	}
+
+	/*
+	One step of the self-energy recursion: with g = (H_bb - sigma)^-1 and the couplings
+	in = H_{b,next} and out = H_{next,b}, the next self-energy is out g in, which only
+	needs g(nonzero columns of out, nonzero rows of in).
+	*/
+	bool propagate(const long &b, const SparseMatrixXcd &in, const SparseMatrixXcd &out)
+	{
+		const std::vector<long> rows = nonzero_cols(out);
+		const std::vector<long> cols = nonzero_rows(in);
+
+		if (rows.empty() || cols.empty())
+		{
+			sigma.resize(0, 0);
+			sigma_rows.clear();
+			sigma_cols.clear();
+			return true;
+		}
+
+		SparseMatrixXcd A = isolated_argument(b);
+		A.makeCompressed();
+
+		SparseLU<SparseMatrixXcd, COLAMDOrdering<int> > lu;
+
+		lu.analyzePattern(A);
+		lu.factorize(A);
+
+		if (lu.info() != Success)
+		{
+			log() << "The sparse LU of block " << b << " failed." << std::endl;
+			return false;
+		}
+
+		MatrixXcd unit = MatrixXcd::Zero(A.rows(), cols.size());
+
+		for (std::size_t j = 0; j < cols.size(); j++)
+			unit(cols[j], j) = 1.0;
+
+		const MatrixXcd X = lu.solve(unit);
+
+		MatrixXcd g(rows.size(), cols.size());
+
+		for (std::size_t i = 0; i < rows.size(); i++)
+			g.row(i) = X.row(rows[i]);
+
+		sigma_rows = nonzero_rows(out);
+		sigma_cols = nonzero_cols(in);
+
+		sigma = compact(out, sigma_rows, rows) * g * compact(in, cols, sigma_cols);
+
+		log() << "Block " << b << " couples through " << rows.size() << "-by-" << cols.size() << " elements of its greens matrix." << std::endl;
+
+		return true;
+	}
+
+	void compute_last_block()
+	{
+		const long block_count = diagonal.size();
+
+		log() << "Preparing to calculate the last block out of " << block_count << " sparse blocks." << std::endl;
+
+		sigma.resize(0, 0);
+		sigma_rows.clear();
+		sigma_cols.clear();
+
+		for (long b = 0; b < block_count - 1; b++)
+			if (!propagate(b, upper[b], lower[b]))
+			{
+				G.resize(0, 0);
+				return;
+			}
+
+		const long size = diagonal[block_count - 1].rows();
+
+		G = (MatrixXcd(diagonal[block_count - 1]) - dense_sigma(size)).inverse();
+
+		log() << "The solution is saved." << std::endl;
+	}
+
+	void compute_first_block()
+	{
+		const long block_count = diagonal.size();
+
+		log() << "Preparing to calculate the first block out of " << block_count << " sparse blocks." << std::endl;
+
+		sigma.resize(0, 0);
+		sigma_rows.clear();
+		sigma_cols.clear();
+
+		for (long b = block_count - 1; b > 0; b--)
+			if (!propagate(b, lower[b - 1], upper[b - 1]))
+			{
+				G.resize(0, 0);
+				return;
+			}
+
+		const long size = diagonal[0].rows();
+
+		G = (MatrixXcd(diagonal[0]) - dense_sigma(size)).inverse();
+
+		log() << "The solution is saved." << std::endl;
+	}
+
+public:
+	// only the FirstBlock and LastBlock are solved sparsely.
+	void compute(const GreenMatrixSubType &action)
+	{
+		switch(action)
+		{
+		case FirstBlock:
+			compute_first_block();
+			break;
+		case LastBlock:
+			compute_last_block();
+			break;
+		default:
+			log() << "Only the first and last block are solved with sparse blocks." << std::endl;
+			G.resize(0, 0);
+			break;
+		}
+	}
+
+	// the self-energy on the solved block, from the blocks before it.
+	MatrixXcd reducedSigma() const
+	{
+		return dense_sigma(G.rows());
+	}
+
+	const MatrixXcd &greensMatrix() const {
+		return G;
+	}
+};
+
+LoggingObject SparseGreensSolver::log("GreensFormalism::SparseGreensSolver", false);
+
+}
+
+}
+
+#endif
@@ -0,0 +1,212 @@
+/*
+Header file for QuantumMechanics::GreensFormalism::SurfaceGreensCache: 
+
+This file keeps surface greens matrices of leads between calculations, such that repeated
+jobs on the same lead (same hamilton and hopping matrix) do not redo the decimation.
+
+A miss in a sweep, like the next energy or field of the same lead, is warm started from the
+stored surface of the nearest lead with the same hopping, when its layer h differs by at most
+warm_start_distance relative to h. ChainSolver rejects the guess, and decimates, when the
+iteration does not converge to the retarded root.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _GREENSFORMALISM_SURFACEGREENSCACHE_H_
+#define _GREENSFORMALISM_SURFACEGREENSCACHE_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+#include "ChainSolver"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace QuantumMechanics {
+
+namespace GreensFormalism {
+
+class SurfaceGreensCache {
+
+	struct Entry {
+		MatrixXcd h;
+		MatrixXcd v;
+		MatrixXcd G;
+	};
+
+	std::map<std::uint64_t, std::shared_ptr<const Entry> > entries;
+	mutable std::mutex entries_mutex;
+
+	std::atomic<long> hit_count;
+	std::atomic<long> miss_count;
+	std::atomic<long> warm_start_count;
+
+	NumaPolicy numa_policy;
+
+	static LoggingObject log;
+
+public:
+	// when more than capacity entries are stored, the cache is emptied before inserting.
+	long capacity;
+
+	// relative to the norm of h, zero never warm starts.
+	double warm_start_distance;
+
+	SurfaceGreensCache(const long &max_entries = 256) : hit_count(0), miss_count(0), warm_start_count(0), numa_policy(NumaFirstTouch), capacity(max_entries), warm_start_distance(0.1) { }
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+	// the placement of the decimation matrices on a miss.
+	void setNumaPolicy(const NumaPolicy &policy)
+	{
+		numa_policy = policy;
+	}
+
+protected:
+	// FNV-1a over the dimensions and the raw coefficients of both matrices.
+	static std::uint64_t hash(const MatrixXcd &h, const MatrixXcd &v)
+	{
+		std::uint64_t key = 14695981039346656037ULL;
+
+		auto feed = [&](const unsigned char *data, std::size_t bytes) {
+			for (std::size_t i = 0; i < bytes; i++)
+			{
+				key ^= data[i];
+				key *= 1099511628211ULL;
+			}
+		};
+
+		const long dims[4] = { (long) h.rows(), (long) h.cols(), (long) v.rows(), (long) v.cols() };
+
+		feed(reinterpret_cast<const unsigned char *>(dims), sizeof(dims));
+		feed(reinterpret_cast<const unsigned char *>(h.data()), h.size() * sizeof(MatrixXcd::Scalar));
+		feed(reinterpret_cast<const unsigned char *>(v.data()), v.size() * sizeof(MatrixXcd::Scalar));
+
+		return key;
+	}
+
+	static bool matches(const Entry &entry, const MatrixXcd &h, const MatrixXcd &v)
+	{
+		return entry.h.rows() == h.rows() && entry.h.cols() == h.cols() && entry.v.rows() == v.rows() && entry.v.cols() == v.cols()
+			&& std::memcmp(entry.h.data(), h.data(), h.size() * sizeof(MatrixXcd::Scalar)) == 0
+			&& std::memcmp(entry.v.data(), v.data(), v.size() * sizeof(MatrixXcd::Scalar)) == 0;
+	}
+
+public:
+	// returns the surface greens matrix of the chain (h, v), decimating only on a miss.
+	MatrixXcd surfaceGreensMatrix(const BlockMatrixXcd &h, const BlockMatrixXcd &v)
+	{
+		const MatrixXcd dense_h = h;
+		const MatrixXcd dense_v = v;
+
+		const std::uint64_t key = hash(dense_h, dense_v);
+
+		std::shared_ptr<const Entry> nearest;
+
+		{
+			std::lock_guard<std::mutex> lock(entries_mutex);
+
+			auto found = entries.find(key);
+
+			if (found != entries.end() && matches(*found->second, dense_h, dense_v))
+			{
+				hit_count++;
+				return found->second->G;
+			}
+
+			double smallest = warm_start_distance * dense_h.norm();
+
+			for (auto it = entries.begin(); it != entries.end() && warm_start_distance > 0; ++it)
+			{
+				const Entry &entry = *it->second;
+
+				if (entry.h.rows() != dense_h.rows() || entry.h.cols() != dense_h.cols() || entry.v.rows() != dense_v.rows() || entry.v.cols() != dense_v.cols())
+					continue;
+
+				if (std::memcmp(entry.v.data(), dense_v.data(), dense_v.size() * sizeof(MatrixXcd::Scalar)) != 0)
+					continue;
+
+				const double distance = (entry.h - dense_h).norm();
+
+				if (distance <= smallest)
+				{
+					smallest = distance;
+					nearest = it->second;
+				}
+			}
+		}
+
+		miss_count++;
+
+		log() << "No cached surface solution for a " << dense_h.rows() << "-by-" << dense_h.cols() << " lead, the chain is decimated." << std::endl;
+
+		ChainSolver solver(h, v);
+		solver.setNumaPolicy(numa_policy);
+
+		if (nearest)
+			solver.setInitialGuess(nearest->G);
+
+		solver.compute(SurfaceGreensMatrix);
+
+		if (solver.warmStartIterations() > 0)
+			warm_start_count++;
+
+		std::shared_ptr<Entry> entry(new Entry());
+		entry->h = dense_h;
+		entry->v = dense_v;
+		entry->G = solver.greensMatrix();
+
+		{
+			std::lock_guard<std::mutex> lock(entries_mutex);
+
+			if ((long) entries.size() >= capacity)
+			{
+				log() << "The cache reached its capacity of " << capacity << " entries and is cleared." << std::endl;
+				entries.clear();
+			}
+
+			entries[key] = entry;
+		}
+
+		return entry->G;
+	}
+
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(entries_mutex);
+		entries.clear();
+	}
+
+	long size() const {
+		std::lock_guard<std::mutex> lock(entries_mutex);
+		return (long) entries.size();
+	}
+
+	long hits() const {
+		return hit_count;
+	}
+
+	long misses() const {
+		return miss_count;
+	}
+
+	// the misses solved by the warm start instead of the decimation.
+	long warmStarts() const {
+		return warm_start_count;
+	}
+};
+
+LoggingObject SurfaceGreensCache::log("GreensFormalism::SurfaceGreensCache", false);
+
+}
+
+}
+
+#endif
@@ -0,0 +1,311 @@
+/*
+Header file for QuantumMechanics::LanduarFormalism::EnergyGrid: 
+
+This file places the energies of a transmission sweep. The band edges and subband thresholds
+of the leads are found from their Bloch hamiltonians h + v exp(ik) + v* exp(-ik) on a grid of
+k, as the extrema of every band refined by a parabola through the neighbouring points. The
+initial grid is a coarse uniform grid plus nodes that cluster geometrically towards every
+threshold from both sides, where the transmission has its steps and square root onsets.
+
+The grid is then refined adaptively: every interval is split at its midpoint, and the
+deviation of the value there from the linear interpolation of the end points is the error
+estimate. Intervals with an error above the tolerance are split again, until all are
+accepted, the smallest spacing is reached or the budget of points is spent. The points of
+each pass are evaluated in parallel.
+
+transmissionFunction() gives the point function of a TwoLeadTransportSolver for a hamilton
+matrix, such that the sweep is simply compute(EnergyGrid::transmissionFunction(H)).
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _LANDUARFORMALISM_ENERGYGRID_H_
+#define _LANDUARFORMALISM_ENERGYGRID_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+#include "TwoLeadTransportSolver"
+
+#include <tbb/tbb.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace QuantumMechanics {
+
+namespace LanduarFormalism {
+
+class EnergyGrid {
+
+	double E_min;
+	double E_max;
+
+	std::vector<double> edges;
+
+	std::vector<double> energy;
+	std::vector<double> value;
+
+	static LoggingObject log;
+
+public:
+	typedef std::function<double(const double &)> PointFunction;
+
+	// the uniform nodes of the initial grid.
+	long coarse_count;
+
+	// the nodes on each side of a threshold, at distances width / 2^j for j < cluster_count.
+	long cluster_count;
+
+	// the outermost cluster distance, zero uses the coarse spacing.
+	double cluster_width;
+
+	// the k points of the band structure of a lead.
+	long k_points;
+
+	// the smallest interval that is still split, relative to the energy range.
+	double min_spacing;
+
+	EnergyGrid(const double &min, const double &max) : E_min(min), E_max(max), coarse_count(32), cluster_count(6), cluster_width(0), k_points(64), min_spacing(1e-6) { }
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+protected:
+	void add_threshold(const double &threshold)
+	{
+		const double resolution = 1e-9 * (E_max - E_min);
+
+		if (threshold < E_min || threshold > E_max)
+			return;
+
+		for (std::size_t t = 0; t < edges.size(); t++)
+			if (std::abs(edges[t] - threshold) <= resolution)
+				return;
+
+		edges.push_back(threshold);
+
+		std::sort(edges.begin(), edges.end());
+	}
+
+public:
+	void addThreshold(const double &threshold)
+	{
+		add_threshold(threshold);
+	}
+
+	// the band extrema of a lead with the hamilton matrix h of a layer and the hopping v to the next.
+	void addLead(const MatrixXcd &h, const MatrixXcd &v)
+	{
+		const long n = h.rows();
+		const long N = std::max(k_points, 4L);
+		const double pi = std::acos(-1.0);
+
+		// the bands in ascending order at k = 2 pi j / N, both k = 0 and k = pi included for even N.
+		MatrixXd bands(n, N);
+
+		for (long j = 0; j < N; j++)
+		{
+			const std::complex<double> phase = std::polar(1.0, 2 * pi * j / N);
+
+			const MatrixXcd bloch = h + v * phase + v.adjoint() * std::conj(phase);
+
+			bands.col(j) = SelfAdjointEigenSolver<MatrixXcd>(bloch, EigenvaluesOnly).eigenvalues();
+		}
+
+		const std::size_t before = edges.size();
+
+		for (long b = 0; b < n; b++)
+			for (long j = 0; j < N; j++)
+			{
+				const double left = bands(b, (j + N - 1) % N);
+				const double middle = bands(b, j);
+				const double right = bands(b, (j + 1) % N);
+
+				if ((middle - left) * (right - middle) > 0)
+					continue;
+
+				// the vertex of the parabola through the three points.
+				const double curvature = left - 2 * middle + right;
+
+				if (curvature != 0)
+					add_threshold(middle - (right - left) * (right - left) / (8 * curvature));
+				else
+					add_threshold(middle);
+			}
+
+		log() << "A lead with " << n << " orbitals per layer adds " << edges.size() - before << " thresholds." << std::endl;
+	}
+
+	// the left lead is the first and the right lead the last left_count and right_count blocks, as in TwoLeadTransportSolver.
+	void addLeads(const BlockMatrixXcd &hamilton, const long &left_count = 1, const long &right_count = 1)
+	{
+		addLead(hamilton.blocks(0, 0, left_count, left_count), hamilton.blocks(0, left_count, left_count, left_count));
+		addLead(hamilton.blocks(-right_count, -right_count, right_count, right_count), hamilton.blocks(-2 * right_count, -right_count, right_count, right_count));
+	}
+
+	const std::vector<double> &thresholds() const {
+		return edges;
+	}
+
+	// the coarse nodes and the clusters around the thresholds, never the thresholds themselves.
+	std::vector<double> initialEnergies() const
+	{
+		const long count = std::max(coarse_count, 2L);
+		const double spacing = (E_max - E_min) / (count - 1);
+		const double width = (cluster_width > 0 ? cluster_width : spacing);
+
+		std::vector<double> result;
+
+		for (long i = 0; i < count; i++)
+			result.push_back(E_min + i * spacing);
+
+		for (std::size_t t = 0; t < edges.size(); t++)
+			for (long j = 0; j < cluster_count; j++)
+			{
+				const double distance = std::ldexp(width, - j);
+
+				if (edges[t] - distance >= E_min)
+					result.push_back(edges[t] - distance);
+
+				if (edges[t] + distance <= E_max)
+					result.push_back(edges[t] + distance);
+			}
+
+		std::sort(result.begin(), result.end());
+
+		const double resolution = 1e-12 * (E_max - E_min);
+
+		std::vector<double> unique;
+
+		for (std::size_t i = 0; i < result.size(); i++)
+			if (unique.empty() || result[i] - unique.back() > resolution)
+				unique.push_back(result[i]);
+
+		return unique;
+	}
+
+	void compute(const PointFunction &f, const double &tolerance = 1e-3, const long &max_points = 2000)
+	{
+		std::map<double, double> points;
+
+		const std::vector<double> initial = initialEnergies();
+
+		std::vector<double> values(initial.size());
+
+		tbb::parallel_for(0L, (long) initial.size(), [&](const long &i) {
+			values[i] = f(initial[i]);
+		});
+
+		for (std::size_t i = 0; i < initial.size(); i++)
+			points[initial[i]] = values[i];
+
+		std::vector<std::pair<double, double> > pending;
+
+		for (std::size_t i = 0; i + 1 < initial.size(); i++)
+			pending.push_back(std::make_pair(initial[i], initial[i + 1]));
+
+		const double smallest = min_spacing * (E_max - E_min);
+
+		long passes = 0;
+
+		while (!pending.empty() && (long) points.size() < max_points)
+		{
+			if ((long) pending.size() > max_points - (long) points.size())
+				pending.resize(max_points - points.size());
+
+			std::vector<double> midpoints(pending.size());
+
+			for (std::size_t i = 0; i < pending.size(); i++)
+				midpoints[i] = 0.5 * (pending[i].first + pending[i].second);
+
+			values.resize(pending.size());
+
+			tbb::parallel_for(0L, (long) pending.size(), [&](const long &i) {
+				values[i] = f(midpoints[i]);
+			});
+
+			// the halves of the rejected intervals, the largest errors first if the budget runs out.
+			std::vector<std::pair<double, long> > rejected;
+
+			for (std::size_t i = 0; i < pending.size(); i++)
+			{
+				const double a = pending[i].first, b = pending[i].second;
+
+				points[midpoints[i]] = values[i];
+
+				const double error = std::abs(values[i] - 0.5 * (points[a] + points[b]));
+
+				if (error > tolerance && 0.5 * (b - a) > smallest)
+					rejected.push_back(std::make_pair(- error, (long) i));
+			}
+
+			std::stable_sort(rejected.begin(), rejected.end());
+
+			std::vector<std::pair<double, double> > next;
+
+			for (std::size_t r = 0; r < rejected.size(); r++)
+			{
+				const long i = rejected[r].second;
+
+				next.push_back(std::make_pair(pending[i].first, midpoints[i]));
+				next.push_back(std::make_pair(midpoints[i], pending[i].second));
+			}
+
+			pending.swap(next);
+			passes++;
+		}
+
+		energy.clear();
+		value.clear();
+
+		for (std::map<double, double>::const_iterator it = points.begin(); it != points.end(); ++it)
+		{
+			energy.push_back(it->first);
+			value.push_back(it->second);
+		}
+
+		log() << "The sweep used " << energy.size() << " energies, " << initial.size() << " initial and " << passes << " refinement passes, leaving " << pending.size() << " intervals unresolved." << std::endl;
+	}
+
+	// the evaluated energies in ascending order, and the values at them.
+	const std::vector<double> &energies() const {
+		return energy;
+	}
+
+	const std::vector<double> &values() const {
+		return value;
+	}
+
+	// the transmission of (E + i broadening) - H, solved from the left lead.
+	static PointFunction transmissionFunction(const BlockMatrixXcd &hamilton, const double &broadening = 1e-8, const long &left_count = 1, const long &right_count = 1)
+	{
+		return [hamilton, broadening, left_count, right_count](const double &E) {
+
+			BlockMatrixXcd argument = MatrixXcd(MatrixXcd::Identity(hamilton.rows(), hamilton.cols()) * std::complex<double>(E, broadening) - hamilton);
+
+			argument.withBlocks(hamilton);
+
+			TwoLeadTransportSolver solver(argument);
+
+			solver.setLeftLeadBlockCount(left_count);
+			solver.setRightLeadBlockCount(right_count);
+			solver.compute(LeftToRight);
+
+			return solver.transmission();
+		};
+	}
+};
+
+LoggingObject EnergyGrid::log("LanduarFormalism::EnergyGrid", false);
+
+}
+
+}
+
+#endif
@@ -0,0 +1,349 @@
+/*
+Header file for QuantumMechanics::LanduarFormalism::NambuTransportSolver: 
+
+This file solves the transport through a superconducting device given by its Bogoliubov-de
+Gennes hamilton matrix, in the same layout of leads and device as TwoLeadTransportSolver. Every
+block holds its electrons first and then the holes of the same orbitals, and the leads are
+normal, i.e. without pairing.
+
+The particle-hole symmetry of the normal leads, H_hh = -conj(H_ee), gives the hole surface
+greens matrix from the electron one at the opposite energy, g_h(E) = -conj(g_e(-E)), so only
+the electron halves of the leads are decimated. The electron surfaces are kept by energy, such
+that a sweep over both signs of the energy decimates every lead once per energy magnitude.
+
+One recursive solve of the first block column of G gives both processes of an electron from
+the left lead, the Andreev reflection R_he = |F_l,h* G_11 F_l,e|^2 and the transmissions
+T_ee and T_he from G_N1, where F are the factors of the electron and hole broadenings. The
+normal reflection follows from the electron channels of the left lead by unitarity.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _LANDUARFORMALISM_NAMBUTRANSPORTSOLVER_H_
+#define _LANDUARFORMALISM_NAMBUTRANSPORTSOLVER_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+
+#include "../GreensFormalism/GreensSolver"
+#include "../GreensFormalism/ChainSolver"
+#include "../GreensFormalism/ComplexBandStructure"
+#include "../LinearAlgebra/HermitianKernels"
+#include "../LinearAlgebra/IndexSelection"
+
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace QuantumMechanics {
+
+namespace LanduarFormalism {
+
+class NambuTransportSolver {
+
+	BlockMatrixXcd H;
+
+	long left_count;
+	long right_count;
+
+	double eta;
+
+	// the electron surface greens matrices of the left and right lead by energy.
+	std::map<double, std::pair<MatrixXcd, MatrixXcd> > electron_surfaces;
+
+	double normal_transmission;
+	double crossed_transmission;
+	double andreev_reflection;
+	double normal_reflection;
+
+	long channels;
+
+	LinearAlgebra::ProductSettings product_settings;
+
+	static LoggingObject log;
+
+public:
+	NambuTransportSolver(const BlockMatrixXcd &hamilton, const double &broadening = 1e-8) :
+		H(hamilton), left_count(1), right_count(1), eta(broadening),
+		normal_transmission(0), crossed_transmission(0), andreev_reflection(0), normal_reflection(0), channels(0),
+		product_settings()
+		{}
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+	void setLeftLeadBlockCount(const long &count)
+	{
+		left_count = count;
+		electron_surfaces.clear();
+	}
+
+	void setRightLeadBlockCount(const long &count)
+	{
+		right_count = count;
+		electron_surfaces.clear();
+	}
+
+	void setProductSettings(const LinearAlgebra::ProductSettings &settings)
+	{
+		product_settings = settings;
+	}
+
+	// the number of energies with decimated electron surfaces.
+	long cachedSurfaceCount() const {
+		return electron_surfaces.size();
+	}
+
+	void clearSurfaceCache()
+	{
+		electron_surfaces.clear();
+	}
+
+protected:
+	// the electron or hole orbitals of every block of M.
+	static std::vector<long> nambu_orbitals(const BlockMatrixXcd &M, const bool &holes)
+	{
+		std::vector<long> result;
+
+		for (long b = 0, offset = 0; b < M.blockRows(); b++)
+		{
+			const long half = M.block(b, b).rows() / 2;
+
+			for (long i = 0; i < half; i++)
+				result.push_back(offset + (holes ? half : 0) + i);
+
+			offset += 2 * half;
+		}
+
+		return result;
+	}
+
+	static BlockMatrixXcd electron_layer(const BlockMatrixXcd &layer, const MatrixXcd &M)
+	{
+		BlockMatrixXcd result = M;
+
+		ArrayXi sizes(layer.blockRows());
+
+		for (long b = 0; b < layer.blockRows(); b++)
+			sizes[b] = layer.block(b, b).rows() / 2;
+
+		result.setBlocks(sizes);
+
+		return result;
+	}
+
+	// the surface of a lead continuing through the hamilton hopping t, i.e. the argument hopping -t.
+	MatrixXcd electron_surface(const BlockMatrixXcd &h, const MatrixXcd &t, const double &energy) const
+	{
+		using namespace GreensFormalism;
+
+		const std::vector<long> electrons = nambu_orbitals(h, false);
+
+		const MatrixXcd h_e = LinearAlgebra::select(h, electrons, electrons);
+		const MatrixXcd t_e = LinearAlgebra::select(t, electrons, electrons);
+
+		const BlockMatrixXcd argument = electron_layer(h, MatrixXcd::Identity(h_e.rows(), h_e.cols()) * std::complex<double>(energy, eta) - h_e);
+
+		ChainSolver chain(argument, electron_layer(h, - t_e));
+
+		chain.product_settings = product_settings;
+		chain.compute(SurfaceGreensMatrix);
+
+		return chain.greensMatrix();
+	}
+
+	const std::pair<MatrixXcd, MatrixXcd> &electron_surfaces_at(const double &energy)
+	{
+		std::map<double, std::pair<MatrixXcd, MatrixXcd> >::const_iterator it = electron_surfaces.find(energy);
+
+		if (it != electron_surfaces.end())
+			return it->second;
+
+		// the left lead continues from its surface layer to the left, the right lead to the right.
+		const BlockMatrixXcd h_left = H.blocks(0, 0, left_count, left_count);
+		const BlockMatrixXcd v_left = H.blocks(0, left_count, left_count, left_count);
+
+		const BlockMatrixXcd h_right = H.blocks(-right_count, -right_count, right_count, right_count);
+		const BlockMatrixXcd v_right = H.blocks(-2 * right_count, -right_count, right_count, right_count);
+
+		std::pair<MatrixXcd, MatrixXcd> &surfaces = electron_surfaces[energy];
+
+		surfaces.first = electron_surface(h_left, v_left.adjoint(), energy);
+		surfaces.second = electron_surface(h_right, v_right, energy);
+
+		return surfaces;
+	}
+
+	// the nambu surface from the electron surfaces at E and -E.
+	static MatrixXcd nambu_surface(const BlockMatrixXcd &layer, const MatrixXcd &g_electron, const MatrixXcd &g_electron_opposite)
+	{
+		const std::vector<long> electrons = nambu_orbitals(layer, false);
+		const std::vector<long> holes = nambu_orbitals(layer, true);
+
+		MatrixXcd result = MatrixXcd::Zero(layer.rows(), layer.cols());
+
+		for (std::size_t j = 0; j < electrons.size(); j++)
+			for (std::size_t i = 0; i < electrons.size(); i++)
+			{
+				result(electrons[i], electrons[j]) = g_electron(i, j);
+				result(holes[i], holes[j]) = - std::conj(g_electron_opposite(i, j));
+			}
+
+		return result;
+	}
+
+	// the factor of the electron or hole part of the broadening i(sigma - sigma*).
+	static MatrixXcd broadening_factor(const MatrixXcd &sigma, const BlockMatrixXcd &block, const bool &holes)
+	{
+		const std::vector<long> orbitals = nambu_orbitals(block, holes);
+
+		const std::complex<double> i_unit(0, 1);
+		const MatrixXcd part = LinearAlgebra::select(sigma, orbitals, orbitals);
+
+		const MatrixXcd F = LinearAlgebra::broadeningFactor(MatrixXcd(i_unit * (part - part.adjoint())));
+
+		MatrixXcd result = MatrixXcd::Zero(sigma.rows(), F.cols());
+
+		for (std::size_t i = 0; i < orbitals.size(); i++)
+			result.row(orbitals[i]) = F.row(i);
+
+		return result;
+	}
+
+public:
+	// H_hh = -conj(H_ee), as for both P = tau_x K and the spin-reduced P = tau_y K, and no pairing in the leads.
+	bool isParticleHoleSymmetric(const double &tolerance = 1e-12) const
+	{
+		const std::vector<long> electrons = nambu_orbitals(H, false);
+		const std::vector<long> holes = nambu_orbitals(H, true);
+
+		const double threshold = tolerance * std::max(1.0, H.cwiseAbs().maxCoeff());
+
+		for (std::size_t j = 0; j < electrons.size(); j++)
+			for (std::size_t i = 0; i < electrons.size(); i++)
+				if (std::abs(H(holes[i], holes[j]) + std::conj(H(electrons[i], electrons[j]))) > threshold)
+					return false;
+
+		// the lead layers are the first and last blocks up to the device.
+		const long n = H.rows();
+		const long left_size = H.blocks(0, 0, 2 * left_count, 2 * left_count).rows();
+		const long right_size = H.blocks(-2 * right_count, -2 * right_count, 2 * right_count, 2 * right_count).rows();
+
+		for (std::size_t j = 0; j < electrons.size(); j++)
+			for (std::size_t i = 0; i < holes.size(); i++)
+			{
+				const bool lead = (holes[i] < left_size && electrons[j] < left_size) || (holes[i] >= n - right_size && electrons[j] >= n - right_size);
+
+				if (lead && (std::abs(H(holes[i], electrons[j])) > threshold || std::abs(H(electrons[j], holes[i])) > threshold))
+					return false;
+			}
+
+		return true;
+	}
+
+	void compute(const double &energy)
+	{
+		using namespace GreensFormalism;
+
+		const long device_count = H.blockRows() - 2 * left_count - 2 * right_count;
+		const long first = 2 * left_count, last = first + device_count - 1;
+
+		const std::pair<MatrixXcd, MatrixXcd> &opposite = electron_surfaces_at(- energy);
+		const std::pair<MatrixXcd, MatrixXcd> &surfaces = electron_surfaces_at(energy);
+
+		const BlockMatrixXcd left_layer = H.blocks(left_count, left_count, left_count, left_count);
+		const BlockMatrixXcd right_layer = H.blocks(-2 * right_count, -2 * right_count, right_count, right_count);
+
+		const MatrixXcd g_left = nambu_surface(left_layer, surfaces.first, opposite.first);
+		const MatrixXcd g_right = nambu_surface(right_layer, surfaces.second, opposite.second);
+
+		// the couplings of the lead layers to the first and last device block.
+		const MatrixXcd t_left = H.blocks(left_count, first, left_count, 1);
+		const MatrixXcd t_right = H.blocks(last, -2 * right_count, 1, right_count);
+
+		const MatrixXcd t_left_adjoint = t_left.adjoint(), t_right_adjoint = t_right.adjoint();
+
+		const MatrixXcd sigma_left = LinearAlgebra::multiply(t_left_adjoint, g_left, t_left, product_settings);
+		const MatrixXcd sigma_right = LinearAlgebra::multiply(t_right, g_right, t_right_adjoint, product_settings);
+
+		const BlockMatrixXcd device = H.blocks(first, first, device_count, device_count);
+
+		BlockMatrixXcd argument = MatrixXcd(MatrixXcd::Identity(device.rows(), device.cols()) * std::complex<double>(energy, eta) - device);
+
+		argument.withBlocks(device);
+
+		argument.block(0, 0) -= sigma_left;
+		argument.block(-1, -1) -= sigma_right;
+
+		GreensSolver solver(argument);
+
+		solver.setProductSettings(product_settings);
+		solver.compute(FirstBlockColumn);
+
+		const MatrixXcd G_11 = solver.greensMatrix().block(0, 0);
+		const MatrixXcd G_N1 = solver.greensMatrix().block(-1, 0);
+
+		const BlockMatrixXcd first_block = H.blocks(first, first, 1, 1);
+		const BlockMatrixXcd last_block = H.blocks(last, last, 1, 1);
+
+		const MatrixXcd F_left_e = broadening_factor(sigma_left, first_block, false);
+		const MatrixXcd F_left_h = broadening_factor(sigma_left, first_block, true);
+		const MatrixXcd F_right_e = broadening_factor(sigma_right, last_block, false);
+		const MatrixXcd F_right_h = broadening_factor(sigma_right, last_block, true);
+
+		normal_transmission = LinearAlgebra::transmission(G_N1, F_left_e, F_right_e, product_settings);
+		crossed_transmission = LinearAlgebra::transmission(G_N1, F_left_e, F_right_h, product_settings);
+		andreev_reflection = LinearAlgebra::transmission(G_11, F_left_e, F_left_h, product_settings);
+
+		// the electron channels of the left lead, all other processes leave through them.
+		const std::vector<long> electrons = nambu_orbitals(left_layer, false);
+
+		ComplexBandStructure bands(LinearAlgebra::select(left_layer, electrons, electrons), LinearAlgebra::select(H.blocks(0, left_count, left_count, left_count), electrons, electrons));
+
+		bands.compute(energy);
+
+		channels = bands.channelCount();
+		normal_reflection = channels - normal_transmission - crossed_transmission - andreev_reflection;
+
+		log() << "At the energy " << energy << " the " << channels << " electron channels give T_ee = " << normal_transmission << ", T_he = " << crossed_transmission << " and R_he = " << andreev_reflection << "." << std::endl;
+	}
+
+	// T_ee, an electron from the left lead leaves as an electron in the right lead.
+	double normalTransmission() const {
+		return normal_transmission;
+	}
+
+	// T_he, an electron from the left lead leaves as a hole in the right lead.
+	double crossedAndreevTransmission() const {
+		return crossed_transmission;
+	}
+
+	// R_he, an electron from the left lead is reflected as a hole.
+	double andreevReflection() const {
+		return andreev_reflection;
+	}
+
+	// R_ee = N - T_ee - T_he - R_he.
+	double normalReflection() const {
+		return normal_reflection;
+	}
+
+	long electronChannelCount() const {
+		return channels;
+	}
+
+	// the conductance of the left lead into the grounded superconductor, N - R_ee + R_he, in units of e^2/h.
+	double conductance() const {
+		return channels - normal_reflection + andreev_reflection;
+	}
+};
+
+LoggingObject NambuTransportSolver::log("LanduarFormalism::NambuTransportSolver", false);
+
+}
+
+}
+
+#endif
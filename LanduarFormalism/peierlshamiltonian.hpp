@@ -0,0 +1,131 @@
+/*
+Header file for QuantumMechanics::LanduarFormalism::PeierlsHamiltonian: 
+
+This file keeps a hamilton matrix in a perpendicular magnetic field B, where only the phases
+of the hoppings depend on the field, H_ij(B) = H_ij(0) exp(i B theta_ij) with the Peierls
+phase pattern theta_ij = 2 pi / phi_0 times the line integral of A / B from orbital j to i.
+
+The pattern is found once from the orbital positions, and every field value only rewrites the
+hoppings with a nonzero phase, in place, so the block partition and the storage of the matrix
+are reused over the field grid. applyField() does the same to any matrix of the same layout,
+like an argument E - H built once per energy.
+
+The field is in flux quanta per unit area of the positions. The Landau gauge A = (-B y, 0)
+keeps leads along x translation invariant, the symmetric gauge A = B (-y, x) / 2 suits
+closed geometries.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _LANDUARFORMALISM_PEIERLSHAMILTONIAN_H_
+#define _LANDUARFORMALISM_PEIERLSHAMILTONIAN_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+
+#include <cmath>
+#include <vector>
+
+namespace QuantumMechanics {
+
+namespace LanduarFormalism {
+
+	enum MagneticGauge {
+		LandauGauge,
+		SymmetricGauge
+	};
+
+class PeierlsHamiltonian {
+
+	struct Hopping {
+		long row;
+		long col;
+		std::complex<double> value;
+		double theta;
+	};
+
+	BlockMatrixXcd H;
+
+	// the hoppings with a nonzero phase pattern, at zero field.
+	std::vector<Hopping> pattern;
+
+	double field;
+
+	static LoggingObject log;
+
+public:
+	// positions has a row (x, y) for every orbital, and H is the hamilton matrix at zero field.
+	PeierlsHamiltonian(const BlockMatrixXcd &hamilton, const MatrixXd &positions, const MagneticGauge &gauge = LandauGauge, const double &tolerance = 1e-12) :
+		H(hamilton), field(0)
+	{
+		const double pi = std::acos(-1.0);
+		const double threshold = tolerance * (H.size() > 0 ? H.cwiseAbs().maxCoeff() : 0.0);
+
+		for (long j = 0; j < H.cols(); j++)
+			for (long i = 0; i < H.rows(); i++)
+			{
+				if (i == j || std::abs(H(i, j)) <= threshold)
+					continue;
+
+				const double x_i = positions(i, 0), y_i = positions(i, 1);
+				const double x_j = positions(j, 0), y_j = positions(j, 1);
+
+				double theta;
+
+				if (gauge == LandauGauge)
+					theta = - pi * (y_i + y_j) * (x_i - x_j);
+				else
+					theta = pi * (x_j * y_i - x_i * y_j);
+
+				if (theta == 0)
+					continue;
+
+				Hopping hopping = { i, j, H(i, j), theta };
+
+				pattern.push_back(hopping);
+			}
+
+		log() << pattern.size() << " hoppings of " << H.rows() << " orbitals carry a Peierls phase." << std::endl;
+	}
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+	// M_ij = scale H_ij(B) for the hoppings with a phase, all other elements are kept.
+	template<class Matrix>
+	void applyField(const double &B, Matrix &M, const std::complex<double> &scale = 1.0) const
+	{
+		for (std::size_t k = 0; k < pattern.size(); k++)
+			M(pattern[k].row, pattern[k].col) = scale * pattern[k].value * std::polar(1.0, B * pattern[k].theta);
+	}
+
+	void setField(const double &B)
+	{
+		applyField(B, H);
+
+		field = B;
+	}
+
+	double currentField() const {
+		return field;
+	}
+
+	// the number of hoppings rewritten by every field.
+	long patternSize() const {
+		return pattern.size();
+	}
+
+	const BlockMatrixXcd &hamilton() const {
+		return H;
+	}
+};
+
+LoggingObject PeierlsHamiltonian::log("LanduarFormalism::PeierlsHamiltonian", false);
+
+}
+
+}
+
+#endif
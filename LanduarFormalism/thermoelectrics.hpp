@@ -0,0 +1,206 @@
+/*
+Header file for QuantumMechanics::LanduarFormalism::Thermoelectrics: 
+
+This file finds the linear response thermoelectric coefficients from one set of samples of
+the transmission T(E), e.g. those of an EnergyGrid sweep. All of them follow from the moments
+
+	L_n(mu, t) = int T(E) (E - mu)^n (-df/dE) dE,		n = 0, 1, 2,
+
+where f is the Fermi function of the chemical potential mu and the temperature t = k_B T.
+The moments share the trapezoid weights of the samples, computed once, and the three moments
+of a (mu, t) point are accumulated in a single pass over the samples, so a whole grid of
+chemical potentials and temperatures costs no solver calls at all.
+
+With the energies and t in the same unit, the coefficients are given in natural units:
+
+	G = L0						(e^2 / h)
+	S = -L1 / (t L0)				(k_B / e)
+	Pi = -L1 / L0				(energy / e)
+	kappa = (L2 - L1^2 / L0) / t	(k_B / h times energy)
+
+The samples must resolve the Fermi window, i.e. be spaced well below t around mu. At t = 0
+the conductance is the interpolated T(mu) and the other coefficients vanish.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _LANDUARFORMALISM_THERMOELECTRICS_H_
+#define _LANDUARFORMALISM_THERMOELECTRICS_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+#include "EnergyGrid"
+
+#include <tbb/tbb.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace QuantumMechanics {
+
+namespace LanduarFormalism {
+
+class Thermoelectrics {
+
+	std::vector<double> energy;
+
+	// the trapezoid weights times the transmissions.
+	std::vector<double> weighted;
+
+	std::vector<double> transmission;
+
+	// rows are chemical potentials and columns temperatures.
+	MatrixXd L0, L1, L2;
+
+	std::vector<double> temperature;
+
+	static LoggingObject log;
+
+public:
+	// the energies in ascending order.
+	Thermoelectrics(const std::vector<double> &energies, const std::vector<double> &transmissions) :
+		energy(energies), weighted(energies.size(), 0.0), transmission(transmissions)
+	{
+		prepare();
+	}
+
+	Thermoelectrics(const EnergyGrid &grid) :
+		energy(grid.energies()), weighted(grid.energies().size(), 0.0), transmission(grid.values())
+	{
+		prepare();
+	}
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+protected:
+	void prepare()
+	{
+		for (std::size_t k = 0; k + 1 < energy.size(); k++)
+		{
+			const double half = 0.5 * (energy[k + 1] - energy[k]);
+
+			weighted[k] += half * transmission[k];
+			weighted[k + 1] += half * transmission[k + 1];
+		}
+	}
+
+	double interpolate(const double &mu) const
+	{
+		if (energy.empty())
+			return 0;
+
+		if (mu <= energy.front())
+			return transmission.front();
+
+		if (mu >= energy.back())
+			return transmission.back();
+
+		const std::size_t k = std::upper_bound(energy.begin(), energy.end(), mu) - energy.begin();
+
+		const double s = (mu - energy[k - 1]) / (energy[k] - energy[k - 1]);
+
+		return (1 - s) * transmission[k - 1] + s * transmission[k];
+	}
+
+public:
+	// L0, L1 and L2 of one point in a single pass.
+	Vector3d moments(const double &mu, const double &t) const
+	{
+		Vector3d result = Vector3d::Zero();
+
+		if (t <= 0)
+		{
+			result[0] = interpolate(mu);
+			return result;
+		}
+
+		for (std::size_t k = 0; k < energy.size(); k++)
+		{
+			const double x = (energy[k] - mu) / t;
+
+			// -df/dE is below 1e-17 of its peak beyond.
+			if (std::abs(x) > 40)
+				continue;
+
+			const double c = std::cosh(0.5 * x);
+			const double w = weighted[k] / (4 * t * c * c);
+			const double d = energy[k] - mu;
+
+			result[0] += w;
+			result[1] += w * d;
+			result[2] += w * d * d;
+		}
+
+		return result;
+	}
+
+	void compute(const std::vector<double> &chemical_potentials, const std::vector<double> &temperatures)
+	{
+		const long M = chemical_potentials.size(), N = temperatures.size();
+
+		L0.resize(M, N);
+		L1.resize(M, N);
+		L2.resize(M, N);
+
+		temperature = temperatures;
+
+		tbb::parallel_for(0L, M * N, [&](const long &p) {
+
+			const long i = p % M, j = p / M;
+
+			const Vector3d L = moments(chemical_potentials[i], temperatures[j]);
+
+			L0(i, j) = L[0];
+			L1(i, j) = L[1];
+			L2(i, j) = L[2];
+		});
+
+		log() << "The moments of " << M << " chemical potentials and " << N << " temperatures are found from " << energy.size() << " samples." << std::endl;
+	}
+
+	// L_n of the last grid, n = 0, 1 or 2.
+	const MatrixXd &moment(const long &n) const {
+		return (n == 0 ? L0 : (n == 1 ? L1 : L2));
+	}
+
+	MatrixXd conductance() const {
+		return L0;
+	}
+
+	MatrixXd peltier() const
+	{
+		return (L0.array() > 0).select(- L1.array() / L0.array(), 0.0);
+	}
+
+	MatrixXd seebeck() const
+	{
+		MatrixXd result = peltier();
+
+		for (long j = 0; j < result.cols(); j++)
+			result.col(j) *= (temperature[j] > 0 ? 1 / temperature[j] : 0.0);
+
+		return result;
+	}
+
+	MatrixXd thermalConductance() const
+	{
+		MatrixXd result = (L0.array() > 0).select(L2.array() - L1.array().square() / L0.array(), 0.0);
+
+		for (long j = 0; j < result.cols(); j++)
+			result.col(j) *= (temperature[j] > 0 ? 1 / temperature[j] : 0.0);
+
+		return result;
+	}
+};
+
+LoggingObject Thermoelectrics::log("LanduarFormalism::Thermoelectrics", false);
+
+}
+
+}
+
+#endif
@@ -14,6 +14,13 @@ Copyright (C) 2014, S
 
 #include "../GreensFormalism/GreensSolver"
 #include "../GreensFormalism/ChainSolver"
+#include "../GreensFormalism/SurfaceGreensCache"
+#include "../GreensFormalism/PrincipalLayer"
+#include "../LinearAlgebra/LowRankCoupling"
+#include "../LinearAlgebra/HermitianKernels"
+#include "../LinearAlgebra/SymmetrySectors"
+
+#include <numeric>
 
 namespace QuantumMechanics {
 
@@ -64,6 +71,28 @@ class TwoLeadTransportSolver{
 
 	MatrixXd current;
 
+	// optional cache of lead surface solutions shared between solvers, not owned.
+	GreensFormalism::SurfaceGreensCache *surface_cache;
+
+	// in bytes, zero disables planning of the full inversions in the Currents* modes.
+	double memory_budget;
+
+	// used by the lead decimation and the full inversions of the Currents* modes.
+	LinearAlgebra::InversionBackend inversion_backend;
+
+	// the couplings v_l and v_r are compressed to their coupled rows, columns and rank.
+	double coupling_tolerance;
+
+	// used by the lead decimation, the self-energies and the recursive solvers.
+	LinearAlgebra::ProductSettings product_settings;
+
+	// the leads are decimated in their thinnest principal layer.
+	bool layer_minimization;
+
+	// the matrix is split into independent sectors, after the block unitaries if any.
+	bool sector_decomposition;
+	std::vector<MatrixXcd> sector_basis;
+
 	static LoggingObject log;
 
 public:
@@ -79,9 +108,64 @@ public:
 		v_r(m.blocks(3, -2, m.blockRows() - 4, 1)),
 
 		h_rl(m.blocks(-1, -1, 1, 1)),
-		v_rl(m.blocks(-2, -1, 1, 1))
+		v_rl(m.blocks(-2, -1, 1, 1)),
+
+		transport(0),
+		surface_cache(nullptr),
+		memory_budget(0),
+		inversion_backend(LinearAlgebra::VendorInversion),
+		coupling_tolerance(1e-12),
+		product_settings(),
+		layer_minimization(false),
+		sector_decomposition(false)
 		{}
 
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+	void setSurfaceCache(GreensFormalism::SurfaceGreensCache *cache)
+	{
+		surface_cache = cache;
+	}
+
+	void setMemoryBudget(const double &bytes)
+	{
+		memory_budget = bytes;
+	}
+
+	void setInversionBackend(const LinearAlgebra::InversionBackend &backend)
+	{
+		inversion_backend = backend;
+	}
+
+	// relative to the largest element and singular value of a coupling.
+	void setCouplingTolerance(const double &tolerance)
+	{
+		coupling_tolerance = tolerance;
+	}
+
+	// the 3M product for the large complex products, see LinearAlgebra::ProductSettings.
+	void setProductSettings(const LinearAlgebra::ProductSettings &settings)
+	{
+		product_settings = settings;
+	}
+
+	// thick lead layers are reduced to their hopping range before the decimation.
+	void setLayerMinimization(const bool &minimize)
+	{
+		layer_minimization = minimize;
+	}
+
+	// independent sectors are solved in parallel, see LinearAlgebra::SymmetrySectors. The unitaries
+	// rotate every block, or all blocks if only one is given, into the basis of the symmetry.
+	void setSymmetrySectors(const bool &decompose, const std::vector<MatrixXcd> &unitaries = std::vector<MatrixXcd>())
+	{
+		sector_decomposition = decompose;
+		sector_basis = unitaries;
+	}
+
 	void setLeftLeadBlockCount(const long &left_lead_count)
 	{
 		// Note that the lead cell are square and have equal size!
@@ -113,77 +197,258 @@ public:
 	}
 
 protected:
+	MatrixXcd lead_surface_greens_matrix(const BlockMatrixXcd &h, const BlockMatrixXcd &v)
+	{
+		using namespace GreensFormalism;
+
+		if (surface_cache != nullptr)
+			return surface_cache->surfaceGreensMatrix(h, v);
+
+		if (layer_minimization)
+		{
+			const PrincipalLayer layer(h, v);
+
+			if (layer.isReducible())
+			{
+				ChainSolver chain = layer.chain();
+
+				chain.inversion_backend = inversion_backend;
+				chain.product_settings = product_settings;
+				chain.compute(SurfaceGreensMatrix);
+
+				return layer.surfaceGreensMatrix(chain.greensMatrix());
+			}
+		}
+
+		ChainSolver chain(h, v);
+
+		chain.inversion_backend = inversion_backend;
+		chain.product_settings = product_settings;
+		chain.compute(SurfaceGreensMatrix);
+
+		return chain.greensMatrix();
+	}
+
+	/*
+	The left lead continues away from the device through v_ll*, and the right lead through v_rl,
+	whichever the direction of the transmission. Identical leads share one decimation, in which
+	the right lead is the surface continuing through v_rl and the left lead the one continuing
+	through v_rl* = v_ll*.
+	*/
+	void lead_surface_greens_matrices(MatrixXcd &left_surface, MatrixXcd &right_surface)
+	{
+		using namespace GreensFormalism;
+
+		const bool identical = h_ll.rows() == h_rl.rows() && v_ll.rows() == v_rl.rows() && v_ll.cols() == v_rl.cols() && h_ll == h_rl && v_ll == v_rl;
+
+		if (identical && surface_cache == nullptr && !(layer_minimization && PrincipalLayer(h_rl, v_rl).isReducible()))
+		{
+			ChainSolver chain(h_rl, v_rl);
+
+			chain.inversion_backend = inversion_backend;
+			chain.product_settings = product_settings;
+			chain.compute(AllGreensMatrices);
+
+			left_surface = chain.rightSurfaceGreensMatrix();
+			right_surface = chain.greensMatrix();
+
+			return;
+		}
+
+		left_surface = lead_surface_greens_matrix(h_ll, BlockMatrixXcd(v_ll.adjoint()));
+		right_surface = lead_surface_greens_matrix(h_rl, v_rl);
+	}
+
+	/*
+	The transmission from the lead of coupling to the far side of G, where the broadening
+	gamma_out of the dense reduced self-energy stays packed. The lead broadening enters by its
+	factor from the coupling core while the rank is at most half the block, and packed as well
+	otherwise, where the eigensolver would cost more than the trace.
+	*/
+	double lead_transmission(const MatrixXcd &G, const LinearAlgebra::LowRankCoupling &coupling, const MatrixXcd &surface, const long &offset, const long &size, const LinearAlgebra::PackedHermitian &gamma_out) const
+	{
+		if (2 * coupling.rank() <= size)
+			return LinearAlgebra::transmission(G, coupling.broadeningFactor(surface, offset, size), gamma_out, product_settings);
+
+		return LinearAlgebra::transmission(G, LinearAlgebra::broadening(coupling.selfEnergyBlock(surface, offset, size)), gamma_out);
+	}
+
 	void compute_left_to_right()
 	{
 		using namespace GreensFormalism;
 
-		ChainSolver left_chain(h_ll, v_ll);
-		ChainSolver right_chain(h_rl, v_rl);
+		MatrixXcd left_surface, right_surface;
 
-		left_chain.compute(SurfaceGreensMatrix);
-		right_chain.compute(SurfaceGreensMatrix);
-		
-		BlockMatrixXcd sigma_left = h_d;
-		BlockMatrixXcd sigma_right = h_d;
+		lead_surface_greens_matrices(left_surface, right_surface);
 
-		sigma_left = v_l * left_chain.greensMatrix() * v_l.adjoint();
-		sigma_right = v_r.adjoint() * right_chain.greensMatrix() * v_r;
+		// sigma_l = v_l* g_l v_l and sigma_r = v_r g_r v_r*, in both directions, are built at the rank of the couplings and only touch the coupled rows.
+		const LinearAlgebra::LowRankCoupling left(v_l.adjoint(), coupling_tolerance, product_settings);
+		const LinearAlgebra::LowRankCoupling right(v_r, coupling_tolerance, product_settings);
 
-		GreensSolver solver(BlockMatrixXcd(h_d - sigma_left - sigma_right).withBlocks(h_d));
+		BlockMatrixXcd argument = h_d;
 
-		solver.compute(FirstBlock);
+		left.addSelfEnergy(argument, left_surface, -1.0);
+		right.addSelfEnergy(argument, right_surface, -1.0);
+		argument.withBlocks(h_d);
 
-		sigma_left = sigma_left.block(0, 0);
-		sigma_right = solver.reducedSigma();
+		GreensSolver solver(argument);
 
-		sigma_left = (sigma_left.adjoint() - sigma_left).eval() * std::complex<double>(0, 1);
-		sigma_right = (sigma_right.adjoint() - sigma_right).eval() * std::complex<double>(0, 1);
+		solver.setProductSettings(product_settings);
+		solver.compute(FirstBlock);
 
-		transport = (sigma_right * solver.greensMatrix() * sigma_left * solver.greensMatrix().adjoint()).trace().real();
+		const long first = h_d.block(0, 0).rows();
+
+		transport = lead_transmission(solver.greensMatrix(), left, left_surface, 0, first, LinearAlgebra::broadening(solver.reducedSigma()));
 	}
 
 	void compute_right_to_left()
 	{
 		using namespace GreensFormalism;
 
-		ChainSolver left_chain(h_ll, v_ll.adjoint());
-		ChainSolver right_chain(h_rl, v_rl.adjoint());
+		MatrixXcd left_surface, right_surface;
+
+		lead_surface_greens_matrices(left_surface, right_surface);
 
-		left_chain.compute(SurfaceGreensMatrix);
-		right_chain.compute(SurfaceGreensMatrix);
+		const LinearAlgebra::LowRankCoupling left(v_l.adjoint(), coupling_tolerance, product_settings);
+		const LinearAlgebra::LowRankCoupling right(v_r, coupling_tolerance, product_settings);
 
-		BlockMatrixXcd sigma_left = h_d;
-		BlockMatrixXcd sigma_right = h_d;
+		BlockMatrixXcd argument = h_d;
 
-		sigma_left = v_l.adjoint() * left_chain.greensMatrix() * v_l;
-		sigma_right = v_r * right_chain.greensMatrix() * v_r.adjoint();
+		left.addSelfEnergy(argument, left_surface, -1.0);
+		right.addSelfEnergy(argument, right_surface, -1.0);
+		argument.withBlocks(h_d);
 
-		GreensSolver solver(BlockMatrixXcd(h_d - sigma_left - sigma_right).withBlocks(h_d));
+		GreensSolver solver(argument);
 
+		solver.setProductSettings(product_settings);
 		solver.compute(LastBlock);
 
-		sigma_left = solver.reducedSigma();
-		sigma_right = sigma_right.block(-1, -1);
+		const long last = h_d.block(-1, -1).rows();
+
+		transport = lead_transmission(solver.greensMatrix(), right, right_surface, h_d.rows() - last, last, LinearAlgebra::broadening(solver.reducedSigma()));
+	}
+
+	MatrixXcd full_greens_matrix(const BlockMatrixXcd &m)
+	{
+		using namespace GreensFormalism;
 
-		sigma_left = (sigma_left.adjoint() - sigma_left).eval() * std::complex<double>(0, 1);
-		sigma_right = (sigma_right.adjoint() - sigma_right).eval() * std::complex<double>(0, 1);
+		if (memory_budget <= 0)
+			return LinearAlgebra::inverse(m, inversion_backend);
 
-		transport = (sigma_left * solver.greensMatrix() * sigma_right * solver.greensMatrix().adjoint()).trace().real();
+		GreensSolver solver(m);
+
+		solver.setMemoryBudget(memory_budget);
+		solver.setInversionBackend(inversion_backend);
+		solver.setProductSettings(product_settings);
+		solver.compute(FullMatrix);
+
+		return solver.greensMatrix();
 	}
 
 	void compute_currents_left_to_right()
 	{
-		current = full.inverse().real();
+		current = full_greens_matrix(full).real();
 	}
 
 	void compute_currents_right_to_left()
 	{
-		current = full.inverse().real();
+		current = full_greens_matrix(full).real();
+	}
+
+	/*
+	A sector of the finite matrix only continues into the semi-infinite leads when it holds the
+	same block local orbitals in both layers of each lead. Otherwise, like for a hopping that
+	swaps the orbitals between layers, its lead layers are not a lead of their own.
+	*/
+	bool lead_consistent(const LinearAlgebra::SymmetrySectors &sectors) const
+	{
+		std::vector<long> sector_of(full.rows());
+
+		for (long s = 0; s < sectors.sectorCount(); s++)
+			for (std::size_t k = 0; k < sectors.orbitals(s).size(); k++)
+				sector_of[sectors.orbitals(s)[k]] = s;
+
+		const long n = full.rows(), left = h_ll.rows(), right = h_rl.rows();
+
+		for (long k = 0; k < left; k++)
+			if (sector_of[k] != sector_of[left + k])
+				return false;
+
+		for (long k = 0; k < right; k++)
+			if (sector_of[n - 2 * right + k] != sector_of[n - right + k])
+				return false;
+
+		return true;
+	}
+
+	// the transmissions of the sectors are summed and their greens matrices combined.
+	bool compute_sectors(const TwoLeadTransportCalculation &action)
+	{
+		const LinearAlgebra::SymmetrySectors sectors(full, sector_basis);
+
+		if (sectors.sectorCount() == 1)
+			return false;
+
+		if (!lead_consistent(sectors))
+		{
+			log() << "The " << sectors.sectorCount() << " sectors differ between the layers of a lead, the matrix is solved whole." << std::endl;
+			return false;
+		}
+
+		const long left_count = h_ll.blockRows();
+		const long right_count = h_rl.blockRows();
+
+		const bool currents = (action == CurrentsLeftToRight || action == CurrentsRightToLeft);
+
+		std::vector<double> transports(sectors.sectorCount(), 0.0);
+		std::vector<MatrixXcd> greens(sectors.sectorCount());
+
+		sectors.forEach([&](const long &s) {
+
+			const BlockMatrixXcd m = sectors.sector(full, s);
+
+			if (currents)
+			{
+				greens[s] = full_greens_matrix(m);
+				return;
+			}
+
+			// a sector missing from any block does not connect the leads.
+			if ((sectors.sectorBlocks(s) == 0).any())
+				return;
+
+			TwoLeadTransportSolver solver(m);
+
+			solver.surface_cache = surface_cache;
+			solver.memory_budget = memory_budget;
+			solver.inversion_backend = inversion_backend;
+			solver.coupling_tolerance = coupling_tolerance;
+			solver.product_settings = product_settings;
+			solver.layer_minimization = layer_minimization;
+
+			solver.setLeftLeadBlockCount(left_count);
+			solver.setRightLeadBlockCount(right_count);
+			solver.compute(action);
+
+			transports[s] = solver.transmission();
+		});
+
+		if (currents)
+			current = sectors.combine(greens).real();
+		else
+			transport = std::accumulate(transports.begin(), transports.end(), 0.0);
+
+		log() << "Solved " << sectors.sectorCount() << " symmetry sectors independently." << std::endl;
+
+		return true;
 	}
 	
 public:
 	void compute(const TwoLeadTransportCalculation &action)
 	{
+		if (sector_decomposition && compute_sectors(action))
+			return;
+
 		switch(action)
 		{
 		case LeftToRight:
@@ -200,6 +465,14 @@ public:
 			break;
 		}
 	}
+
+	double transmission() const {
+		return transport;
+	}
+
+	const MatrixXd &currents() const {
+		return current;
+	}
 };
 
 LoggingObject TwoLeadTransportSolver::log("LanduarFormalism::TwoLeadTransportSolver", false);
@@ -0,0 +1,300 @@
+/*
+Header file for QuantumMechanics::LinearAlgebra::PackedBatch and the batched kernels: 
+
+This file keeps many small complex matrices of the same shape interleaved, such that element
+(i, j) of every matrix in the batch is stored contiguously, with the real and imaginary parts
+apart. The kernels loop over the batch innermost, which the compiler vectorizes, and thereby
+avoid the per call overhead of BLAS for the small blocks (b <= 32) of energy, k-point or
+disorder sweeps. The inverse is a Gauss-Jordan elimination with partial pivoting done per
+matrix, where only the row and column swaps leave the vectorized loops.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _LINEARALGEBRA_BATCHEDKERNELS_H_
+#define _LINEARALGEBRA_BATCHEDKERNELS_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace QuantumMechanics {
+
+namespace LinearAlgebra {
+
+class PackedBatch {
+
+	long n_rows;
+	long n_cols;
+	long n_count;
+
+	std::vector<double> re;
+	std::vector<double> im;
+
+public:
+	PackedBatch() : n_rows(0), n_cols(0), n_count(0) { }
+
+	PackedBatch(const long &rows, const long &cols, const long &count) :
+		n_rows(rows), n_cols(cols), n_count(count), re(rows * cols * count, 0.0), im(rows * cols * count, 0.0) { }
+
+	// the matrices must have the same shape.
+	PackedBatch(const std::vector<MatrixXcd> &matrices) :
+		n_rows(matrices.empty() ? 0 : matrices[0].rows()),
+		n_cols(matrices.empty() ? 0 : matrices[0].cols()),
+		n_count(matrices.size()),
+		re(n_rows * n_cols * n_count),
+		im(n_rows * n_cols * n_count)
+	{
+		for (long k = 0; k < n_count; k++)
+			set(k, matrices[k]);
+	}
+
+	long rows() const {
+		return n_rows;
+	}
+
+	long cols() const {
+		return n_cols;
+	}
+
+	long count() const {
+		return n_count;
+	}
+
+	// the first of the count values of element (i, j).
+	double *real(const long &i, const long &j) {
+		return &re[(j * n_rows + i) * n_count];
+	}
+
+	double *imag(const long &i, const long &j) {
+		return &im[(j * n_rows + i) * n_count];
+	}
+
+	const double *real(const long &i, const long &j) const {
+		return &re[(j * n_rows + i) * n_count];
+	}
+
+	const double *imag(const long &i, const long &j) const {
+		return &im[(j * n_rows + i) * n_count];
+	}
+
+	void set(const long &k, const MatrixXcd &M)
+	{
+		for (long j = 0; j < n_cols; j++)
+			for (long i = 0; i < n_rows; i++)
+			{
+				real(i, j)[k] = M(i, j).real();
+				imag(i, j)[k] = M(i, j).imag();
+			}
+	}
+
+	MatrixXcd get(const long &k) const
+	{
+		MatrixXcd M(n_rows, n_cols);
+
+		for (long j = 0; j < n_cols; j++)
+			for (long i = 0; i < n_rows; i++)
+				M(i, j) = std::complex<double>(real(i, j)[k], imag(i, j)[k]);
+
+		return M;
+	}
+
+	std::vector<MatrixXcd> matrices() const
+	{
+		std::vector<MatrixXcd> result(n_count);
+
+		for (long k = 0; k < n_count; k++)
+			result[k] = get(k);
+
+		return result;
+	}
+
+	// this -= other, element wise.
+	void subtract(const PackedBatch &other)
+	{
+		for (std::size_t e = 0; e < re.size(); e++)
+		{
+			re[e] -= other.re[e];
+			im[e] -= other.im[e];
+		}
+	}
+};
+
+	// C_k = A_k B_k for every k, C may be A or B.
+	inline void batchedMultiply(const PackedBatch &A, const PackedBatch &B, PackedBatch &C)
+	{
+		const long count = A.count();
+
+		PackedBatch result(A.rows(), B.cols(), count);
+
+		for (long j = 0; j < B.cols(); j++)
+			for (long l = 0; l < A.cols(); l++)
+			{
+				const double *__restrict br = B.real(l, j);
+				const double *__restrict bi = B.imag(l, j);
+
+				for (long i = 0; i < A.rows(); i++)
+				{
+					const double *__restrict ar = A.real(i, l);
+					const double *__restrict ai = A.imag(i, l);
+					double *__restrict cr = result.real(i, j);
+					double *__restrict ci = result.imag(i, j);
+
+					for (long k = 0; k < count; k++)
+					{
+						cr[k] += ar[k] * br[k] - ai[k] * bi[k];
+						ci[k] += ar[k] * bi[k] + ai[k] * br[k];
+					}
+				}
+			}
+
+		std::swap(C, result);
+	}
+
+	// A_k = A_k^-1 for every k, returns the number of singular matrices.
+	inline long batchedInverse(PackedBatch &A)
+	{
+		const long n = A.rows(), count = A.count();
+
+		std::vector<long> pivots(n * count);
+		std::vector<bool> singular(count, false);
+
+		std::vector<double> dr(count), di(count), fr(count), fi(count);
+
+		for (long j = 0; j < n; j++)
+		{
+			// the pivot search and the row swap differ between the matrices.
+			for (long k = 0; k < count; k++)
+			{
+				long p = j;
+				double largest = -1;
+
+				for (long i = j; i < n; i++)
+				{
+					const double size = std::abs(A.real(i, j)[k]) + std::abs(A.imag(i, j)[k]);
+
+					if (size > largest)
+					{
+						largest = size;
+						p = i;
+					}
+				}
+
+				pivots[j * count + k] = p;
+
+				if (p != j)
+					for (long c = 0; c < n; c++)
+					{
+						std::swap(A.real(j, c)[k], A.real(p, c)[k]);
+						std::swap(A.imag(j, c)[k], A.imag(p, c)[k]);
+					}
+
+				const double norm = A.real(j, j)[k] * A.real(j, j)[k] + A.imag(j, j)[k] * A.imag(j, j)[k];
+
+				if (norm == 0)
+				{
+					singular[k] = true;
+					dr[k] = di[k] = 0;
+				}
+				else
+				{
+					dr[k] = A.real(j, j)[k] / norm;
+					di[k] = - A.imag(j, j)[k] / norm;
+				}
+			}
+
+			// row j is scaled by the inverse pivot, which takes the place of the pivot.
+			{
+				double *__restrict pr = A.real(j, j);
+				double *__restrict pi = A.imag(j, j);
+
+				for (long k = 0; k < count; k++)
+				{
+					pr[k] = 1.0;
+					pi[k] = 0.0;
+				}
+			}
+
+			for (long c = 0; c < n; c++)
+			{
+				double *__restrict ar = A.real(j, c);
+				double *__restrict ai = A.imag(j, c);
+
+				for (long k = 0; k < count; k++)
+				{
+					const double r = ar[k] * dr[k] - ai[k] * di[k];
+					const double i = ar[k] * di[k] + ai[k] * dr[k];
+
+					ar[k] = r;
+					ai[k] = i;
+				}
+			}
+
+			// every other row is eliminated with row j.
+			for (long i = 0; i < n; i++)
+			{
+				if (i == j)
+					continue;
+
+				std::copy(A.real(i, j), A.real(i, j) + count, fr.begin());
+				std::copy(A.imag(i, j), A.imag(i, j) + count, fi.begin());
+
+				{
+					double *__restrict ar = A.real(i, j);
+					double *__restrict ai = A.imag(i, j);
+
+					for (long k = 0; k < count; k++)
+					{
+						ar[k] = 0.0;
+						ai[k] = 0.0;
+					}
+				}
+
+				for (long c = 0; c < n; c++)
+				{
+					double *__restrict ar = A.real(i, c);
+					double *__restrict ai = A.imag(i, c);
+					const double *__restrict br = A.real(j, c);
+					const double *__restrict bi = A.imag(j, c);
+
+					for (long k = 0; k < count; k++)
+					{
+						ar[k] -= fr[k] * br[k] - fi[k] * bi[k];
+						ai[k] -= fr[k] * bi[k] + fi[k] * br[k];
+					}
+				}
+			}
+		}
+
+		// the row swaps of the elimination become column swaps of the inverse, in reverse order.
+		for (long j = n - 1; j >= 0; j--)
+			for (long k = 0; k < count; k++)
+			{
+				const long p = pivots[j * count + k];
+
+				if (p != j)
+					for (long r = 0; r < n; r++)
+					{
+						std::swap(A.real(r, j)[k], A.real(r, p)[k]);
+						std::swap(A.imag(r, j)[k], A.imag(r, p)[k]);
+					}
+			}
+
+		long singular_count = 0;
+
+		for (long k = 0; k < count; k++)
+			if (singular[k])
+				singular_count++;
+
+		return singular_count;
+	}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,188 @@
+/*
+Header file for QuantumMechanics::LinearAlgebra::PackedHermitian and the hermitian kernels: 
+
+This file keeps hermitian matrices, like the broadening i(sigma - sigma*), by their lower
+triangle in the column packed storage of LAPACK, i.e. n(n + 1)/2 elements. A packed broadening
+is built from the lower triangle of sigma only. For a product it is unpacked into the lower
+triangle of a square matrix, which enters a hermitian matrix product (hemm) of level 3.
+
+A broadening of a retarded self-energy is positive semidefinite and factors as F F*, with F of
+the rank of the coupling, such that the transmission trace(gamma_r G gamma_l G*) becomes the
+squared norm of F_r* G F_l. The factor of a coupling of low rank is found from its core in
+LowRankCoupling, at the cost of an eigensolver of the rank. A broadening of a dense
+self-energy is not factored, as its eigensolver costs more than the trace: it is applied by
+hemm, trace(X* gamma X) with X = G F against a factor and trace(gamma_r G gamma_l G*) from two
+hermitian products otherwise. These traces keep their sign, such that a broadening of the
+wrong sign shows as a negative transmission.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _LINEARALGEBRA_HERMITIANKERNELS_H_
+#define _LINEARALGEBRA_HERMITIANKERNELS_H_
+
+#include <Math/Dense>
+#include "ComplexProduct"
+
+#include <cmath>
+#include <vector>
+
+namespace QuantumMechanics {
+
+namespace LinearAlgebra {
+
+class PackedHermitian {
+
+	long n;
+
+	// the lower triangle, column by column.
+	std::vector<std::complex<double> > elements;
+
+	long index(const long &i, const long &j) const {
+		return i + j * (2 * n - j - 1) / 2;
+	}
+
+public:
+	PackedHermitian() : n(0) { }
+
+	PackedHermitian(const long &size) : n(size), elements(size * (size + 1) / 2, 0.0) { }
+
+	// only the lower triangle of M is read.
+	PackedHermitian(const MatrixXcd &M) : n(M.rows()), elements(M.rows() * (M.rows() + 1) / 2)
+	{
+		for (long j = 0; j < n; j++)
+			for (long i = j; i < n; i++)
+				elements[index(i, j)] = M(i, j);
+	}
+
+	long size() const {
+		return n;
+	}
+
+	// the number of stored elements.
+	long storage() const {
+		return elements.size();
+	}
+
+	// i >= j.
+	std::complex<double> &lower(const long &i, const long &j) {
+		return elements[index(i, j)];
+	}
+
+	std::complex<double> operator()(const long &i, const long &j) const {
+		return (i >= j ? elements[index(i, j)] : std::conj(elements[index(j, i)]));
+	}
+
+	// the lower triangle only, with a real diagonal, as read by selfadjointView<Lower>.
+	MatrixXcd lowerTriangle() const
+	{
+		MatrixXcd result = MatrixXcd::Zero(n, n);
+
+		for (long j = 0; j < n; j++)
+		{
+			result(j, j) = elements[index(j, j)].real();
+
+			for (long i = j + 1; i < n; i++)
+				result(i, j) = elements[index(i, j)];
+		}
+
+		return result;
+	}
+
+	MatrixXcd matrix() const
+	{
+		MatrixXcd result(n, n);
+
+		for (long j = 0; j < n; j++)
+		{
+			result(j, j) = elements[index(j, j)].real();
+
+			for (long i = j + 1; i < n; i++)
+			{
+				result(i, j) = elements[index(i, j)];
+				result(j, i) = std::conj(elements[index(i, j)]);
+			}
+		}
+
+		return result;
+	}
+
+	// this X, as a hermitian product from the lower triangle (hemm).
+	MatrixXcd multiply(const MatrixXcd &X) const
+	{
+		const MatrixXcd lower = lowerTriangle();
+
+		return lower.selfadjointView<Lower>() * X;
+	}
+};
+
+	// i(sigma - sigma*), from the lower triangle only.
+	inline PackedHermitian broadening(const MatrixXcd &sigma)
+	{
+		const long n = sigma.rows();
+		const std::complex<double> i_unit(0, 1);
+
+		PackedHermitian result(n);
+
+		for (long j = 0; j < n; j++)
+			for (long i = j; i < n; i++)
+				result.lower(i, j) = i_unit * (sigma(i, j) - std::conj(sigma(j, i)));
+
+		return result;
+	}
+
+	// F with gamma = F F* for a positive semidefinite gamma, eigenvalues below tolerance times the
+	// largest are dropped. The negative part of a gamma of the wrong sign is dropped as well.
+	inline MatrixXcd broadeningFactor(const MatrixXcd &gamma, const double &tolerance = 1e-12)
+	{
+		SelfAdjointEigenSolver<MatrixXcd> eigen(gamma);
+
+		const VectorXd &values = eigen.eigenvalues();
+
+		const double largest = (values.size() > 0 ? values.cwiseAbs().maxCoeff() : 0.0);
+
+		std::vector<long> kept;
+
+		for (long k = 0; k < values.size(); k++)
+			if (values[k] > tolerance * largest)
+				kept.push_back(k);
+
+		MatrixXcd F(gamma.rows(), kept.size());
+
+		for (std::size_t k = 0; k < kept.size(); k++)
+			F.col(k) = eigen.eigenvectors().col(kept[k]) * std::sqrt(values[kept[k]]);
+
+		return F;
+	}
+
+	// trace(gamma_out G gamma_in G*) = |F_out* G F_in|^2.
+	inline double transmission(const MatrixXcd &G, const MatrixXcd &F_in, const MatrixXcd &F_out, const ProductSettings &settings = ProductSettings())
+	{
+		const MatrixXcd F_out_adjoint = F_out.adjoint();
+
+		return multiply(F_out_adjoint, G, F_in, settings).squaredNorm();
+	}
+
+	// trace(gamma_out G F_in F_in* G*) = trace(X* gamma_out X) with X = G F_in.
+	inline double transmission(const MatrixXcd &G, const MatrixXcd &F_in, const PackedHermitian &gamma_out, const ProductSettings &settings = ProductSettings())
+	{
+		const MatrixXcd X = multiply(G, F_in, settings);
+
+		const MatrixXcd X_adjoint = X.adjoint();
+
+		return traceOfProduct(X_adjoint, gamma_out.multiply(X)).real();
+	}
+
+	// trace(gamma_out G gamma_in G*), from the packed broadenings without factoring them.
+	inline double transmission(const MatrixXcd &G, const PackedHermitian &gamma_in, const PackedHermitian &gamma_out)
+	{
+		const MatrixXcd G_adjoint = G.adjoint();
+
+		return traceOfProduct(gamma_out.multiply(G), gamma_in.multiply(G_adjoint)).real();
+	}
+
+}
+
+}
+
+#endif
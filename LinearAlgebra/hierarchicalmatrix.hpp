@@ -0,0 +1,416 @@
+/*
+Header file for QuantumMechanics::LinearAlgebra::HierarchicalMatrix: 
+
+This file stores a square complex matrix as a hierarchically off-diagonal low-rank (HODLR)
+matrix: the matrix is split in halves, the two off-diagonal parts are kept as low-rank
+products U V* and the two diagonal parts are split again, until they are at most leaf_size
+wide and kept densely. The low-rank parts are found by adaptive cross approximation (ACA)
+with partial pivoting, which only reads a few rows and columns, and are recompressed by a
+truncated SVD at the same relative tolerance.
+
+The inverse is found recursively from the Schur complement of the lower diagonal part, in
+which every update is a low-rank addition. For the wide blocks of 2D devices the off-diagonal
+ranks grow slowly with the width, and the products and inverses approach O(b log^2 b).
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _LINEARALGEBRA_HIERARCHICALMATRIX_H_
+#define _LINEARALGEBRA_HIERARCHICALMATRIX_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace QuantumMechanics {
+
+namespace LinearAlgebra {
+
+class HierarchicalMatrix {
+
+	long n;
+
+	double tolerance;
+	long leaf_size;
+
+	// set for leafs only.
+	MatrixXcd dense;
+
+	std::unique_ptr<HierarchicalMatrix> top;
+	std::unique_ptr<HierarchicalMatrix> bottom;
+
+	// the upper right part is upper_u * upper_v.adjoint(), the lower left alike.
+	MatrixXcd upper_u, upper_v;
+	MatrixXcd lower_u, lower_v;
+
+	static LoggingObject log;
+
+	HierarchicalMatrix(const long &size, const double &eps, const long &leaf) : n(size), tolerance(eps), leaf_size(leaf) { }
+
+public:
+	HierarchicalMatrix(const MatrixXcd &A, const double &eps = 1e-10, const long &leaf = 64) :
+		n(A.rows()),
+		tolerance(eps),
+		leaf_size(std::max(1L, leaf))
+	{
+		if (n <= leaf_size)
+		{
+			dense = A;
+			return;
+		}
+
+		const long h = n / 2;
+
+		top.reset(new HierarchicalMatrix(A.topLeftCorner(h, h), tolerance, leaf_size));
+		bottom.reset(new HierarchicalMatrix(A.bottomRightCorner(n - h, n - h), tolerance, leaf_size));
+
+		approximate(A.topRightCorner(h, n - h), tolerance, upper_u, upper_v);
+		approximate(A.bottomLeftCorner(n - h, h), tolerance, lower_u, lower_v);
+	}
+
+	HierarchicalMatrix(const HierarchicalMatrix &other) :
+		n(other.n),
+		tolerance(other.tolerance),
+		leaf_size(other.leaf_size),
+		dense(other.dense),
+		top(other.top ? new HierarchicalMatrix(*other.top) : nullptr),
+		bottom(other.bottom ? new HierarchicalMatrix(*other.bottom) : nullptr),
+		upper_u(other.upper_u), upper_v(other.upper_v),
+		lower_u(other.lower_u), lower_v(other.lower_v)
+	{ }
+
+	HierarchicalMatrix &operator=(const HierarchicalMatrix &other)
+	{
+		if (this != &other)
+		{
+			HierarchicalMatrix copy(other);
+
+			n = copy.n;
+			tolerance = copy.tolerance;
+			leaf_size = copy.leaf_size;
+			dense.swap(copy.dense);
+			top.swap(copy.top);
+			bottom.swap(copy.bottom);
+			upper_u.swap(copy.upper_u);
+			upper_v.swap(copy.upper_v);
+			lower_u.swap(copy.lower_u);
+			lower_v.swap(copy.lower_v);
+		}
+
+		return *this;
+	}
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+	long rows() const {
+		return n;
+	}
+
+	long cols() const {
+		return n;
+	}
+
+	bool isLeaf() const {
+		return !top;
+	}
+
+	// the largest rank of the off-diagonal parts.
+	long rank() const
+	{
+		if (isLeaf())
+			return 0;
+
+		return std::max(std::max(upper_u.cols(), lower_u.cols()), std::max(top->rank(), bottom->rank()));
+	}
+
+	// the number of stored coefficients, n * n for a dense matrix.
+	long storage() const
+	{
+		if (isLeaf())
+			return dense.size();
+
+		return top->storage() + bottom->storage() + upper_u.size() + upper_v.size() + lower_u.size() + lower_v.size();
+	}
+
+	// truncates U V* to the singular values above tolerance times the largest.
+	static void recompress(MatrixXcd &U, MatrixXcd &V, const double &tolerance)
+	{
+		if (U.cols() == 0)
+			return;
+
+		const long ru = std::min(U.rows(), U.cols()), rv = std::min(V.rows(), V.cols());
+
+		HouseholderQR<MatrixXcd> qu(U), qv(V);
+
+		const MatrixXcd Ru = qu.matrixQR().topRows(ru).triangularView<Upper>();
+		const MatrixXcd Rv = qv.matrixQR().topRows(rv).triangularView<Upper>();
+
+		JacobiSVD<MatrixXcd> svd(Ru * Rv.adjoint(), ComputeThinU | ComputeThinV);
+
+		const VectorXd &s = svd.singularValues();
+
+		long rank = 0;
+
+		while (rank < s.size() && s[rank] > tolerance * s[0])
+			rank++;
+
+		U = qu.householderQ() * MatrixXcd::Identity(U.rows(), ru) * svd.matrixU().leftCols(rank) * s.head(rank).asDiagonal();
+		V = qv.householderQ() * MatrixXcd::Identity(V.rows(), rv) * svd.matrixV().leftCols(rank);
+	}
+
+	// A ~ U V* by ACA with partial pivoting, stopped when the last cross is below tolerance
+	// relative to the estimated norm. When the rank grows beyond half the dimension the
+	// block is not low-rank, and it is truncated by a full SVD instead.
+	static void approximate(const MatrixXcd &A, const double &tolerance, MatrixXcd &U, MatrixXcd &V)
+	{
+		const long m = A.rows(), k = A.cols();
+		const long max_rank = std::max(1L, std::min(m, k) / 2);
+
+		std::vector<VectorXcd> us, ws;
+		std::vector<bool> used(m, false);
+
+		double norm2 = 0;
+		long row = 0;
+		bool converged = false;
+
+		for (long tries = 0; tries < m && long(us.size()) < max_rank; tries++)
+		{
+			used[row] = true;
+
+			VectorXcd w = A.row(row).transpose();
+
+			for (std::size_t l = 0; l < us.size(); l++)
+				w -= us[l][row] * ws[l];
+
+			long col;
+
+			if (w.cwiseAbs().maxCoeff(&col) == 0)
+			{
+				// a zero residual row, the next unused row is tried.
+				row = std::find(used.begin(), used.end(), false) - used.begin();
+
+				if (row == m)
+				{
+					converged = true;
+					break;
+				}
+
+				continue;
+			}
+
+			w /= w[col];
+
+			VectorXcd u = A.col(col);
+
+			for (std::size_t l = 0; l < us.size(); l++)
+				u -= ws[l][col] * us[l];
+
+			const double cross2 = u.squaredNorm() * w.squaredNorm();
+
+			for (std::size_t l = 0; l < us.size(); l++)
+				norm2 += 2.0 * std::real(us[l].dot(u) * std::conj(ws[l].dot(w)));
+
+			norm2 += cross2;
+
+			us.push_back(u);
+			ws.push_back(w);
+
+			if (cross2 <= tolerance * tolerance * norm2)
+			{
+				converged = true;
+				break;
+			}
+
+			double largest = -1;
+
+			for (long i = 0; i < m; i++)
+				if (!used[i] && std::abs(u[i]) > largest)
+				{
+					largest = std::abs(u[i]);
+					row = i;
+				}
+
+			if (largest < 0)
+			{
+				converged = true;
+				break;
+			}
+		}
+
+		if (!converged)
+		{
+			log() << "The ACA of a " << m << "-by-" << k << " block did not converge, it is truncated by SVD." << std::endl;
+
+			JacobiSVD<MatrixXcd> svd(A, ComputeThinU | ComputeThinV);
+
+			const VectorXd &s = svd.singularValues();
+
+			long rank = 0;
+
+			while (rank < s.size() && s[rank] > tolerance * s[0])
+				rank++;
+
+			U = svd.matrixU().leftCols(rank) * s.head(rank).asDiagonal();
+			V = svd.matrixV().leftCols(rank);
+
+			return;
+		}
+
+		U.resize(m, us.size());
+		V.resize(k, us.size());
+
+		for (std::size_t l = 0; l < us.size(); l++)
+		{
+			U.col(l) = us[l];
+			V.col(l) = ws[l].conjugate();
+		}
+
+		recompress(U, V, tolerance);
+	}
+
+	MatrixXcd matrix() const
+	{
+		if (isLeaf())
+			return dense;
+
+		const long h = top->rows();
+
+		MatrixXcd result(n, n);
+
+		result.topLeftCorner(h, h) = top->matrix();
+		result.bottomRightCorner(n - h, n - h) = bottom->matrix();
+		result.topRightCorner(h, n - h) = upper_u * upper_v.adjoint();
+		result.bottomLeftCorner(n - h, h) = lower_u * lower_v.adjoint();
+
+		return result;
+	}
+
+	// this * X.
+	MatrixXcd multiply(const MatrixXcd &X) const
+	{
+		if (isLeaf())
+			return dense * X;
+
+		const long h = top->rows();
+
+		MatrixXcd result(n, X.cols());
+
+		result.topRows(h) = top->multiply(X.topRows(h)) + upper_u * (upper_v.adjoint() * X.bottomRows(n - h));
+		result.bottomRows(n - h) = bottom->multiply(X.bottomRows(n - h)) + lower_u * (lower_v.adjoint() * X.topRows(h));
+
+		return result;
+	}
+
+	// this* * X.
+	MatrixXcd adjointMultiply(const MatrixXcd &X) const
+	{
+		if (isLeaf())
+			return dense.adjoint() * X;
+
+		const long h = top->rows();
+
+		MatrixXcd result(n, X.cols());
+
+		result.topRows(h) = top->adjointMultiply(X.topRows(h)) + lower_v * (lower_u.adjoint() * X.bottomRows(n - h));
+		result.bottomRows(n - h) = bottom->adjointMultiply(X.bottomRows(n - h)) + upper_v * (upper_u.adjoint() * X.topRows(h));
+
+		return result;
+	}
+
+	// this += U V*, the off-diagonal parts are recompressed.
+	void addLowRank(const MatrixXcd &U, const MatrixXcd &V)
+	{
+		if (isLeaf())
+		{
+			dense.noalias() += U * V.adjoint();
+			return;
+		}
+
+		const long h = top->rows();
+
+		top->addLowRank(U.topRows(h), V.topRows(h));
+		bottom->addLowRank(U.bottomRows(n - h), V.bottomRows(n - h));
+
+		MatrixXcd u(h, upper_u.cols() + U.cols()), v(n - h, upper_v.cols() + V.cols());
+
+		u << upper_u, U.topRows(h);
+		v << upper_v, V.bottomRows(n - h);
+
+		recompress(u, v, tolerance);
+		upper_u.swap(u);
+		upper_v.swap(v);
+
+		u.resize(n - h, lower_u.cols() + U.cols());
+		v.resize(h, lower_v.cols() + V.cols());
+
+		u << lower_u, U.bottomRows(n - h);
+		v << lower_v, V.topRows(h);
+
+		recompress(u, v, tolerance);
+		lower_u.swap(u);
+		lower_v.swap(v);
+	}
+
+	/*
+	For [A B; C D] with B = U1 V1* and C = U2 V2*, the Schur complement S = D - C A^-1 B is a
+	low-rank update of D, and
+
+		inverse = [A^-1 + A^-1 B S^-1 C A^-1	-A^-1 B S^-1]
+				  [-S^-1 C A^-1					S^-1		]
+
+	where every off-diagonal part stays low-rank.
+	*/
+	HierarchicalMatrix inverse() const
+	{
+		HierarchicalMatrix result(n, tolerance, leaf_size);
+
+		if (isLeaf())
+		{
+			result.dense = dense.inverse();
+			return result;
+		}
+
+		HierarchicalMatrix top_inverse = top->inverse();
+
+		const MatrixXcd W = top_inverse.multiply(upper_u);
+
+		HierarchicalMatrix schur(*bottom);
+
+		schur.addLowRank(- lower_u * (lower_v.adjoint() * W), upper_v);
+
+		HierarchicalMatrix schur_inverse = schur.inverse();
+
+		const MatrixXcd P = top_inverse.adjointMultiply(lower_v);
+		const MatrixXcd Q = schur_inverse.adjointMultiply(upper_v);
+
+		result.upper_u = - W;
+		result.upper_v = Q;
+		result.lower_u = - schur_inverse.multiply(lower_u);
+		result.lower_v = P;
+
+		recompress(result.upper_u, result.upper_v, tolerance);
+		recompress(result.lower_u, result.lower_v, tolerance);
+
+		top_inverse.addLowRank(W * (Q.adjoint() * lower_u), P);
+
+		result.top.reset(new HierarchicalMatrix(top_inverse));
+		result.bottom.reset(new HierarchicalMatrix(schur_inverse));
+
+		return result;
+	}
+};
+
+LoggingObject HierarchicalMatrix::log("LinearAlgebra::HierarchicalMatrix", false);
+
+}
+
+}
+
+#endif
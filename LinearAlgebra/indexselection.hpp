@@ -0,0 +1,37 @@
+/*
+Header file for QuantumMechanics::LinearAlgebra::IndexSelection: 
+
+This file gathers the submatrix M(rows, cols) of arbitrary row and column indices, in the given
+order, like the electron half of a Nambu block or the coupled orbitals of a lead layer.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _LINEARALGEBRA_INDEXSELECTION_H_
+#define _LINEARALGEBRA_INDEXSELECTION_H_
+
+#include <Math/Dense>
+
+#include <vector>
+
+namespace QuantumMechanics {
+
+namespace LinearAlgebra {
+
+	template<class Matrix>
+	inline MatrixXcd select(const Matrix &M, const std::vector<long> &rows, const std::vector<long> &cols)
+	{
+		MatrixXcd result(rows.size(), cols.size());
+
+		for (std::size_t j = 0; j < cols.size(); j++)
+			for (std::size_t i = 0; i < rows.size(); i++)
+				result(i, j) = M(rows[i], cols[j]);
+
+		return result;
+	}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,196 @@
+/*
+Header file for QuantumMechanics::LinearAlgebra::LowRankCoupling: 
+
+This file compresses a coupling matrix A, typically connecting a few surface orbitals of a
+lead to the edge of a device, as A = P_r L R* P_c^T, where P_r and P_c select the rows and
+columns with nonzero elements and L R* is the truncated SVD of the remaining compact part.
+The self-energy A g A* is then built from the coupled part of g only, through a core of the
+size of the coupling rank, and is embedded directly into the coupled rows of a target. Its
+broadening L i(C - C*) L* is factored from the core C as well, by an eigensolver of the rank.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _LINEARALGEBRA_LOWRANKCOUPLING_H_
+#define _LINEARALGEBRA_LOWRANKCOUPLING_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+#include "ComplexProduct"
+#include "HermitianKernels"
+#include "IndexSelection"
+
+#include <vector>
+
+namespace QuantumMechanics {
+
+namespace LinearAlgebra {
+
+class LowRankCoupling {
+
+	long n_rows;
+	long n_cols;
+
+	// the coupled rows and columns of A.
+	std::vector<long> row_index;
+	std::vector<long> col_index;
+
+	// A(row_index, col_index) ~ L R*.
+	MatrixXcd L;
+	MatrixXcd R;
+
+	// used by the products of the self-energy.
+	ProductSettings product_settings;
+
+	static LoggingObject log;
+
+public:
+	// elements and singular values below tolerance times the largest are dropped.
+	LowRankCoupling(const MatrixXcd &A, const double &tolerance = 1e-12, const ProductSettings &settings = ProductSettings()) :
+		n_rows(A.rows()), n_cols(A.cols()), product_settings(settings)
+	{
+		const double largest = (A.size() > 0 ? A.cwiseAbs().maxCoeff() : 0.0);
+		const double threshold = tolerance * largest;
+
+		for (long i = 0; i < n_rows; i++)
+			if (A.row(i).cwiseAbs().maxCoeff() > threshold)
+				row_index.push_back(i);
+
+		for (long j = 0; j < n_cols; j++)
+			if (A.col(j).cwiseAbs().maxCoeff() > threshold)
+				col_index.push_back(j);
+
+		if (row_index.empty() || col_index.empty())
+		{
+			L.resize(row_index.size(), 0);
+			R.resize(col_index.size(), 0);
+			return;
+		}
+
+		const MatrixXcd compact = select(A, row_index, col_index);
+
+		JacobiSVD<MatrixXcd> svd(compact, ComputeThinU | ComputeThinV);
+
+		const VectorXd &s = svd.singularValues();
+
+		long rank = 0;
+
+		while (rank < s.size() && s[rank] > tolerance * s[0])
+			rank++;
+
+		L = svd.matrixU().leftCols(rank) * s.head(rank).asDiagonal();
+		R = svd.matrixV().leftCols(rank);
+
+		log() << "A " << n_rows << "-by-" << n_cols << " coupling has " << row_index.size() << " coupled rows, " << col_index.size() << " coupled columns and rank " << rank << "." << std::endl;
+	}
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+	long rows() const {
+		return n_rows;
+	}
+
+	long cols() const {
+		return n_cols;
+	}
+
+	long rank() const {
+		return L.cols();
+	}
+
+	const std::vector<long> &coupledRows() const {
+		return row_index;
+	}
+
+	const std::vector<long> &coupledCols() const {
+		return col_index;
+	}
+
+	MatrixXcd matrix() const
+	{
+		MatrixXcd result = MatrixXcd::Zero(n_rows, n_cols);
+
+		const MatrixXcd compact = L * R.adjoint();
+
+		for (std::size_t j = 0; j < col_index.size(); j++)
+			for (std::size_t i = 0; i < row_index.size(); i++)
+				result(row_index[i], col_index[j]) = compact(i, j);
+
+		return result;
+	}
+
+	// R* g(coupled, coupled) R, the self-energy in the rank-sized coupling basis.
+	MatrixXcd core(const MatrixXcd &g) const
+	{
+		return multiply(R.adjoint(), select(g, col_index, col_index), R, product_settings);
+	}
+
+	// the self-energy A g A* = L R* g R L* of the coupled rows, in the order of coupledRows().
+	MatrixXcd compactSelfEnergy(const MatrixXcd &g) const
+	{
+		const MatrixXcd coupled = select(g, col_index, col_index);
+		const MatrixXcd L_adjoint = L.adjoint(), R_adjoint = R.adjoint();
+
+		const std::vector<const MatrixXcd *> factors = { &L, &R_adjoint, &coupled, &R, &L_adjoint };
+
+		return multiply(factors, product_settings);
+	}
+
+	// target += scale * A g A*, only the coupled rows and columns of target are touched.
+	template<class Matrix>
+	void addSelfEnergy(Matrix &target, const MatrixXcd &g, const std::complex<double> &scale = 1.0) const
+	{
+		const MatrixXcd sigma = compactSelfEnergy(g);
+
+		for (std::size_t j = 0; j < row_index.size(); j++)
+			for (std::size_t i = 0; i < row_index.size(); i++)
+				target(row_index[i], row_index[j]) += scale * sigma(i, j);
+	}
+
+	// the dense block [offset, offset + size) of A g A*.
+	MatrixXcd selfEnergyBlock(const MatrixXcd &g, const long &offset, const long &size) const
+	{
+		MatrixXcd result = MatrixXcd::Zero(size, size);
+
+		const MatrixXcd sigma = compactSelfEnergy(g);
+
+		for (std::size_t j = 0; j < row_index.size(); j++)
+			for (std::size_t i = 0; i < row_index.size(); i++)
+				if (row_index[i] >= offset && row_index[i] < offset + size && row_index[j] >= offset && row_index[j] < offset + size)
+					result(row_index[i] - offset, row_index[j] - offset) = sigma(i, j);
+
+		return result;
+	}
+
+	// F with F F* the block [offset, offset + size) of i(A g A* - (A g A*)*), for a retarded g.
+	MatrixXcd broadeningFactor(const MatrixXcd &g, const long &offset, const long &size, const double &tolerance = 1e-12) const
+	{
+		if (rank() == 0)
+			return MatrixXcd::Zero(size, 0);
+
+		const std::complex<double> i_unit(0, 1);
+
+		const MatrixXcd C = core(g);
+		const MatrixXcd W = LinearAlgebra::broadeningFactor(MatrixXcd(i_unit * (C - C.adjoint())), tolerance);
+		const MatrixXcd compact = L * W;
+
+		MatrixXcd result = MatrixXcd::Zero(size, W.cols());
+
+		for (std::size_t i = 0; i < row_index.size(); i++)
+			if (row_index[i] >= offset && row_index[i] < offset + size)
+				result.row(row_index[i] - offset) = compact.row(i);
+
+		return result;
+	}
+};
+
+LoggingObject LowRankCoupling::log("LinearAlgebra::LowRankCoupling", false);
+
+}
+
+}
+
+#endif
@@ -0,0 +1,613 @@
+/*
+Header file for QuantumMechanics::LinearAlgebra::SparseDirectSolver: 
+
+This file solves a general sparse complex matrix A, e.g. (E - H) of a device with loops, rings
+or several leads on one side, where the block tridiagonal chain of the greens solvers does not
+apply. The matrix graph is ordered by nested dissection into a tree of separators, and A is
+factorized multifrontally: every tree node eliminates its separator (a dense supernode) from
+a dense front, and passes the Schur complement on its boundary to its parent. The subtrees
+of a node are independent and are factorized in parallel with TBB.
+
+After the factorization, selected inversion walks the tree from the root and finds the
+elements of A^-1 on the pattern of the factors, which includes the diagonal and every
+block of coupled sites, without a dense inverse. Elements outside the pattern are found by
+solving for the requested columns.
+
+Pivoting is done within the supernodes only, which is stable for the shifted matrices of
+greens matrix calculations but not for arbitrary matrices.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _LINEARALGEBRA_SPARSEDIRECTSOLVER_H_
+#define _LINEARALGEBRA_SPARSEDIRECTSOLVER_H_
+
+#include <Math/Dense>
+#include <Math/Sparse>
+#include "../Misc/LoggingObject"
+
+#include <tbb/tbb.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+namespace QuantumMechanics {
+
+namespace LinearAlgebra {
+
+	typedef SparseMatrix<std::complex<double> > SparseMatrixXcd;
+
+class SparseDirectSolver {
+
+	typedef SparseMatrix<std::complex<double>, RowMajor> RowMajorMatrixXcd;
+
+	struct Node {
+		// the eliminated vertices, and the later vertices they are coupled to after elimination.
+		std::vector<long> pivots;
+		std::vector<long> boundary;
+
+		std::vector<long> children;
+		long parent;
+
+		// the first elimination position of the pivots.
+		long first;
+
+		// for the front [A11 A12; A21 A22]: A11^-1, A11^-1 A12 and A21 A11^-1.
+		MatrixXcd inverse;
+		MatrixXcd W;
+		MatrixXcd V;
+
+		// the Schur complement on the boundary, passed to the parent.
+		MatrixXcd update;
+
+		// the selected inverse on the front (pivots, then boundary).
+		MatrixXcd X;
+
+		Node() : parent(-1), first(0) { }
+	};
+
+	SparseMatrixXcd A;
+	RowMajorMatrixXcd A_rows;
+
+	long n;
+	long leaf_size;
+
+	std::vector<Node> nodes;
+	long root;
+
+	// the nodes in elimination order.
+	std::vector<long> postorder;
+
+	// the elimination position and the tree node of every vertex.
+	std::vector<long> position;
+	std::vector<long> owner;
+
+	bool factorized;
+	bool inverted;
+	std::atomic<bool> singular;
+
+	static LoggingObject log;
+
+public:
+	SparseDirectSolver(const SparseMatrixXcd &matrix, const long &leaf = 64) :
+		A(matrix),
+		A_rows(matrix),
+		n(matrix.rows()),
+		leaf_size(std::max(1L, leaf)),
+		root(-1),
+		factorized(false),
+		inverted(false),
+		singular(false)
+	{
+		A.makeCompressed();
+		A_rows.makeCompressed();
+	}
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+	bool isFactorized() const {
+		return factorized;
+	}
+
+	bool isSingular() const {
+		return singular;
+	}
+
+	long nodeCount() const {
+		return nodes.size();
+	}
+
+	// the largest supernode, i.e. the largest separator or leaf.
+	long largestSupernode() const
+	{
+		long largest = 0;
+
+		for (auto &node : nodes)
+			largest = std::max(largest, long(node.pivots.size()));
+
+		return largest;
+	}
+
+protected:
+	// the symmetric pattern of A, without the diagonal.
+	std::vector<std::vector<long> > adjacency() const
+	{
+		std::vector<std::vector<long> > graph(n);
+
+		for (long k = 0; k < A.outerSize(); k++)
+			for (SparseMatrixXcd::InnerIterator it(A, k); it; ++it)
+				if (it.row() != it.col())
+				{
+					graph[it.row()].push_back(it.col());
+					graph[it.col()].push_back(it.row());
+				}
+
+		for (auto &neighbours : graph)
+		{
+			std::sort(neighbours.begin(), neighbours.end());
+			neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+		}
+
+		return graph;
+	}
+
+	// the levels of a breadth first search within the vertices marked with stamp.
+	static long level_structure(const std::vector<std::vector<long> > &graph, const long &start, const std::vector<long> &mark, const long &stamp, std::vector<long> &level, std::vector<long> &order)
+	{
+		order.clear();
+		order.push_back(start);
+		level[start] = 0;
+
+		for (std::size_t k = 0; k < order.size(); k++)
+			for (auto &j : graph[order[k]])
+				if (mark[j] == stamp && level[j] < 0)
+				{
+					level[j] = level[order[k]] + 1;
+					order.push_back(j);
+				}
+
+		return level[order.back()];
+	}
+
+	// splits the vertices by the middle level of a breadth first search from a pseudo-peripheral vertex.
+	long dissect(const std::vector<std::vector<long> > &graph, const std::vector<long> &vertices, std::vector<long> &mark, long &stamp, std::vector<long> &level, const long &parent)
+	{
+		const long index = nodes.size();
+
+		nodes.push_back(Node());
+		nodes[index].parent = parent;
+
+		if (long(vertices.size()) <= leaf_size)
+		{
+			nodes[index].pivots = vertices;
+			return index;
+		}
+
+		stamp++;
+
+		for (auto &v : vertices)
+			mark[v] = stamp;
+
+		std::vector<long> order;
+
+		long start = vertices[0];
+		long depth = level_structure(graph, start, mark, stamp, level, order);
+
+		// a few sweeps towards the farthest vertex give a long and narrow level structure.
+		for (int sweep = 0; sweep < 2; sweep++)
+		{
+			const long candidate = order.back();
+
+			for (auto &v : order)
+				level[v] = -1;
+
+			const long candidate_depth = level_structure(graph, candidate, mark, stamp, level, order);
+
+			if (candidate_depth <= depth)
+			{
+				for (auto &v : order)
+					level[v] = -1;
+
+				level_structure(graph, start, mark, stamp, level, order);
+				break;
+			}
+
+			start = candidate;
+			depth = candidate_depth;
+		}
+
+		std::vector<long> first_part, separator, second_part;
+
+		if (order.size() < vertices.size())
+		{
+			// the vertices are not connected, the reached component is split from the rest.
+			for (auto &v : vertices)
+				(level[v] >= 0 ? first_part : second_part).push_back(v);
+		}
+		else
+		{
+			std::vector<long> count(depth + 1, 0);
+
+			for (auto &v : order)
+				count[level[v]]++;
+
+			long middle = 0, below = 0;
+
+			while (middle < depth && below + count[middle] < long(vertices.size()) / 2)
+				below += count[middle++];
+
+			for (auto &v : vertices)
+			{
+				if (level[v] < middle)
+					first_part.push_back(v);
+				else if (level[v] == middle)
+					separator.push_back(v);
+				else
+					second_part.push_back(v);
+			}
+		}
+
+		for (auto &v : order)
+			level[v] = -1;
+
+		if (first_part.empty() || second_part.empty())
+		{
+			// nothing separates the vertices, they become a single supernode.
+			nodes[index].pivots = vertices;
+			return index;
+		}
+
+		const long first_child = dissect(graph, first_part, mark, stamp, level, index);
+		const long second_child = dissect(graph, second_part, mark, stamp, level, index);
+
+		nodes[index].children.push_back(first_child);
+		nodes[index].children.push_back(second_child);
+		nodes[index].pivots = separator;
+
+		return index;
+	}
+
+	// numbers the pivots in post order, such that every node is eliminated after its subtree.
+	void number(const long &index, long &next)
+	{
+		for (auto &child : nodes[index].children)
+			number(child, next);
+
+		nodes[index].first = next;
+		postorder.push_back(index);
+
+		for (auto &v : nodes[index].pivots)
+		{
+			position[v] = next++;
+			owner[v] = index;
+		}
+	}
+
+	void symbolic(const long &index, const std::vector<std::vector<long> > &graph)
+	{
+		Node &node = nodes[index];
+
+		for (auto &child : node.children)
+			symbolic(child, graph);
+
+		const long last = node.first + node.pivots.size();
+
+		std::vector<long> boundary;
+
+		for (auto &v : node.pivots)
+			for (auto &j : graph[v])
+				if (position[j] >= last)
+					boundary.push_back(j);
+
+		for (auto &child : node.children)
+			for (auto &j : nodes[child].boundary)
+				if (position[j] >= last)
+					boundary.push_back(j);
+
+		std::sort(boundary.begin(), boundary.end(), [this](const long &a, const long &b) { return position[a] < position[b]; });
+		boundary.erase(std::unique(boundary.begin(), boundary.end()), boundary.end());
+
+		node.boundary = boundary;
+	}
+
+	// the place of vertex v in the front of a node, or -1.
+	long front_index(const Node &node, const long &v) const
+	{
+		const long p = node.pivots.size();
+		const long offset = position[v] - node.first;
+
+		if (offset >= 0 && offset < p)
+			return offset;
+
+		auto it = std::lower_bound(node.boundary.begin(), node.boundary.end(), v, [this](const long &a, const long &b) { return position[a] < position[b]; });
+
+		if (it != node.boundary.end() && *it == v)
+			return p + (it - node.boundary.begin());
+
+		return -1;
+	}
+
+	void factorize_node(const long &index)
+	{
+		Node &node = nodes[index];
+
+		const long p = node.pivots.size(), m = node.boundary.size();
+
+		MatrixXcd F = MatrixXcd::Zero(p + m, p + m);
+
+		// the elements of A are assembled where the first of their row and column is eliminated.
+		for (long k = 0; k < p; k++)
+		{
+			const long v = node.pivots[k];
+
+			for (RowMajorMatrixXcd::InnerIterator it(A_rows, v); it; ++it)
+				if (position[it.col()] >= node.first)
+					F(k, front_index(node, it.col())) += it.value();
+
+			for (SparseMatrixXcd::InnerIterator it(A, v); it; ++it)
+				if (position[it.row()] >= node.first + p)
+					F(front_index(node, it.row()), k) += it.value();
+		}
+
+		for (auto &child : node.children)
+		{
+			Node &c = nodes[child];
+
+			std::vector<long> map(c.boundary.size());
+
+			for (std::size_t i = 0; i < c.boundary.size(); i++)
+				map[i] = front_index(node, c.boundary[i]);
+
+			for (std::size_t j = 0; j < c.boundary.size(); j++)
+				for (std::size_t i = 0; i < c.boundary.size(); i++)
+					F(map[i], map[j]) += c.update(i, j);
+
+			c.update.resize(0, 0);
+		}
+
+		if (p > 0)
+		{
+			PartialPivLU<MatrixXcd> lu(F.topLeftCorner(p, p));
+
+			if ((lu.matrixLU().diagonal().array() == std::complex<double>(0)).any())
+				singular = true;
+
+			node.inverse = lu.inverse();
+			node.W = node.inverse * F.topRightCorner(p, m);
+			node.V = F.bottomLeftCorner(m, p) * node.inverse;
+			node.update = F.bottomRightCorner(m, m) - F.bottomLeftCorner(m, p) * node.W;
+		}
+		else
+			node.update = F;
+	}
+
+	void factorize_subtree(const long &index)
+	{
+		tbb::parallel_for(std::size_t(0), nodes[index].children.size(), [&](const std::size_t &c) {
+			factorize_subtree(nodes[index].children[c]);
+		});
+
+		factorize_node(index);
+	}
+
+	void invert_subtree(const long &index)
+	{
+		Node &node = nodes[index];
+
+		const long p = node.pivots.size(), m = node.boundary.size();
+
+		// the inverse on the boundary is known from the ancestors, since the boundary is a clique.
+		MatrixXcd X_BB(m, m);
+
+		for (long j = 0; j < m; j++)
+			for (long i = 0; i < m; i++)
+				X_BB(i, j) = stored_element(node.boundary[i], node.boundary[j]);
+
+		node.X.resize(p + m, p + m);
+
+		if (p > 0)
+		{
+			const MatrixXcd X_BP = - X_BB * node.V;
+
+			node.X.topRightCorner(p, m) = - node.W * X_BB;
+			node.X.bottomLeftCorner(m, p) = X_BP;
+			node.X.topLeftCorner(p, p) = node.inverse - node.W * X_BP;
+		}
+
+		node.X.bottomRightCorner(m, m) = X_BB;
+
+		tbb::parallel_for(std::size_t(0), node.children.size(), [&](const std::size_t &c) {
+			invert_subtree(node.children[c]);
+		});
+	}
+
+	// an element of the selected inverse, which must be on the pattern of the factors.
+	std::complex<double> stored_element(const long &i, const long &j) const
+	{
+		const Node &node = nodes[owner[position[i] <= position[j] ? i : j]];
+
+		return node.X(front_index(node, i), front_index(node, j));
+	}
+
+	bool in_pattern(const long &i, const long &j) const
+	{
+		const Node &node = nodes[owner[position[i] <= position[j] ? i : j]];
+
+		return front_index(node, i) >= 0 && front_index(node, j) >= 0;
+	}
+
+public:
+	void factorize()
+	{
+		log() << "Preparing the nested dissection of a " << n << "-by-" << n << " matrix with " << A.nonZeros() << " elements." << std::endl;
+
+		const std::vector<std::vector<long> > graph = adjacency();
+
+		std::vector<long> vertices(n), mark(n, 0), level(n, -1);
+
+		for (long v = 0; v < n; v++)
+			vertices[v] = v;
+
+		long stamp = 0;
+
+		nodes.clear();
+		root = dissect(graph, vertices, mark, stamp, level, -1);
+
+		position.assign(n, -1);
+		owner.assign(n, -1);
+		postorder.clear();
+
+		long next = 0;
+
+		number(root, next);
+		symbolic(root, graph);
+
+		log() << "The separator tree has " << nodes.size() << " nodes, the largest supernode has " << largestSupernode() << " vertices." << std::endl;
+
+		singular = false;
+
+		factorize_subtree(root);
+
+		factorized = true;
+		inverted = false;
+
+		log() << "The factorization is finished" << (singular ? ", but the matrix is singular." : ".") << std::endl;
+	}
+
+	// A^-1 B, by a forward and a backward sweep through the separator tree.
+	MatrixXcd solve(const MatrixXcd &B)
+	{
+		if (!factorized)
+			factorize();
+
+		MatrixXcd X = B;
+		MatrixXcd part;
+
+		for (auto &index : postorder)
+		{
+			const Node &node = nodes[index];
+
+			if (node.pivots.empty())
+				continue;
+
+			part.resize(node.pivots.size(), X.cols());
+
+			for (std::size_t k = 0; k < node.pivots.size(); k++)
+				part.row(k) = X.row(node.pivots[k]);
+
+			const MatrixXcd correction = node.V * part;
+
+			for (std::size_t i = 0; i < node.boundary.size(); i++)
+				X.row(node.boundary[i]) -= correction.row(i);
+		}
+
+		for (auto index = postorder.rbegin(); index != postorder.rend(); ++index)
+		{
+			const Node &node = nodes[*index];
+
+			if (node.pivots.empty())
+				continue;
+
+			MatrixXcd boundary(node.boundary.size(), X.cols());
+
+			for (std::size_t i = 0; i < node.boundary.size(); i++)
+				boundary.row(i) = X.row(node.boundary[i]);
+
+			part.resize(node.pivots.size(), X.cols());
+
+			for (std::size_t k = 0; k < node.pivots.size(); k++)
+				part.row(k) = X.row(node.pivots[k]);
+
+			part = node.inverse * part - node.W * boundary;
+
+			for (std::size_t k = 0; k < node.pivots.size(); k++)
+				X.row(node.pivots[k]) = part.row(k);
+		}
+
+		return X;
+	}
+
+	// finds the elements of A^-1 on the pattern of the factors.
+	void selectedInversion()
+	{
+		if (!factorized)
+			factorize();
+
+		log() << "Preparing the selected inversion." << std::endl;
+
+		invert_subtree(root);
+
+		inverted = true;
+	}
+
+	VectorXcd inverseDiagonal()
+	{
+		if (!inverted)
+			selectedInversion();
+
+		VectorXcd result(n);
+
+		for (long i = 0; i < n; i++)
+			result[i] = stored_element(i, i);
+
+		return result;
+	}
+
+	// the block A^-1(rows, cols); columns with elements outside the pattern are solved for.
+	MatrixXcd inverseBlock(const std::vector<long> &rows, const std::vector<long> &cols)
+	{
+		if (!inverted)
+			selectedInversion();
+
+		MatrixXcd result(rows.size(), cols.size());
+
+		std::vector<long> missing;
+
+		for (std::size_t j = 0; j < cols.size(); j++)
+		{
+			bool found = true;
+
+			for (std::size_t i = 0; i < rows.size() && found; i++)
+				found = in_pattern(rows[i], cols[j]);
+
+			if (!found)
+			{
+				missing.push_back(j);
+				continue;
+			}
+
+			for (std::size_t i = 0; i < rows.size(); i++)
+				result(i, j) = stored_element(rows[i], cols[j]);
+		}
+
+		if (!missing.empty())
+		{
+			log() << missing.size() << " requested columns are outside the selected inverse and are solved for." << std::endl;
+
+			MatrixXcd unit = MatrixXcd::Zero(n, missing.size());
+
+			for (std::size_t k = 0; k < missing.size(); k++)
+				unit(cols[missing[k]], k) = 1.0;
+
+			const MatrixXcd columns = solve(unit);
+
+			for (std::size_t k = 0; k < missing.size(); k++)
+				for (std::size_t i = 0; i < rows.size(); i++)
+					result(i, missing[k]) = columns(rows[i], k);
+		}
+
+		return result;
+	}
+};
+
+LoggingObject SparseDirectSolver::log("LinearAlgebra::SparseDirectSolver", false);
+
+}
+
+}
+
+#endif
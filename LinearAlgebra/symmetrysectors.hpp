@@ -0,0 +1,278 @@
+/*
+Header file for QuantumMechanics::LinearAlgebra::SymmetrySectors: 
+
+This file splits a block matrix into its independent sectors, like the two spins without
+spin-orbit coupling or the two parities of a mirror symmetric device. The matrix is first
+rotated block by block into a given symmetry basis, U_i* M_ij U_j, and the sectors are then the
+connected components of the graph of its nonzero elements. A lead is split by the union of
+the graphs of its layer h and hopping v, such that a sector holds the same orbitals in every
+layer.
+
+Every sector keeps the block structure of the matrix, restricted to its orbitals, so the
+solvers run on each sector unchanged and independently, at a cost of the sum of b^3 instead of
+(sum of b)^3. Observables like transmissions are summed, while greens matrices are scattered
+back and rotated to the original basis by combine().
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _LINEARALGEBRA_SYMMETRYSECTORS_H_
+#define _LINEARALGEBRA_SYMMETRYSECTORS_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+
+#include <tbb/tbb.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace QuantumMechanics {
+
+namespace LinearAlgebra {
+
+class SymmetrySectors {
+
+	ArrayXi sizes;
+	ArrayXi offsets;
+
+	// the unitary of every block, or a single one shared by all blocks. None is the identity.
+	std::vector<MatrixXcd> basis;
+
+	// the orbitals of every sector in ascending order, in the symmetry basis.
+	std::vector<std::vector<long> > members;
+
+	static LoggingObject log;
+
+public:
+	SymmetrySectors(const BlockMatrixXcd &M, const std::vector<MatrixXcd> &unitaries = std::vector<MatrixXcd>(), const double &tolerance = 1e-12) :
+		basis(unitaries)
+	{
+		set_blocks(M);
+
+		const BlockMatrixXcd transformed = transform(M);
+
+		detect(std::vector<const MatrixXcd *>(1, &transformed), tolerance);
+	}
+
+	// the sectors of a lead, shared by its layer h and its hopping v.
+	SymmetrySectors(const BlockMatrixXcd &h, const BlockMatrixXcd &v, const std::vector<MatrixXcd> &unitaries = std::vector<MatrixXcd>(), const double &tolerance = 1e-12) :
+		basis(unitaries)
+	{
+		set_blocks(h);
+
+		const BlockMatrixXcd transformed_h = transform(h);
+		const BlockMatrixXcd transformed_v = transform(v);
+
+		std::vector<const MatrixXcd *> matrices;
+
+		matrices.push_back(&transformed_h);
+		matrices.push_back(&transformed_v);
+
+		detect(matrices, tolerance);
+	}
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+protected:
+	void set_blocks(const BlockMatrixXcd &M)
+	{
+		const long block_count = M.blockRows();
+
+		sizes.resize(block_count);
+		offsets.resize(block_count);
+
+		for (long b = 0, offset = 0; b < block_count; b++)
+		{
+			sizes[b] = M.block(b, b).rows();
+			offsets[b] = offset;
+			offset += sizes[b];
+		}
+	}
+
+	const MatrixXcd &unitary(const long &b) const {
+		return basis[basis.size() == 1 ? 0 : b];
+	}
+
+	static long root(std::vector<long> &parent, long i)
+	{
+		while (parent[i] != i)
+		{
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+
+		return i;
+	}
+
+	void detect(const std::vector<const MatrixXcd *> &matrices, const double &tolerance)
+	{
+		const long n = sizes.sum();
+
+		double largest = 0;
+
+		for (std::size_t m = 0; m < matrices.size(); m++)
+			if (matrices[m]->size() > 0)
+				largest = std::max(largest, matrices[m]->cwiseAbs().maxCoeff());
+
+		const double threshold = tolerance * largest;
+
+		std::vector<long> parent(n);
+
+		for (long i = 0; i < n; i++)
+			parent[i] = i;
+
+		for (std::size_t m = 0; m < matrices.size(); m++)
+			for (long j = 0; j < n; j++)
+				for (long i = 0; i < n; i++)
+					if (std::abs((*matrices[m])(i, j)) > threshold)
+						parent[root(parent, i)] = root(parent, j);
+
+		// the sectors are numbered by their first orbital.
+		std::map<long, long> numbers;
+
+		members.clear();
+
+		for (long i = 0; i < n; i++)
+		{
+			const long r = root(parent, i);
+
+			if (numbers.find(r) == numbers.end())
+			{
+				numbers[r] = members.size();
+				members.push_back(std::vector<long>());
+			}
+
+			members[numbers[r]].push_back(i);
+		}
+
+		log() << "The " << n << " orbitals split into " << members.size() << " sectors." << std::endl;
+	}
+
+public:
+	long sectorCount() const {
+		return members.size();
+	}
+
+	const std::vector<long> &orbitals(const long &s) const {
+		return members[s];
+	}
+
+	// the orbitals of sector s in every block, zero where the sector is absent.
+	ArrayXi sectorBlocks(const long &s) const
+	{
+		ArrayXi counts = ArrayXi::Zero(sizes.size());
+
+		for (std::size_t k = 0, b = 0; k < members[s].size(); k++)
+		{
+			while (members[s][k] >= offsets[b] + sizes[b])
+				b++;
+
+			counts[b]++;
+		}
+
+		return counts;
+	}
+
+	// U* A U, block by block.
+	BlockMatrixXcd transform(const BlockMatrixXcd &A) const
+	{
+		if (basis.empty())
+			return A;
+
+		BlockMatrixXcd result = A;
+
+		for (long j = 0; j < sizes.size(); j++)
+			for (long i = 0; i < sizes.size(); i++)
+				if (!A.block(i, j).isZero(0))
+					result.block(i, j) = unitary(i).adjoint() * A.block(i, j) * unitary(j);
+
+		return result;
+	}
+
+	// A in the symmetry basis restricted to sector s, without the blocks where s is absent.
+	BlockMatrixXcd sector(const BlockMatrixXcd &A, const long &s) const
+	{
+		const BlockMatrixXcd transformed = transform(A);
+		const std::vector<long> &index = members[s];
+
+		BlockMatrixXcd result = MatrixXcd(index.size(), index.size());
+
+		for (std::size_t j = 0; j < index.size(); j++)
+			for (std::size_t i = 0; i < index.size(); i++)
+				result(i, j) = transformed(index[i], index[j]);
+
+		const ArrayXi counts = sectorBlocks(s);
+
+		ArrayXi blocks((counts > 0).count());
+
+		for (long b = 0, k = 0; b < counts.size(); b++)
+			if (counts[b] > 0)
+				blocks[k++] = counts[b];
+
+		result.setBlocks(blocks);
+
+		return result;
+	}
+
+	// the diagonal blocks [first, first + count) in the original basis, from the same blocks of every sector.
+	MatrixXcd combine(const std::vector<MatrixXcd> &parts, const long &first, const long &count) const
+	{
+		const long begin = offsets[first];
+		const long end = offsets[first + count - 1] + sizes[first + count - 1];
+
+		MatrixXcd result = MatrixXcd::Zero(end - begin, end - begin);
+
+		for (std::size_t s = 0; s < members.size(); s++)
+		{
+			std::vector<long> index;
+
+			for (std::size_t k = 0; k < members[s].size(); k++)
+				if (members[s][k] >= begin && members[s][k] < end)
+					index.push_back(members[s][k] - begin);
+
+			for (std::size_t j = 0; j < index.size(); j++)
+				for (std::size_t i = 0; i < index.size(); i++)
+					result(index[i], index[j]) = parts[s](i, j);
+		}
+
+		if (basis.empty())
+			return result;
+
+		for (long j = first; j < first + count; j++)
+			for (long i = first; i < first + count; i++)
+			{
+				const long row = offsets[i] - begin, col = offsets[j] - begin;
+
+				result.block(row, col, sizes[i], sizes[j]) = unitary(i) * result.block(row, col, sizes[i], sizes[j]) * unitary(j).adjoint();
+			}
+
+		return result;
+	}
+
+	MatrixXcd combine(const std::vector<MatrixXcd> &parts) const
+	{
+		return combine(parts, 0, sizes.size());
+	}
+
+	// f(s) for every sector, in parallel.
+	template<class Function>
+	void forEach(const Function &f) const
+	{
+		tbb::parallel_for(0L, sectorCount(), [&](const long &s) {
+			f(s);
+		});
+	}
+};
+
+LoggingObject SymmetrySectors::log("LinearAlgebra::SymmetrySectors", false);
+
+}
+
+}
+
+#endif
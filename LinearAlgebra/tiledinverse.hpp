@@ -0,0 +1,64 @@
+/*
+Header file for QuantumMechanics::LinearAlgebra::TiledInverse: 
+
+This file provides a drop-in replacement for MatrixXcd::inverse() based on the in-memory
+TiledLU, and a switch between it and the vendor inverse for the dense inversions of the
+solvers. The tiled inverse scales with the TBB task graph rather than with the threading
+of the vendor BLAS, and matrices of a single tile are left to the vendor inverse. The tiled
+LU pivots like the dense LU, and a singular matrix falls back to the vendor inverse, such that
+both backends give the same result for it.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _LINEARALGEBRA_TILEDINVERSE_H_
+#define _LINEARALGEBRA_TILEDINVERSE_H_
+
+#include <Math/Dense>
+#include "TiledMatrix"
+#include "TiledLU"
+
+namespace QuantumMechanics {
+
+namespace LinearAlgebra {
+
+	enum InversionBackend {
+		VendorInversion,
+		TiledInversion
+	};
+
+	inline MatrixXcd tiledInverse(const MatrixXcd &M, const long &tile_size = 128)
+	{
+		if (M.rows() <= tile_size)
+			return M.inverse();
+
+		TiledMatrix A(M.rows(), tile_size);
+		TiledMatrix result(M.rows(), tile_size);
+
+		A.setFrom(M);
+
+		TiledLU lu(A);
+
+		lu.factorize();
+
+		if (lu.isSingular())
+			return M.inverse();
+
+		lu.inverse(result);
+
+		return result.matrix();
+	}
+
+	inline MatrixXcd inverse(const MatrixXcd &M, const InversionBackend &backend, const long &tile_size = 128)
+	{
+		if (backend == TiledInversion)
+			return tiledInverse(M, tile_size);
+
+		return M.inverse();
+	}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,356 @@
+/*
+Header file for QuantumMechanics::LinearAlgebra::TiledLU: 
+
+This file factorizes a TiledMatrix in place and inverts it tile by tile. The factorization
+is a right-looking tile LU scheduled as a TBB flow graph, in which every tile operation
+(factorization of a panel, the row interchanges and triangular solve of a tile to its right
+and the trailing update) is a node that starts as soon as the tiles it reads are final. When
+a panel is factorized, the tiles of the next panel are prefetched from the scratch file.
+
+The pivots are searched in the whole tile column below the diagonal, i.e. the partial
+pivoting of a dense LU with P A = L U, which is needed for matrices like E - H at energies
+inside a band and without broadening. The panel is factorized in memory, which takes n times
+the tile size of memory. The interchanges are applied to the tiles to the right of a panel
+before they are updated, and to the factors to its left once the factorization is done, such
+that the updates never wait for them. The inverse U^-1 L^-1 is found column by column and the
+columns are interchanged at the end.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _LINEARALGEBRA_TILEDLU_H_
+#define _LINEARALGEBRA_TILEDLU_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+#include "TiledMatrix"
+
+#include <tbb/tbb.h>
+#include <tbb/flow_graph.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace QuantumMechanics {
+
+namespace LinearAlgebra {
+
+// keeps the vendor BLAS of the calling thread single threaded while in scope.
+class SequentialBlas {
+
+#ifdef EIGEN_USE_MKL
+	int previous;
+
+public:
+	SequentialBlas() : previous(mkl_set_num_threads_local(1)) { }
+
+	~SequentialBlas()
+	{
+		mkl_set_num_threads_local(previous);
+	}
+#else
+public:
+	SequentialBlas() { }
+#endif
+};
+
+class TiledLU {
+
+	typedef tbb::flow::continue_node<tbb::flow::continue_msg> TaskNode;
+
+	TiledMatrix &A;
+
+	// the row interchanges of every panel, relative to its first row, in the order of LAPACK.
+	std::vector<std::vector<long> > swaps;
+
+	bool factorized;
+	std::atomic<bool> singular;
+
+	static LoggingObject log;
+
+public:
+	TiledLU(TiledMatrix &matrix) : A(matrix), swaps(matrix.tileCount()), factorized(false), singular(false) { }
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+	bool isFactorized() const {
+		return factorized;
+	}
+
+	// true if a pivot was exactly zero, i.e. the matrix is singular and the factors are useless.
+	bool isSingular() const {
+		return singular;
+	}
+
+protected:
+	// the LU with partial pivoting of a tall panel in blocks of columns, like LAPACK getrf, such
+	// that most of the work is in the products. Returns false if a pivot is zero.
+	static bool factorize_panel(MatrixXcd &P, std::vector<long> &interchanges)
+	{
+		const long h = P.rows(), w = P.cols();
+		const long width = 32;
+
+		bool regular = true;
+
+		interchanges.resize(w);
+
+		for (long j0 = 0; j0 < w; j0 += width)
+		{
+			const long b = std::min(width, w - j0);
+
+			for (long j = j0; j < j0 + b; j++)
+			{
+				long p;
+
+				P.col(j).tail(h - j).cwiseAbs2().maxCoeff(&p);
+				p += j;
+
+				interchanges[j] = p;
+
+				if (p != j)
+					P.row(j).swap(P.row(p));
+
+				if (P(j, j) == std::complex<double>(0))
+				{
+					regular = false;
+					continue;
+				}
+
+				P.col(j).tail(h - j - 1) /= P(j, j);
+				P.block(j + 1, j + 1, h - j - 1, j0 + b - j - 1).noalias() -= P.col(j).tail(h - j - 1) * P.row(j).segment(j + 1, j0 + b - j - 1);
+			}
+
+			if (j0 + b < w)
+			{
+				P.block(j0, j0, b, b).triangularView<UnitLower>().solveInPlace(P.block(j0, j0 + b, b, w - j0 - b));
+				P.block(j0 + b, j0 + b, h - j0 - b, w - j0 - b).noalias() -= P.block(j0 + b, j0, h - j0 - b, b) * P.block(j0, j0 + b, b, w - j0 - b);
+			}
+		}
+
+		return regular;
+	}
+
+	// the tile column k from the diagonal down is factorized as one panel.
+	void factorize_panel(const long &k)
+	{
+		SequentialBlas sequential;
+
+		const long T = A.tileCount(), first = k * A.tileSize();
+
+		MatrixXcd panel(A.size() - first, A.tileRows(k));
+
+		for (long i = k; i < T; i++)
+			panel.middleRows((i - k) * A.tileSize(), A.tileRows(i)) = A(i, k);
+
+		if (!factorize_panel(panel, swaps[k]))
+			singular = true;
+
+		for (long i = k; i < T; i++)
+			A(i, k) = panel.middleRows((i - k) * A.tileSize(), A.tileRows(i));
+
+		// the next panel is on the critical path, so it is read ahead while the updates run.
+		for (long i = k + 1; i < T; i++)
+		{
+			A.prefetch(i, k + 1);
+			A.prefetch(k + 1, i);
+		}
+	}
+
+	// applies the interchanges of panel k to the rows of tile column j, from the panel down.
+	void interchange_rows(const long &k, const long &j)
+	{
+		const long tile = A.tileSize(), first = k * tile;
+
+		for (std::size_t r = 0; r < swaps[k].size(); r++)
+		{
+			const long a = first + r, b = first + swaps[k][r];
+
+			if (a != b)
+				A(a / tile, j).row(a % tile).swap(A(b / tile, j).row(b % tile));
+		}
+	}
+
+	void solve_row(const long &k, const long &m)
+	{
+		SequentialBlas sequential;
+
+		interchange_rows(k, m);
+
+		MatrixXcd tile = A(k, m);
+
+		A(k, k).triangularView<UnitLower>().solveInPlace(tile);
+
+		A(k, m) = tile;
+	}
+
+	void update(const long &i, const long &m, const long &k)
+	{
+		SequentialBlas sequential;
+
+		A(i, m).noalias() -= A(i, k) * A(k, m);
+	}
+
+public:
+	void factorize()
+	{
+		using namespace tbb::flow;
+
+		const long T = A.tileCount();
+
+		log() << "Preparing the task graph of a " << T << "-by-" << T << " tile LU." << std::endl;
+
+		graph dag;
+
+		std::vector<std::unique_ptr<TaskNode> > panels(T);
+		std::vector<std::unique_ptr<TaskNode> > rows(T * T);
+		std::vector<std::unique_ptr<TaskNode> > updates(T * T * T);
+
+		auto update_node = [&](const long &i, const long &m, const long &k) -> TaskNode & {
+			return *updates[(k * T + i) * T + m];
+		};
+
+		for (long k = 0; k < T; k++)
+		{
+			panels[k].reset(new TaskNode(dag, [this, k](const continue_msg &) { factorize_panel(k); }));
+
+			for (long m = k + 1; m < T; m++)
+				rows[k * T + m].reset(new TaskNode(dag, [this, k, m](const continue_msg &) { solve_row(k, m); }));
+
+			for (long i = k + 1; i < T; i++)
+				for (long m = k + 1; m < T; m++)
+					updates[(k * T + i) * T + m].reset(new TaskNode(dag, [this, i, m, k](const continue_msg &) { update(i, m, k); }));
+		}
+
+		for (long k = 0; k < T; k++)
+		{
+			// a panel and the interchanges of a tile column need the whole column updated.
+			if (k > 0)
+				for (long i = k; i < T; i++)
+				{
+					make_edge(update_node(i, k, k - 1), *panels[k]);
+
+					for (long m = k + 1; m < T; m++)
+						make_edge(update_node(i, m, k - 1), *rows[k * T + m]);
+				}
+
+			for (long m = k + 1; m < T; m++)
+				make_edge(*panels[k], *rows[k * T + m]);
+
+			for (long i = k + 1; i < T; i++)
+				for (long m = k + 1; m < T; m++)
+				{
+					make_edge(*panels[k], update_node(i, m, k));
+					make_edge(*rows[k * T + m], update_node(i, m, k));
+				}
+		}
+
+		singular = false;
+
+		panels[0]->try_put(continue_msg());
+		dag.wait_for_all();
+
+		// the factors left of every panel get its interchanges last, column by column.
+		tbb::parallel_for(0L, T, [&](const long &j) {
+			for (long k = j + 1; k < T; k++)
+				interchange_rows(k, j);
+		});
+
+		factorized = true;
+
+		log() << "The tile LU is finished" << (singular ? ", but the matrix is singular." : ".") << std::endl;
+	}
+
+protected:
+	// solves for the tile column c of (L U)^-1, using the tile column of result as storage.
+	void invert_column(TiledMatrix &result, const long &c) const
+	{
+		SequentialBlas sequential;
+
+		const long T = A.tileCount();
+
+		for (long k = 0; k < c; k++)
+			result(k, c).setZero();
+
+		// forward substitution, the right hand side is the tile column c of the identity.
+		for (long k = c; k < T; k++)
+		{
+			if (k + 1 < T)
+				for (long j = c; j <= k + 1; j++)
+					A.prefetch(k + 1, j);
+
+			MatrixXcd rhs;
+
+			if (k == c)
+				rhs = MatrixXcd::Identity(A.tileRows(k), A.tileRows(c));
+			else
+			{
+				rhs = MatrixXcd::Zero(A.tileRows(k), A.tileRows(c));
+
+				for (long j = c; j < k; j++)
+					rhs.noalias() -= A(k, j) * result(j, c);
+			}
+
+			A(k, k).triangularView<UnitLower>().solveInPlace(rhs);
+
+			result(k, c) = rhs;
+		}
+
+		// backward substitution.
+		for (long k = T - 1; k >= 0; k--)
+		{
+			if (k > 0)
+				for (long j = k - 1; j < T; j++)
+					A.prefetch(k - 1, j);
+
+			MatrixXcd rhs = result(k, c);
+
+			for (long j = k + 1; j < T; j++)
+				rhs.noalias() -= A(k, j) * result(j, c);
+
+			A(k, k).triangularView<Upper>().solveInPlace(rhs);
+
+			result(k, c) = rhs;
+		}
+	}
+
+public:
+	// writes the inverse into result, which must have the same size and tiling.
+	void inverse(TiledMatrix &result)
+	{
+		if (!factorized)
+			factorize();
+
+		log() << "Inverting the " << A.tileCount() << " tile columns." << std::endl;
+
+		const long T = A.tileCount(), tile = A.tileSize();
+
+		tbb::parallel_for(0L, T, [&](const long &c) {
+			invert_column(result, c);
+		});
+
+		// A^-1 = (L U)^-1 P, i.e. the interchanges are applied to the columns in reverse order.
+		tbb::parallel_for(0L, T, [&](const long &i) {
+			for (long k = T - 1; k >= 0; k--)
+				for (long r = (long) swaps[k].size() - 1; r >= 0; r--)
+				{
+					const long a = k * tile + r, b = k * tile + swaps[k][r];
+
+					if (a != b)
+						result(i, a / tile).col(a % tile).swap(result(i, b / tile).col(b % tile));
+				}
+		});
+	}
+};
+
+LoggingObject TiledLU::log("LinearAlgebra::TiledLU", false);
+
+}
+
+}
+
+#endif
@@ -0,0 +1,203 @@
+/*
+Header file for QuantumMechanics::LinearAlgebra::TiledMatrix: 
+
+This file stores a square complex matrix as a grid of square tiles, either in memory or in
+a memory-mapped scratch file, such that matrices larger than the physical memory can be
+worked on tile by tile. Each tile is stored contiguously in column major order, and the last
+tile row and column may be smaller than the others. The scratch file is removed as soon as
+it is mapped.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _LINEARALGEBRA_TILEDMATRIX_H_
+#define _LINEARALGEBRA_TILEDMATRIX_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace QuantumMechanics {
+
+namespace LinearAlgebra {
+
+class TiledMatrix {
+
+	typedef std::complex<double> Scalar;
+
+	long n;
+	long tile;
+	long tiles;
+
+	Scalar *data;
+	std::size_t bytes;
+
+	// the storage of in-memory tiles, empty when the tiles are mapped.
+	std::vector<Scalar> memory;
+
+	static LoggingObject log;
+
+	TiledMatrix(const TiledMatrix &);
+	TiledMatrix &operator=(const TiledMatrix &);
+
+public:
+	// the tiles are kept in memory.
+	TiledMatrix(const long &size, const long &tile_size) :
+		n(size),
+		tile(std::max(1L, std::min(tile_size, size))),
+		tiles((size + tile - 1) / tile),
+		data(nullptr),
+		bytes(std::size_t(tiles) * tiles * tile * tile * sizeof(Scalar)),
+		memory(std::size_t(tiles) * tiles * tile * tile)
+	{
+		if (bytes != 0)
+			data = memory.data();
+	}
+
+	// the scratch file is created in the directory, or in TMPDIR (or /tmp) when empty.
+	TiledMatrix(const long &size, const long &tile_size, const std::string &scratch_directory) :
+		n(size),
+		tile(std::max(1L, std::min(tile_size, size))),
+		tiles((size + tile - 1) / tile),
+		data(nullptr),
+		bytes(std::size_t(tiles) * tiles * tile * tile * sizeof(Scalar))
+	{
+		if (bytes == 0)
+			return;
+
+		std::string directory = scratch_directory;
+
+		if (directory.empty())
+			directory = (std::getenv("TMPDIR") != nullptr ? std::getenv("TMPDIR") : "/tmp");
+
+		std::string path = directory + "/qm_tiles_XXXXXX";
+
+		const int fd = mkstemp(&path[0]);
+
+		if (fd < 0)
+		{
+			log() << "Could not create a scratch file in " << directory << "." << std::endl;
+			return;
+		}
+
+		unlink(path.c_str());
+
+		if (ftruncate(fd, bytes) == 0)
+		{
+			void *mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+			if (mapping != MAP_FAILED)
+				data = static_cast<Scalar *>(mapping);
+		}
+
+		close(fd);
+
+		if (data == nullptr)
+			log() << "Could not map a scratch file of " << bytes << " bytes." << std::endl;
+		else
+			log() << "Mapped " << tiles << "-by-" << tiles << " tiles of size " << tile << " in " << directory << "." << std::endl;
+	}
+
+	~TiledMatrix()
+	{
+		if (data != nullptr && memory.empty())
+			munmap(data, bytes);
+	}
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+	bool valid() const {
+		return data != nullptr;
+	}
+
+	bool isMapped() const {
+		return valid() && memory.empty();
+	}
+
+	long size() const {
+		return n;
+	}
+
+	long tileSize() const {
+		return tile;
+	}
+
+	long tileCount() const {
+		return tiles;
+	}
+
+	// the rows of tile row i (equal to the columns of tile column i).
+	long tileRows(const long &i) const {
+		return (i + 1 < tiles ? tile : n - (tiles - 1) * tile);
+	}
+
+	Map<MatrixXcd> operator()(const long &i, const long &j) {
+		return Map<MatrixXcd>(data + (std::size_t(j) * tiles + i) * tile * tile, tileRows(i), tileRows(j));
+	}
+
+	Map<const MatrixXcd> operator()(const long &i, const long &j) const {
+		return Map<const MatrixXcd>(data + (std::size_t(j) * tiles + i) * tile * tile, tileRows(i), tileRows(j));
+	}
+
+	// asks the kernel to read the tile ahead of its use.
+	void prefetch(const long &i, const long &j) const
+	{
+		if (isMapped())
+			madvise(data + (std::size_t(j) * tiles + i) * tile * tile, tile * tile * sizeof(Scalar), MADV_WILLNEED);
+	}
+
+	void setFrom(const MatrixXcd &M)
+	{
+		for (long j = 0; j < tiles; j++)
+			for (long i = 0; i < tiles; i++)
+				(*this)(i, j) = M.block(i * tile, j * tile, tileRows(i), tileRows(j));
+	}
+
+	// fills every tile from a generator, such that the full matrix never needs to be in memory.
+	void setFrom(const std::function<void(const long &row, const long &col, Map<MatrixXcd> tile_matrix)> &generator)
+	{
+		for (long j = 0; j < tiles; j++)
+			for (long i = 0; i < tiles; i++)
+				generator(i * tile, j * tile, (*this)(i, j));
+	}
+
+	MatrixXcd block(const long &row, const long &col, const long &rows, const long &cols) const
+	{
+		MatrixXcd result(rows, cols);
+
+		for (long j = col / tile; j * tile < col + cols; j++)
+			for (long i = row / tile; i * tile < row + rows; i++)
+			{
+				const long r0 = std::max(row, i * tile), r1 = std::min(row + rows, i * tile + tileRows(i));
+				const long c0 = std::max(col, j * tile), c1 = std::min(col + cols, j * tile + tileRows(j));
+
+				result.block(r0 - row, c0 - col, r1 - r0, c1 - c0) = (*this)(i, j).block(r0 - i * tile, c0 - j * tile, r1 - r0, c1 - c0);
+			}
+
+		return result;
+	}
+
+	MatrixXcd matrix() const {
+		return block(0, 0, n, n);
+	}
+};
+
+LoggingObject TiledMatrix::log("LinearAlgebra::TiledMatrix", false);
+
+}
+
+}
+
+#endif
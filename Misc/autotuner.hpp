@@ -0,0 +1,264 @@
+/*
+Header file for QuantumMechanics::AutoTuner:
+
+This file micro-benchmarks candidate configurations of a calculation and remembers the
+fastest one per machine and problem signature in a small tuning file, such that later runs
+with the same signature on the same machine reuse the winner without benchmarking.
+
+The tuning file is a text file with one tab separated line per entry, holding the key, the
+winning configuration and its time in seconds. It is given by the QM_TUNING_FILE environment
+variable, or defaults to ~/.quantummechanics_tuning.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+*/
+#ifndef _AUTOTUNER_H_
+#define _AUTOTUNER_H_
+
+#include <Math/Dense>
+#include "LoggingObject"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+namespace QuantumMechanics {
+
+class AutoTuner {
+
+	struct Entry {
+		std::string winner;
+		double seconds;
+	};
+
+	std::string file_path;
+	std::map<std::string, Entry> entries;
+
+	std::mutex entries_mutex;
+
+	static LoggingObject log;
+
+public:
+	typedef std::vector<std::pair<std::string, std::function<void()> > > CandidateList;
+
+	// timed runs per candidate after one untimed warm-up run; the fastest run counts.
+	long repetitions;
+	bool warm_up;
+
+	AutoTuner(const std::string &path = defaultPath()) : file_path(path), entries(), repetitions(3), warm_up(true)
+	{
+		load();
+	}
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+	static std::string defaultPath()
+	{
+		if (const char *path = std::getenv("QM_TUNING_FILE"))
+			return path;
+
+		if (const char *home = std::getenv("HOME"))
+			return std::string(home) + "/.quantummechanics_tuning";
+
+		return ".quantummechanics_tuning";
+	}
+
+	// the host name, the core count and the cpu model; winners never travel between machines.
+	static std::string machineSignature()
+	{
+		char host[256] = { 0 };
+		gethostname(host, sizeof(host) - 1);
+
+		std::string model = "unknown";
+		std::ifstream cpuinfo("/proc/cpuinfo");
+		std::string line;
+
+		while (std::getline(cpuinfo, line))
+			if (line.compare(0, 10, "model name") == 0)
+			{
+				model = line.substr(line.find(':') + 2);
+				break;
+			}
+
+		std::ostringstream signature;
+		signature << host << "/" << std::thread::hardware_concurrency() << "/" << model;
+
+		return signature.str();
+	}
+
+	// a histogram of the block sizes, e.g. "blocks:2x3,3x2".
+	static std::string problemSignature(const ArrayXi &block_sizes)
+	{
+		std::map<int, long> histogram;
+
+		for (long b = 0; b < block_sizes.size(); b++)
+			histogram[block_sizes[b]]++;
+
+		std::ostringstream signature;
+		signature << "blocks:";
+
+		for (auto it = histogram.begin(); it != histogram.end(); ++it)
+			signature << (it == histogram.begin() ? "" : ",") << it->first << "x" << it->second;
+
+		return signature.str();
+	}
+
+	void load()
+	{
+		std::lock_guard<std::mutex> lock(entries_mutex);
+
+		read_file(entries);
+	}
+
+protected:
+	void read_file(std::map<std::string, Entry> &into) const
+	{
+		std::ifstream file(file_path);
+		std::string line;
+
+		while (std::getline(file, line))
+		{
+			const std::size_t first = line.find('\t');
+			const std::size_t second = line.find('\t', first + 1);
+
+			if (first == std::string::npos || second == std::string::npos)
+				continue;
+
+			Entry entry;
+			entry.winner = line.substr(first + 1, second - first - 1);
+			entry.seconds = std::atof(line.substr(second + 1).c_str());
+
+			into[line.substr(0, first)] = entry;
+		}
+	}
+
+	// merges with entries other processes wrote meanwhile, and replaces the file atomically.
+	bool save()
+	{
+		std::map<std::string, Entry> merged;
+
+		read_file(merged);
+
+		for (auto &entry : entries)
+			merged[entry.first] = entry.second;
+
+		const std::string temporary = file_path + ".tmp" + std::to_string(getpid());
+
+		{
+			std::ofstream file(temporary);
+
+			for (auto &entry : merged)
+				file << entry.first << "\t" << entry.second.winner << "\t" << entry.second.seconds << "\n";
+
+			if (!file)
+				return false;
+		}
+
+		entries = merged;
+
+		return std::rename(temporary.c_str(), file_path.c_str()) == 0;
+	}
+
+	double time_candidate(const std::function<void()> &run) const
+	{
+		if (warm_up)
+			run();
+
+		double best = std::numeric_limits<double>::infinity();
+
+		for (long r = 0; r < std::max(1L, repetitions); r++)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			run();
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+			best = std::min(best, elapsed.count());
+		}
+
+		return best;
+	}
+
+public:
+	// returns the stored winner if it is among the candidates, otherwise benchmarks all of them.
+	std::string tune(const std::string &problem, const CandidateList &candidates, const bool &retune = false)
+	{
+		if (candidates.empty())
+			return std::string();
+
+		const std::string key = machineSignature() + "|" + problem;
+
+		if (!retune)
+		{
+			std::lock_guard<std::mutex> lock(entries_mutex);
+
+			auto found = entries.find(key);
+
+			if (found != entries.end())
+				for (auto &candidate : candidates)
+					if (candidate.first == found->second.winner)
+						return candidate.first;
+		}
+
+		log() << "Tuning " << candidates.size() << " candidates for " << problem << "." << std::endl;
+
+		Entry best = { candidates[0].first, std::numeric_limits<double>::infinity() };
+
+		for (auto &candidate : candidates)
+		{
+			const double seconds = time_candidate(candidate.second);
+
+			log() << "Candidate " << candidate.first << " took " << seconds << " s." << std::endl;
+
+			if (seconds < best.seconds)
+			{
+				best.winner = candidate.first;
+				best.seconds = seconds;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(entries_mutex);
+
+		entries[key] = best;
+
+		if (!save())
+			log() << "The tuning file " << file_path << " could not be written." << std::endl;
+
+		return best.winner;
+	}
+
+	// the stored winner, or an empty string.
+	std::string lookup(const std::string &problem)
+	{
+		std::lock_guard<std::mutex> lock(entries_mutex);
+
+		auto found = entries.find(machineSignature() + "|" + problem);
+
+		return found == entries.end() ? std::string() : found->second.winner;
+	}
+
+	const std::string &path() const {
+		return file_path;
+	}
+};
+
+LoggingObject AutoTuner::log("AutoTuner", false);
+
+};
+
+#endif //namespace _AUTOTUNER_H_
@@ -0,0 +1,384 @@
+/*
+Header file for QuantumMechanics::NumaTopology:
+
+This file reads the NUMA nodes and their cores from sysfs and pins processes or threads to
+them. Nodes are numbered densely in the order of their kernel ids, which need not be
+contiguous, and nodes with memory but no cores are kept for the placement of memory. On
+systems without NUMA information all cores are reported as a single node.
+
+Large matrices can be placed with a NumaPolicy before they are first touched: interleaved
+page by page over all nodes, or partitioned in contiguous column ranges, one per node.
+NumaLocal prefers the node of the calling thread for matrices of any size, meant for the
+workspaces of a solver running inside an energy-parallel loop. The NumaThreadPinning observer
+pins the TBB workers to cores, such that these workspaces stay on the node of their worker.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+*/
+#ifndef _NUMATOPOLOGY_H_
+#define _NUMATOPOLOGY_H_
+
+#include <Math/Dense>
+
+#include <tbb/tbb.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace QuantumMechanics {
+
+	enum NumaPolicy {
+		NumaFirstTouch,
+		NumaInterleave,
+		NumaPartition,
+		NumaLocal
+	};
+
+class NumaTopology {
+
+	// the kernel id and the cores of every node.
+	std::vector<long> node_ids;
+	std::vector<std::vector<int> > node_cpus;
+
+public:
+	NumaTopology(const std::string &sysfs_nodes = "/sys/devices/system/node") : node_ids(), node_cpus()
+	{
+		if (DIR *directory = ::opendir(sysfs_nodes.c_str()))
+		{
+			while (const dirent *entry = ::readdir(directory))
+			{
+				const std::string name = entry->d_name;
+
+				if (name.size() > 4 && name.compare(0, 4, "node") == 0 && name.find_first_not_of("0123456789", 4) == std::string::npos)
+					node_ids.push_back(std::atol(name.c_str() + 4));
+			}
+
+			::closedir(directory);
+		}
+
+		std::sort(node_ids.begin(), node_ids.end());
+
+		for (long id : node_ids)
+		{
+			std::ifstream list(sysfs_nodes + "/node" + std::to_string(id) + "/cpulist");
+			std::string ranges;
+
+			std::getline(list, ranges);
+
+			node_cpus.push_back(parse_cpu_list(ranges));
+		}
+
+		if (cpuCount() == 0)
+		{
+			const int count = std::max(1u, std::thread::hardware_concurrency());
+
+			node_ids.assign(1, 0);
+			node_cpus.assign(1, std::vector<int>());
+
+			for (int cpu = 0; cpu < count; cpu++)
+				node_cpus[0].push_back(cpu);
+		}
+	}
+
+	// parses the sysfs format, e.g. "0-3,8-11".
+	static std::vector<int> parse_cpu_list(const std::string &ranges)
+	{
+		std::vector<int> cpus;
+		std::istringstream items(ranges);
+		std::string item;
+
+		while (std::getline(items, item, ','))
+		{
+			if (item.find_first_of("0123456789") == std::string::npos)
+				continue;
+
+			const std::size_t dash = item.find('-');
+			const int first = std::stoi(item.substr(0, dash));
+			const int last = (dash == std::string::npos ? first : std::stoi(item.substr(dash + 1)));
+
+			for (int cpu = first; cpu <= last; cpu++)
+				cpus.push_back(cpu);
+		}
+
+		return cpus;
+	}
+
+	long nodeCount() const {
+		return (long) node_cpus.size();
+	}
+
+	long cpuCount() const {
+		long count = 0;
+
+		for (auto &cpus : node_cpus)
+			count += (long) cpus.size();
+
+		return count;
+	}
+
+	const std::vector<int> &nodeCpus(const long &node) const {
+		return node_cpus[node % node_cpus.size()];
+	}
+
+	// the kernel id of a node, as used by mbind.
+	long nodeId(const long &node) const {
+		return node_ids[node % node_ids.size()];
+	}
+
+	// the nodes with cores, in order.
+	std::vector<long> cpuNodes() const
+	{
+		std::vector<long> nodes;
+
+		for (std::size_t node = 0; node < node_cpus.size(); node++)
+			if (!node_cpus[node].empty())
+				nodes.push_back((long) node);
+
+		return nodes;
+	}
+
+	// restricts the calling thread (and the threads it creates afterwards) to the cores of the node.
+	bool pinToNode(const long &node) const
+	{
+		if (nodeCpus(node).empty())
+			return false;
+
+		cpu_set_t set;
+		CPU_ZERO(&set);
+
+		for (int cpu : nodeCpus(node))
+			CPU_SET(cpu, &set);
+
+		return sched_setaffinity(0, sizeof(set), &set) == 0;
+	}
+
+	bool pinToCpu(const int &cpu) const
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+
+		return sched_setaffinity(0, sizeof(set), &set) == 0;
+	}
+
+	// the node owning the core the calling thread currently runs on.
+	long currentNode() const
+	{
+		const int cpu = sched_getcpu();
+
+		for (std::size_t node = 0; node < node_cpus.size(); node++)
+			for (int c : node_cpus[node])
+				if (c == cpu)
+					return (long) node;
+
+		return 0;
+	}
+
+	// matrices below this size are left to the first-touch default.
+	static const std::size_t large_allocation_bytes = std::size_t(64) << 20;
+
+protected:
+	// the mempolicy modes of the kernel (see numaif.h).
+	enum { mpol_preferred = 1, mpol_bind = 2, mpol_interleave = 3 };
+
+	// only whole pages inside the range are bound, the ragged ends keep the default policy.
+	bool bind_range(const void *start, const std::size_t &bytes, const int &mode, const std::vector<long> &nodes) const
+	{
+		const std::uintptr_t page = (std::uintptr_t) sysconf(_SC_PAGESIZE);
+		const std::uintptr_t first = (reinterpret_cast<std::uintptr_t>(start) + page - 1) / page * page;
+		const std::uintptr_t last = (reinterpret_cast<std::uintptr_t>(start) + bytes) / page * page;
+
+		if (last <= first || nodes.empty())
+			return true;
+
+		std::vector<long> ids;
+
+		for (long node : nodes)
+			ids.push_back(nodeId(node));
+
+		const long bits = 8 * sizeof(unsigned long);
+		std::vector<unsigned long> mask(*std::max_element(ids.begin(), ids.end()) / bits + 1, 0);
+
+		for (long id : ids)
+			mask[id / bits] |= 1UL << (id % bits);
+
+		return syscall(SYS_mbind, first, last - first, mode, mask.data(), mask.size() * bits + 1, 0) == 0;
+	}
+
+public:
+	// binds the memory of a not yet touched allocation according to the policy.
+	bool bindMemory(const void *data, const std::size_t &bytes, const NumaPolicy &policy) const
+	{
+		if (policy == NumaFirstTouch || nodeCount() < 2)
+			return true;
+
+		if (policy == NumaLocal)
+			return bind_range(data, bytes, mpol_preferred, std::vector<long>(1, currentNode()));
+
+		if (bytes < large_allocation_bytes)
+			return true;
+
+		std::vector<long> all;
+
+		for (long node = 0; node < nodeCount(); node++)
+			all.push_back(node);
+
+		if (policy == NumaInterleave)
+			return bind_range(data, bytes, mpol_interleave, all);
+
+		bool bound = true;
+		const std::size_t share = bytes / nodeCount();
+
+		for (long node = 0; node < nodeCount(); node++)
+			bound = bind_range(static_cast<const char *>(data) + node * share, (node + 1 == nodeCount() ? bytes - node * share : share), mpol_bind, std::vector<long>(1, node)) && bound;
+
+		return bound;
+	}
+
+	// sizes the matrix and places its (fresh) storage according to the policy. For column major
+	// storage, NumaPartition gives each node a contiguous range of columns.
+	bool prepare(MatrixXcd &matrix, const long &rows, const long &cols, const NumaPolicy &policy) const
+	{
+		if (matrix.rows() != rows || matrix.cols() != cols)
+		{
+			// a resize to zero first forces a fresh, untouched allocation.
+			matrix.resize(0, 0);
+			matrix.resize(rows, cols);
+		}
+
+		return bindMemory(matrix.data(), matrix.size() * sizeof(MatrixXcd::Scalar), policy);
+	}
+};
+
+/*
+Pins every TBB worker entering an arena to its own core, and restores the affinity the worker
+had before when it leaves the arena again, or at the latest when the observer is destroyed.
+Cores are handed out node by node (compact) or alternating between nodes (scatter), and a
+worker keeps its core when it enters again. Given a task arena, only the workers of that arena
+are pinned, otherwise those of every arena. Every observer remembers the threads it pinned, so
+several observers pin independently.
+*/
+class NumaThreadPinning : public tbb::task_scheduler_observer {
+
+	struct Pin {
+		pid_t tid;
+		int cpu;
+		bool active;
+		cpu_set_t original;
+	};
+
+	NumaTopology topology;
+	std::vector<int> cpu_order;
+	std::atomic<long> next_slot;
+
+	std::map<std::thread::id, Pin> pins;
+	std::mutex pins_mutex;
+
+	void order_cpus(const bool &scatter)
+	{
+		if (scatter)
+		{
+			for (std::size_t index = 0; (long) cpu_order.size() < topology.cpuCount(); index++)
+				for (long node = 0; node < topology.nodeCount(); node++)
+					if (index < topology.nodeCpus(node).size())
+						cpu_order.push_back(topology.nodeCpus(node)[index]);
+		}
+		else
+		{
+			for (long node = 0; node < topology.nodeCount(); node++)
+				cpu_order.insert(cpu_order.end(), topology.nodeCpus(node).begin(), topology.nodeCpus(node).end());
+		}
+	}
+
+public:
+	NumaThreadPinning(const bool &scatter = false) : tbb::task_scheduler_observer(), topology(), cpu_order(), next_slot(0), pins(), pins_mutex()
+	{
+		order_cpus(scatter);
+		observe(true);
+	}
+
+	NumaThreadPinning(tbb::task_arena &arena, const bool &scatter = false) : tbb::task_scheduler_observer(arena), topology(), cpu_order(), next_slot(0), pins(), pins_mutex()
+	{
+		order_cpus(scatter);
+		observe(true);
+	}
+
+	// the workers still inside an arena are restored by their thread ids.
+	~NumaThreadPinning()
+	{
+		observe(false);
+
+		std::lock_guard<std::mutex> lock(pins_mutex);
+
+		for (auto &pin : pins)
+			if (pin.second.active)
+				sched_setaffinity(pin.second.tid, sizeof(cpu_set_t), &pin.second.original);
+	}
+
+	void on_scheduler_entry(bool is_worker)
+	{
+		if (!is_worker)
+			return;
+
+		Pin pin;
+
+		{
+			std::lock_guard<std::mutex> lock(pins_mutex);
+
+			auto found = pins.find(std::this_thread::get_id());
+
+			if (found != pins.end() && found->second.active)
+				return;
+
+			pin.cpu = (found != pins.end() ? found->second.cpu : cpu_order[next_slot++ % cpu_order.size()]);
+		}
+
+		pin.tid = (pid_t) ::syscall(SYS_gettid);
+		pin.active = sched_getaffinity(0, sizeof(cpu_set_t), &pin.original) == 0 && topology.pinToCpu(pin.cpu);
+
+		std::lock_guard<std::mutex> lock(pins_mutex);
+		pins[std::this_thread::get_id()] = pin;
+	}
+
+	void on_scheduler_exit(bool is_worker)
+	{
+		if (!is_worker)
+			return;
+
+		std::lock_guard<std::mutex> lock(pins_mutex);
+
+		auto found = pins.find(std::this_thread::get_id());
+
+		if (found == pins.end() || !found->second.active)
+			return;
+
+		sched_setaffinity(0, sizeof(cpu_set_t), &found->second.original);
+		found->second.active = false;
+	}
+
+	// the workers currently pinned by this observer.
+	long pinnedCount()
+	{
+		std::lock_guard<std::mutex> lock(pins_mutex);
+
+		return std::count_if(pins.begin(), pins.end(), [](const std::pair<const std::thread::id, Pin> &pin) { return pin.second.active; });
+	}
+};
+
+};
+
+#endif //namespace _NUMATOPOLOGY_H_
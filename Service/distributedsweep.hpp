@@ -0,0 +1,642 @@
+/*
+Header file for QuantumMechanics::Service::DistributedSweep: 
+
+This file splits a sweep over energies (or any list of points) across forked worker
+processes on the local machine. Each worker is pinned to one NUMA node, such that everything
+it allocates stays local, and talks to the coordinating process over a unix socket pair. No
+MPI installation is needed.
+
+The coordinator hands out guided chunks from a shared queue; once the queue is empty, idle
+workers steal the upper half of the remaining range of a busy worker. Results are merged in
+the order of the points.
+
+The workers are forked, so the point function and everything it captures is simply inherited.
+A fork copies only the calling thread, so locks held by TBB workers or any other thread would
+stay locked forever in the child. The workers are therefore only forked while the coordinating
+process is single threaded. start() forks them once, before the first use of TBB, and they
+then serve every later compute(points), with the points sent over the socket. compute(points,
+function) forks workers for a single sweep. When no worker can be forked, the points are
+computed in this process by tbb::parallel_for, and distributed() reports this.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _SERVICE_DISTRIBUTEDSWEEP_H_
+#define _SERVICE_DISTRIBUTEDSWEEP_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+#include "../Misc/NumaTopology"
+
+#include <tbb/tbb.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace QuantumMechanics {
+
+namespace Service {
+
+class DistributedSweep {
+
+	enum MessageType : std::int64_t {
+		Assign, Steal, Stop, Points, Sync,
+		Result, Idle, Stolen, Synced
+	};
+
+	struct Message {
+		std::int64_t type;
+		std::int64_t first;
+		std::int64_t second;
+	};
+
+	struct Worker {
+		pid_t pid;
+		int fd;
+		long begin;
+		long end;
+		bool busy;
+		bool steal_pending;
+		bool alive;
+	};
+
+	typedef std::function<VectorXd(const double &)> PointFunction;
+
+	std::vector<VectorXd> results;
+
+	// the started workers and the function they evaluate.
+	std::vector<Worker> workers;
+	PointFunction worker_function;
+
+	// whether the last sweep ran in the workers.
+	bool distributed_sweep;
+
+	static LoggingObject log;
+
+public:
+	long worker_count;
+	long min_chunk;
+
+	bool pin_workers;
+
+	// as default, one worker per core, spread over the NUMA nodes. A point function which runs in
+	// parallel by itself should rather use one worker per node, i.e. NumaTopology().cpuNodes().size().
+	DistributedSweep() : results(), workers(), worker_function(), distributed_sweep(false), worker_count(NumaTopology().cpuCount()), min_chunk(1), pin_workers(true) { }
+
+	DistributedSweep(const long &workers) : results(), workers(), worker_function(), distributed_sweep(false), worker_count(workers), min_chunk(1), pin_workers(true) { }
+
+	~DistributedSweep()
+	{
+		stop();
+	}
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+protected:
+	static bool send_all(int fd, const void *data, std::size_t bytes)
+	{
+		const char *pointer = static_cast<const char *>(data);
+
+		while (bytes > 0)
+		{
+			const ssize_t count = ::send(fd, pointer, bytes, MSG_NOSIGNAL);
+
+			if (count < 0 && errno == EINTR)
+				continue;
+			if (count <= 0)
+				return false;
+
+			pointer += count;
+			bytes -= count;
+		}
+
+		return true;
+	}
+
+	static bool receive_all(int fd, void *data, std::size_t bytes)
+	{
+		char *pointer = static_cast<char *>(data);
+
+		while (bytes > 0)
+		{
+			const ssize_t count = ::read(fd, pointer, bytes);
+
+			if (count < 0 && errno == EINTR)
+				continue;
+			if (count <= 0)
+				return false;
+
+			pointer += count;
+			bytes -= count;
+		}
+
+		return true;
+	}
+
+	static bool send_message(int fd, const std::int64_t &type, const std::int64_t &first = 0, const std::int64_t &second = 0)
+	{
+		const Message message = { type, first, second };
+
+		return send_all(fd, &message, sizeof(message));
+	}
+
+	static void run_worker(int fd, const PointFunction &function)
+	{
+		std::vector<double> points;
+
+		long next = 0;
+		long end = 0;
+
+		for (;;)
+		{
+			Message message;
+
+			// blocks only while the worker has nothing left to do.
+			if (next >= end)
+			{
+				if (!receive_all(fd, &message, sizeof(message)))
+					return;
+			}
+			else
+			{
+				pollfd check = { fd, POLLIN, 0 };
+
+				if (::poll(&check, 1, 0) <= 0)
+					message.type = -1;
+				else if (!receive_all(fd, &message, sizeof(message)))
+					return;
+			}
+
+			if (message.type == Stop)
+				return;
+
+			if (message.type == Points)
+			{
+				points.resize(message.first);
+
+				if (!receive_all(fd, points.data(), points.size() * sizeof(double)))
+					return;
+
+				next = end = 0;
+			}
+			else if (message.type == Sync)
+			{
+				// every earlier answer is already sent, so the coordinator can start a new sweep.
+				if (!send_message(fd, Synced))
+					return;
+			}
+			else if (message.type == Assign)
+			{
+				next = message.first;
+				end = message.second;
+			}
+			else if (message.type == Steal)
+			{
+				// gives away the upper half, but never the point that is next in line.
+				const long split = (end - next > 1 ? next + (end - next + 1) / 2 : end);
+
+				if (!send_message(fd, Stolen, split, end))
+					return;
+
+				end = split;
+			}
+
+			if (next < end)
+			{
+				const VectorXd value = function(points[next]);
+				const std::int64_t length = value.size();
+
+				if (!send_message(fd, Result, next, length) || !send_all(fd, value.data(), length * sizeof(double)))
+					return;
+
+				next++;
+
+				if (next == end && !send_message(fd, Idle))
+					return;
+			}
+		}
+	}
+
+	// the threads of this process, one if they cannot be counted.
+	static long thread_count()
+	{
+		DIR *tasks = ::opendir("/proc/self/task");
+
+		if (tasks == nullptr)
+			return 1;
+
+		long count = 0;
+
+		while (const dirent *entry = ::readdir(tasks))
+			if (entry->d_name[0] != '.')
+				count++;
+
+		::closedir(tasks);
+
+		return std::max(count, 1L);
+	}
+
+	long chunk_size(const long &remaining) const
+	{
+		return std::max(min_chunk, remaining / (2 * std::max(1L, worker_count)));
+	}
+
+	// the points in this process, when no worker can take them.
+	const std::vector<VectorXd> &compute_here(const std::vector<double> &points, const PointFunction &function)
+	{
+		distributed_sweep = false;
+
+		tbb::parallel_for(std::size_t(0), points.size(), [&](const std::size_t &p) {
+			results[p] = function(points[p]);
+		});
+
+		return results;
+	}
+
+	// sends the points to every worker and waits until the answers of the last sweep are drained.
+	void prepare_workers(const std::vector<double> &points)
+	{
+		for (auto &worker : workers)
+		{
+			if (!worker.alive)
+				continue;
+
+			Message message;
+
+			bool prepared = send_message(worker.fd, Sync);
+
+			while (prepared && (prepared = receive_all(worker.fd, &message, sizeof(message))) && message.type != Synced)
+			{
+				// the values of a late result are skipped.
+				if (message.type == Result)
+				{
+					VectorXd value(message.second);
+					prepared = receive_all(worker.fd, value.data(), message.second * sizeof(double));
+				}
+			}
+
+			prepared = prepared && send_message(worker.fd, Points, points.size()) && send_all(worker.fd, points.data(), points.size() * sizeof(double));
+
+			worker.begin = worker.end = 0;
+			worker.busy = worker.steal_pending = false;
+
+			if (!prepared)
+			{
+				log() << "Worker " << worker.pid << " stopped between sweeps." << std::endl;
+				worker.alive = false;
+				::close(worker.fd);
+			}
+		}
+	}
+
+	const std::vector<VectorXd> &sweep(const std::vector<double> &points)
+	{
+		const long point_count = (long) points.size();
+
+		prepare_workers(points);
+
+		std::vector<bool> done(point_count, false);
+		std::deque<std::pair<long, long> > queue(1, std::make_pair(0L, point_count));
+
+		long finished = 0;
+
+		distributed_sweep = true;
+
+		auto next_range = [&](std::pair<long, long> &range) {
+			while (!queue.empty())
+			{
+				range = queue.front();
+				queue.pop_front();
+
+				// a range returned from a dead worker may be partially done.
+				while (range.first < range.second && done[range.first])
+					range.first++;
+
+				if (range.first >= range.second)
+					continue;
+
+				const long size = chunk_size(range.second - range.first);
+
+				if (range.second - range.first > size)
+				{
+					queue.push_front(std::make_pair(range.first + size, range.second));
+					range.second = range.first + size;
+				}
+
+				return true;
+			}
+
+			return false;
+		};
+
+		auto feed = [&](Worker &worker) {
+			std::pair<long, long> range;
+
+			if (next_range(range))
+			{
+				worker.begin = range.first;
+				worker.end = range.second;
+				worker.busy = true;
+
+				send_message(worker.fd, Assign, range.first, range.second);
+
+				return;
+			}
+
+			worker.busy = false;
+
+			// the queue is empty, so the busiest worker is asked to give away half of its range.
+			Worker *victim = nullptr;
+
+			for (auto &other : workers)
+				if (other.alive && other.busy && !other.steal_pending && other.end - other.begin > 1)
+					if (victim == nullptr || other.end - other.begin > victim->end - victim->begin)
+						victim = &other;
+
+			if (victim != nullptr)
+			{
+				victim->steal_pending = true;
+				send_message(victim->fd, Steal);
+			}
+		};
+
+		auto retire = [&](Worker &worker) {
+			worker.alive = false;
+			::close(worker.fd);
+
+			if (worker.busy && worker.begin < worker.end)
+				queue.push_back(std::make_pair(worker.begin, worker.end));
+
+			worker.busy = false;
+		};
+
+		for (auto &worker : workers)
+			if (worker.alive)
+				feed(worker);
+
+		while (finished < point_count)
+		{
+			std::vector<pollfd> checks;
+			std::vector<Worker *> owners;
+
+			for (auto &worker : workers)
+				if (worker.alive)
+				{
+					pollfd check = { worker.fd, POLLIN, 0 };
+					checks.push_back(check);
+					owners.push_back(&worker);
+				}
+
+			if (checks.empty())
+			{
+				log() << "All workers died, the remaining points are computed in this process." << std::endl;
+
+				distributed_sweep = false;
+
+				for (long p = 0; p < point_count; p++)
+					if (!done[p])
+						results[p] = worker_function(points[p]);
+
+				break;
+			}
+
+			if (::poll(checks.data(), checks.size(), -1) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+
+				break;
+			}
+
+			for (std::size_t c = 0; c < checks.size(); c++)
+			{
+				if (checks[c].revents == 0)
+					continue;
+
+				Worker &worker = *owners[c];
+				Message message;
+
+				if (!receive_all(worker.fd, &message, sizeof(message)))
+				{
+					log() << "Worker " << worker.pid << " stopped unexpectedly, its points are requeued." << std::endl;
+					retire(worker);
+
+					for (auto &other : workers)
+						if (other.alive && !other.busy)
+							feed(other);
+
+					continue;
+				}
+
+				if (message.type == Result)
+				{
+					VectorXd value(message.second);
+
+					if (!receive_all(worker.fd, value.data(), message.second * sizeof(double)))
+					{
+						retire(worker);
+						continue;
+					}
+
+					if (!done[message.first])
+					{
+						results[message.first] = value;
+						done[message.first] = true;
+						finished++;
+					}
+
+					worker.begin = message.first + 1;
+				}
+				else if (message.type == Stolen)
+				{
+					worker.steal_pending = false;
+
+					// a late answer may belong to a range the worker already finished.
+					if (message.second == worker.end)
+						worker.end = message.first;
+
+					if (message.first < message.second)
+						queue.push_back(std::make_pair((long) message.first, (long) message.second));
+
+					for (auto &other : workers)
+						if (other.alive && !other.busy)
+							feed(other);
+				}
+				else if (message.type == Idle)
+				{
+					feed(worker);
+				}
+			}
+		}
+
+		log() << "The sweep of " << point_count << " points is merged." << std::endl;
+
+		return results;
+	}
+
+public:
+	/*
+	Forks the workers for function, which then serve every compute(points) until stop(). Returns
+	false, and forks nothing, if this process already runs other threads or no worker could be
+	started. Call it before the first use of TBB.
+	*/
+	bool start(const PointFunction &function)
+	{
+		stop();
+
+		worker_function = function;
+
+		if (thread_count() > 1)
+		{
+			log() << "This process already runs " << thread_count() << " threads and cannot fork safely." << std::endl;
+			return false;
+		}
+
+		NumaTopology topology;
+
+		const std::vector<long> nodes = topology.cpuNodes();
+		const long count = std::max(1L, worker_count);
+
+		log() << "Starting " << count << " workers on " << topology.nodeCount() << " NUMA nodes." << std::endl;
+
+		for (long w = 0; w < count; w++)
+		{
+			int pair[2];
+
+			if (::socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0)
+				break;
+
+			const pid_t pid = ::fork();
+
+			if (pid == 0)
+			{
+				::close(pair[0]);
+
+				for (auto &other : workers)
+					::close(other.fd);
+
+				if (pin_workers)
+					topology.pinToNode(nodes[w % nodes.size()]);
+
+				run_worker(pair[1], function);
+
+				::close(pair[1]);
+				::_exit(0);
+			}
+
+			::close(pair[1]);
+
+			if (pid < 0)
+			{
+				::close(pair[0]);
+				break;
+			}
+
+			Worker worker = { pid, pair[0], 0, 0, false, false, true };
+			workers.push_back(worker);
+		}
+
+		if (workers.empty())
+			log() << "No worker could be started." << std::endl;
+
+		return !workers.empty();
+	}
+
+	// stops and reaps the started workers.
+	void stop()
+	{
+		for (auto &worker : workers)
+		{
+			if (worker.alive)
+			{
+				send_message(worker.fd, Stop);
+				::close(worker.fd);
+			}
+
+			::waitpid(worker.pid, nullptr, 0);
+		}
+
+		workers.clear();
+	}
+
+	// the number of started workers which are still alive.
+	long workerCount() const
+	{
+		return std::count_if(workers.begin(), workers.end(), [](const Worker &worker) { return worker.alive; });
+	}
+
+	// evaluates the function given to start() at every point, in the started workers if any are
+	// alive and in this process otherwise. The results are in the order of the points.
+	const std::vector<VectorXd> &compute(const std::vector<double> &points)
+	{
+		results.assign(points.size(), VectorXd());
+
+		if (points.empty())
+			return results;
+
+		if (workerCount() == 0)
+		{
+			log() << "No worker is running, the sweep runs in this process." << std::endl;
+			return compute_here(points, worker_function);
+		}
+
+		return sweep(points);
+	}
+
+	// forks workers for this sweep only, after stopping any started before, see start().
+	const std::vector<VectorXd> &compute(const std::vector<double> &points, const PointFunction &function)
+	{
+		const long saved_count = worker_count;
+
+		results.assign(points.size(), VectorXd());
+
+		if (points.empty())
+			return results;
+
+		worker_count = std::min(worker_count, (long) points.size());
+
+		const bool started = start(function);
+
+		worker_count = saved_count;
+
+		if (!started)
+			return compute_here(points, function);
+
+		sweep(points);
+		stop();
+
+		return results;
+	}
+
+	// false when the last sweep, or a part of it, ran in this process instead of the workers.
+	bool distributed() const {
+		return distributed_sweep;
+	}
+
+	const std::vector<VectorXd> &result() const {
+		return results;
+	}
+};
+
+LoggingObject DistributedSweep::log("Service::DistributedSweep", false);
+
+}
+
+}
+
+#endif
@@ -0,0 +1,173 @@
+/*
+Header file for QuantumMechanics::Service::JobRequest: 
+
+This file defines the compact message format used between the solver daemon and its clients.
+A message is a single text header line followed by the matrices in raw binary form:
+
+	<kind> <id> <matrix count> [key=value ...]\n
+	<rows> <cols> <block count> [block sizes ...]\n<rows * cols complex doubles, column major>
+	...
+
+Requests use the kinds "transport", "greens", "chain" and "eigen"; the daemon answers with
+"result" (carrying the result matrices, a scalar being a 1-by-1 matrix) or "error" (carrying
+the option message=...). Options must not contain whitespace. A message is rejected as
+malformed before anything is allocated if its matrices hold more than a given number of
+elements in total, 2^27 (2 GiB) by default.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _SERVICE_JOBREQUEST_H_
+#define _SERVICE_JOBREQUEST_H_
+
+#include <Math/Dense>
+
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace QuantumMechanics {
+
+namespace Service {
+
+struct JobRequest {
+
+	std::string kind;
+	long id;
+
+	std::map<std::string, std::string> options;
+	std::vector<BlockMatrixXcd> matrices;
+
+	JobRequest() : kind(), id(-1), options(), matrices() { }
+
+	JobRequest(const std::string &k, const long &i) : kind(k), id(i), options(), matrices() { }
+
+	std::string option(const std::string &key, const std::string &fallback = std::string()) const
+	{
+		auto found = options.find(key);
+
+		return found == options.end() ? fallback : found->second;
+	}
+
+	long longOption(const std::string &key, const long &fallback) const
+	{
+		auto found = options.find(key);
+
+		if (found == options.end())
+			return fallback;
+
+		std::istringstream field(found->second);
+		long value;
+
+		// malformed values give the fallback.
+		if (!(field >> value) || !(field >> std::ws).eof())
+			return fallback;
+
+		return value;
+	}
+
+	// returns false on end of stream or on a malformed message.
+	static bool read(std::istream &in, JobRequest &request, const long &max_elements = 1L << 27)
+	{
+		std::string header;
+
+		if (!std::getline(in, header))
+			return false;
+
+		std::istringstream fields(header);
+		long matrix_count = 0;
+
+		request = JobRequest();
+
+		if (!(fields >> request.kind >> request.id >> matrix_count) || matrix_count < 0)
+			return false;
+
+		std::string token;
+
+		while (fields >> token)
+		{
+			const std::size_t split = token.find('=');
+
+			if (split == std::string::npos)
+				return false;
+
+			request.options[token.substr(0, split)] = token.substr(split + 1);
+		}
+
+		long elements = 0;
+
+		// the matrices are appended as they arrive, so a large count alone allocates nothing.
+		for (long m = 0; m < matrix_count; m++)
+		{
+			std::string shape;
+
+			if (!std::getline(in, shape))
+				return false;
+
+			std::istringstream dims(shape);
+			long rows, cols, block_count;
+
+			if (!(dims >> rows >> cols >> block_count) || rows < 0 || cols < 0 || block_count < 0 || block_count > rows)
+				return false;
+
+			if (cols > 0 && rows > (max_elements - elements) / cols)
+				return false;
+
+			elements += rows * cols;
+
+			ArrayXi sizes(block_count);
+
+			for (long b = 0; b < block_count; b++)
+				if (!(dims >> sizes[b]) || sizes[b] <= 0)
+					return false;
+
+			MatrixXcd values(rows, cols);
+
+			if (!in.read(reinterpret_cast<char *>(values.data()), values.size() * sizeof(MatrixXcd::Scalar)))
+				return false;
+
+			request.matrices.push_back(values);
+
+			// block sizes only describe square matrices.
+			if (block_count > 0 && rows == cols && sizes.sum() == rows)
+				request.matrices.back().setBlocks(sizes);
+		}
+
+		return true;
+	}
+
+	static void write(std::ostream &out, const JobRequest &request, const std::vector<ArrayXi> &block_sizes = std::vector<ArrayXi>())
+	{
+		out << request.kind << " " << request.id << " " << request.matrices.size();
+
+		for (auto &option : request.options)
+			out << " " << option.first << "=" << option.second;
+
+		out << "\n";
+
+		for (std::size_t m = 0; m < request.matrices.size(); m++)
+		{
+			const MatrixXcd values = request.matrices[m];
+			const ArrayXi sizes = m < block_sizes.size() ? block_sizes[m] : ArrayXi();
+
+			out << values.rows() << " " << values.cols() << " " << sizes.size();
+
+			for (long b = 0; b < sizes.size(); b++)
+				out << " " << sizes[b];
+
+			out << "\n";
+
+			out.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(MatrixXcd::Scalar));
+		}
+
+		out.flush();
+	}
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,221 @@
+/*
+Header file for QuantumMechanics::Service::SocketStream: 
+
+This file wraps a connected unix domain socket in a std::iostream, such that requests and
+results can be read and written with the usual stream operators. SocketConnection gives the
+two directions of a socket separate streams, with separate buffers and states, such that one
+thread may read while others write and the end of the input leaves the output usable. Only
+POSIX systems are supported.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _SERVICE_SOCKETSTREAM_H_
+#define _SERVICE_SOCKETSTREAM_H_
+
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace QuantumMechanics {
+
+namespace Service {
+
+class SocketBuffer : public std::streambuf {
+
+	int descriptor;
+
+	std::vector<char> input;
+	std::vector<char> output;
+
+public:
+	SocketBuffer(int fd, std::size_t buffer_size = 1 << 16) : descriptor(fd), input(buffer_size), output(buffer_size)
+	{
+		setg(input.data(), input.data(), input.data());
+		setp(output.data(), output.data() + output.size());
+	}
+
+	~SocketBuffer()
+	{
+		sync();
+	}
+
+	int fd() const {
+		return descriptor;
+	}
+
+protected:
+	int_type underflow()
+	{
+		if (gptr() < egptr())
+			return traits_type::to_int_type(*gptr());
+
+		ssize_t count;
+
+		do {
+			count = ::read(descriptor, input.data(), input.size());
+		} while (count < 0 && errno == EINTR);
+
+		if (count <= 0)
+			return traits_type::eof();
+
+		setg(input.data(), input.data(), input.data() + count);
+
+		return traits_type::to_int_type(*gptr());
+	}
+
+	bool flush_output()
+	{
+		const char *data = pbase();
+		std::size_t remaining = pptr() - pbase();
+
+		while (remaining > 0)
+		{
+			const ssize_t count = ::send(descriptor, data, remaining, MSG_NOSIGNAL);
+
+			if (count < 0 && errno == EINTR)
+				continue;
+
+			if (count <= 0)
+				return false;
+
+			data += count;
+			remaining -= count;
+		}
+
+		setp(output.data(), output.data() + output.size());
+
+		return true;
+	}
+
+	int_type overflow(int_type c)
+	{
+		if (!flush_output())
+			return traits_type::eof();
+
+		if (!traits_type::eq_int_type(c, traits_type::eof()))
+		{
+			*pptr() = traits_type::to_char_type(c);
+			pbump(1);
+		}
+
+		return traits_type::not_eof(c);
+	}
+
+	int sync()
+	{
+		return flush_output() ? 0 : -1;
+	}
+};
+
+class SocketStream : public std::iostream {
+
+	SocketBuffer buffer;
+
+public:
+	// takes ownership of the connected socket and closes it on destruction.
+	SocketStream(int fd) : std::iostream(nullptr), buffer(fd)
+	{
+		rdbuf(&buffer);
+	}
+
+	~SocketStream()
+	{
+		flush();
+		::close(buffer.fd());
+	}
+
+	int fd() const {
+		return buffer.fd();
+	}
+
+	// returns -1 if the path is too long or the socket could not be connected.
+	static int connectTo(const std::string &path)
+	{
+		sockaddr_un address;
+
+		if (path.size() >= sizeof(address.sun_path))
+			return -1;
+
+		std::memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+		const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+		if (fd < 0)
+			return -1;
+
+		if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+		{
+			::close(fd);
+			return -1;
+		}
+
+		return fd;
+	}
+
+	// removes a stale socket file, binds and listens. Returns -1 on failure.
+	static int listenOn(const std::string &path, int backlog = 64)
+	{
+		sockaddr_un address;
+
+		if (path.size() >= sizeof(address.sun_path))
+			return -1;
+
+		std::memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+		const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+		if (fd < 0)
+			return -1;
+
+		::unlink(path.c_str());
+
+		if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || ::listen(fd, backlog) < 0)
+		{
+			::close(fd);
+			return -1;
+		}
+
+		return fd;
+	}
+};
+
+class SocketConnection {
+
+	SocketBuffer input_buffer;
+	SocketBuffer output_buffer;
+
+public:
+	std::istream input;
+	std::ostream output;
+
+	// takes ownership of the connected socket and closes it on destruction.
+	SocketConnection(int fd) : input_buffer(fd), output_buffer(fd), input(&input_buffer), output(&output_buffer) { }
+
+	~SocketConnection()
+	{
+		output.flush();
+		::close(input_buffer.fd());
+	}
+
+	int fd() const {
+		return input_buffer.fd();
+	}
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,87 @@
+/*
+Header file for QuantumMechanics::Service::SolverClient: 
+
+This file connects to a running SolverDaemon and submits jobs. Several jobs may be submitted
+before results are collected; results are returned in the order the daemon finishes them.
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _SERVICE_SOLVERCLIENT_H_
+#define _SERVICE_SOLVERCLIENT_H_
+
+#include <Math/Dense>
+
+#include "SocketStream"
+#include "JobRequest"
+
+#include <memory>
+#include <string>
+
+namespace QuantumMechanics {
+
+namespace Service {
+
+class SolverClient {
+
+	std::unique_ptr<SocketStream> stream;
+
+	long next_id;
+
+public:
+	SolverClient(const std::string &path) : stream(), next_id(0)
+	{
+		const int fd = SocketStream::connectTo(path);
+
+		if (fd >= 0)
+			stream.reset(new SocketStream(fd));
+	}
+
+	// takes ownership of an already connected socket.
+	SolverClient(int fd) : stream(new SocketStream(fd)), next_id(0) { }
+
+	bool connected() const {
+		return stream != nullptr && stream->good();
+	}
+
+	// returns the id of the submitted job, or -1 if not connected.
+	long submit(JobRequest request, const std::vector<ArrayXi> &block_sizes = std::vector<ArrayXi>())
+	{
+		if (!connected())
+			return -1;
+
+		request.id = next_id++;
+
+		JobRequest::write(*stream, request, block_sizes);
+
+		return request.id;
+	}
+
+	// blocks until the next result (or error) arrives. Returns false if the connection closed.
+	bool receive(JobRequest &result)
+	{
+		return connected() && JobRequest::read(*stream, result);
+	}
+
+	// closes the sending direction only, the results of the submitted jobs still arrive.
+	void finishSubmitting()
+	{
+		if (!connected())
+			return;
+
+		stream->flush();
+		::shutdown(stream->fd(), SHUT_WR);
+	}
+
+	void shutdownDaemon()
+	{
+		if (connected())
+			JobRequest::write(*stream, JobRequest("shutdown", next_id++));
+	}
+};
+
+}
+
+}
+
+#endif
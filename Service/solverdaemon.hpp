@@ -0,0 +1,435 @@
+/*
+Header file for QuantumMechanics::Service::SolverDaemon: 
+
+This file runs a long-lived local service on a unix domain socket, which accepts transport,
+greens, chain and eigen jobs in the JobRequest format. The process (and thereby MKL and TBB)
+stays initialized, lead surface solutions are kept in a shared SurfaceGreensCache, and all
+jobs from all connections are scheduled on one task arena. Results are streamed back on the
+connection of the request as soon as each job finishes, so they may arrive out of order and
+must be matched by id.
+
+A minimal executable is:
+
+	int main() { QuantumMechanics::Service::SolverDaemon daemon("/tmp/qm.sock"); return daemon.run() ? 0 : 1; }
+
+---
+Copyright (C) 2014, Søren Schou Gregersen <sorge@nanotech.dtu.dk>
+ */
+#ifndef _SERVICE_SOLVERDAEMON_H_
+#define _SERVICE_SOLVERDAEMON_H_
+
+#include <Math/Dense>
+#include "../Misc/LoggingObject"
+#include "../Misc/NumaTopology"
+
+#include "../GreensFormalism/GreensSolver"
+#include "../GreensFormalism/ChainSolver"
+#include "../GreensFormalism/SurfaceGreensCache"
+#include "../LanduarFormalism/TwoLeadTransportSolver"
+
+#include "SocketStream"
+#include "JobRequest"
+
+#include <tbb/tbb.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+namespace QuantumMechanics {
+
+namespace Service {
+
+class SolverDaemon {
+
+	// the reader of a connection owns its input stream, the jobs share the output stream.
+	struct Connection {
+		SocketConnection socket;
+		std::mutex write_mutex;
+
+		Connection(int fd) : socket(fd) { }
+
+		void send(const JobRequest &result)
+		{
+			std::lock_guard<std::mutex> lock(write_mutex);
+			JobRequest::write(socket.output, result);
+		}
+	};
+
+	const std::string socket_path;
+	std::atomic<int> listener;
+
+	std::atomic<bool> running;
+
+	// the shared core pool on which every job runs.
+	tbb::task_arena arena;
+
+	// connections and jobs still in flight, run() returns only when both are zero.
+	std::set<int> open_connections;
+	std::atomic<long> pending_jobs;
+	std::mutex pending_mutex;
+	std::condition_variable pending_done;
+
+	std::atomic<long> finished_jobs;
+
+	GreensFormalism::SurfaceGreensCache surface_cache;
+
+	static LoggingObject log;
+
+public:
+	// the largest number of matrix elements in one request, larger requests close their connection.
+	long max_request_elements;
+
+	// pins the workers of its arena to cores while run() serves, and places the workspaces of every job on the node of its worker.
+	bool numa_local;
+
+	SolverDaemon(const std::string &path, const int &threads = tbb::task_arena::automatic) :
+		socket_path(path),
+		listener(-1),
+		running(true),
+		arena(threads),
+		pending_jobs(0),
+		finished_jobs(0),
+		surface_cache(),
+		max_request_elements(1L << 27),
+		numa_local(false)
+		{ }
+
+	~SolverDaemon()
+	{
+		stop();
+	}
+
+	static inline void enableLog()
+	{
+		log.enable();
+	}
+
+	GreensFormalism::SurfaceGreensCache &surfaceCache() {
+		return surface_cache;
+	}
+
+	long finishedJobs() const {
+		return finished_jobs;
+	}
+
+	// blocks until stop() is called or a "shutdown" request arrives.
+	bool run()
+	{
+		const int socket = SocketStream::listenOn(socket_path);
+
+		if (socket < 0)
+		{
+			log() << "Could not listen on " << socket_path << "." << std::endl;
+			return false;
+		}
+
+		listener = socket;
+		running = true;
+
+		std::unique_ptr<NumaThreadPinning> pinning(numa_local ? new NumaThreadPinning(arena) : nullptr);
+
+		surface_cache.setNumaPolicy(numa_local ? NumaLocal : NumaFirstTouch);
+
+		log() << "Listening on " << socket_path << " with " << arena.max_concurrency() << " threads." << std::endl;
+
+		while (running)
+		{
+			const int fd = ::accept(socket, nullptr, nullptr);
+
+			if (fd < 0)
+			{
+				if (errno == EINTR)
+					continue;
+
+				break;
+			}
+
+			serveSocket(fd);
+		}
+
+		stop();
+
+		log() << "Waiting for " << pending_jobs << " running jobs." << std::endl;
+
+		{
+			std::lock_guard<std::mutex> lock(pending_mutex);
+
+			// unblocks the connection readers, the output streams stay usable for running jobs.
+			for (int fd : open_connections)
+				::shutdown(fd, SHUT_RD);
+		}
+
+		wait();
+
+		::unlink(socket_path.c_str());
+
+		return true;
+	}
+
+	// serves requests on an already connected socket, like an accepted one, and takes its ownership.
+	void serveSocket(int fd)
+	{
+		std::shared_ptr<Connection> connection(new Connection(fd));
+
+		{
+			std::lock_guard<std::mutex> lock(pending_mutex);
+			open_connections.insert(fd);
+		}
+
+		std::thread([this, connection]() { serve_connection(connection); }).detach();
+	}
+
+	// blocks until every connection is closed and every job has sent its result.
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(pending_mutex);
+
+		pending_done.wait(lock, [this]() { return pending_jobs == 0 && open_connections.empty(); });
+	}
+
+	void stop()
+	{
+		running = false;
+
+		const int socket = listener.exchange(-1);
+
+		if (socket >= 0)
+		{
+			::shutdown(socket, SHUT_RDWR);
+			::close(socket);
+		}
+	}
+
+protected:
+	void serve_connection(std::shared_ptr<Connection> connection)
+	{
+		JobRequest request;
+
+		// a failure on one connection, like a request too large to allocate, only closes that connection.
+		try
+		{
+			while (running && JobRequest::read(connection->socket.input, request, max_request_elements))
+			{
+				if (request.kind == "shutdown")
+				{
+					stop();
+					break;
+				}
+
+				pending_jobs++;
+
+				std::shared_ptr<JobRequest> job(new JobRequest(std::move(request)));
+
+				arena.enqueue([this, connection, job]() {
+					try
+					{
+						connection->send(execute(*job));
+					}
+					catch (...)
+					{
+						log() << "The result of job " << job->id << " could not be sent." << std::endl;
+					}
+
+					finished_jobs++;
+
+					// under the lock, such that wait() cannot return before the notification.
+					std::lock_guard<std::mutex> lock(pending_mutex);
+
+					if (--pending_jobs == 0)
+						pending_done.notify_all();
+				});
+			}
+		}
+		catch (...)
+		{
+			log() << "A connection failed while reading a request." << std::endl;
+		}
+
+		std::lock_guard<std::mutex> lock(pending_mutex);
+		open_connections.erase(connection->socket.fd());
+		pending_done.notify_all();
+	}
+
+	static JobRequest error(const JobRequest &request, const std::string &message)
+	{
+		JobRequest result("error", request.id);
+
+		result.options["message"] = message;
+
+		return result;
+	}
+
+	JobRequest execute(const JobRequest &request)
+	{
+		log() << "Job " << request.id << " of kind " << request.kind << " started." << std::endl;
+
+		try
+		{
+			if (request.kind == "transport")
+				return execute_transport(request);
+			if (request.kind == "greens")
+				return execute_greens(request);
+			if (request.kind == "chain")
+				return execute_chain(request);
+			if (request.kind == "eigen")
+				return execute_eigen(request);
+			if (request.kind == "stats")
+				return execute_stats(request);
+		}
+		catch (const std::exception &failure)
+		{
+			return error(request, std::string("job_failed:") + failure.what());
+		}
+		catch (...)
+		{
+			return error(request, "job_failed");
+		}
+
+		return error(request, "unknown_kind");
+	}
+
+	JobRequest execute_transport(const JobRequest &request)
+	{
+		using namespace LanduarFormalism;
+
+		if (request.matrices.size() != 1)
+			return error(request, "transport_needs_one_matrix");
+
+		const std::string mode = request.option("mode", "LeftToRight");
+		const long left_count = request.longOption("leftblocks", 1);
+		const long right_count = request.longOption("rightblocks", 1);
+
+		// two layers of each lead and at least two device blocks, since a single device block has no reduced self-energies.
+		if (left_count < 1 || right_count < 1 || request.matrices[0].blockRows() < 2 * left_count + 2 * right_count + 2)
+			return error(request, "transport_needs_leads_and_device");
+
+		TwoLeadTransportSolver solver(request.matrices[0]);
+
+		solver.setSurfaceCache(&surface_cache);
+		solver.setLeftLeadBlockCount(left_count);
+		solver.setRightLeadBlockCount(right_count);
+
+		JobRequest result("result", request.id);
+
+		if (mode == "LeftToRight" || mode == "RightToLeft")
+		{
+			solver.compute(mode == "LeftToRight" ? LeftToRight : RightToLeft);
+			result.matrices.push_back(MatrixXcd::Constant(1, 1, solver.transmission()));
+		}
+		else if (mode == "CurrentsLeftToRight" || mode == "CurrentsRightToLeft")
+		{
+			solver.compute(mode == "CurrentsLeftToRight" ? CurrentsLeftToRight : CurrentsRightToLeft);
+			result.matrices.push_back(MatrixXcd(solver.currents().cast<std::complex<double> >()));
+		}
+		else
+			return error(request, "unknown_mode");
+
+		return result;
+	}
+
+	JobRequest execute_greens(const JobRequest &request)
+	{
+		using namespace GreensFormalism;
+
+		if (request.matrices.size() != 1)
+			return error(request, "greens_needs_one_matrix");
+
+		if (request.matrices[0].rows() != request.matrices[0].cols() || request.matrices[0].rows() == 0)
+			return error(request, "greens_needs_square_matrix");
+
+		const std::string mode = request.option("mode", "FullMatrix");
+
+		GreenMatrixSubType action;
+
+		if (mode == "FullMatrix")
+			action = FullMatrix;
+		else if (mode == "FirstBlock")
+			action = FirstBlock;
+		else if (mode == "LastBlock")
+			action = LastBlock;
+		else if (mode == "FirstBlockColumn")
+			action = FirstBlockColumn;
+		else if (mode == "LastBlockColumn")
+			action = LastBlockColumn;
+		else
+			return error(request, "unknown_mode");
+
+		GreensSolver solver(request.matrices[0]);
+
+		if (numa_local)
+			solver.setNumaPolicy(NumaLocal);
+
+		solver.compute(action);
+
+		JobRequest result("result", request.id);
+
+		result.matrices.push_back(solver.greensMatrix());
+
+		return result;
+	}
+
+	JobRequest execute_chain(const JobRequest &request)
+	{
+		if (request.matrices.size() != 2)
+			return error(request, "chain_needs_two_matrices");
+
+		const long n = request.matrices[0].rows();
+
+		if (n == 0 || request.matrices[0].cols() != n || request.matrices[1].rows() != n || request.matrices[1].cols() != n)
+			return error(request, "chain_needs_square_matrices");
+
+		JobRequest result("result", request.id);
+
+		result.matrices.push_back(surface_cache.surfaceGreensMatrix(request.matrices[0], request.matrices[1]));
+
+		return result;
+	}
+
+	JobRequest execute_eigen(const JobRequest &request)
+	{
+		if (request.matrices.size() != 1)
+			return error(request, "eigen_needs_one_matrix");
+
+		if (request.matrices[0].rows() != request.matrices[0].cols())
+			return error(request, "eigen_needs_square_matrix");
+
+		const MatrixXcd M = request.matrices[0];
+
+		auto eigensystem = M.hermitianEigenvectors(range::full());
+
+		JobRequest result("result", request.id);
+
+		result.matrices.push_back(MatrixXcd(eigensystem.first.cast<std::complex<double> >()));
+
+		if (request.longOption("vectors", 0) != 0)
+			result.matrices.push_back(MatrixXcd(eigensystem.second));
+
+		return result;
+	}
+
+	JobRequest execute_stats(const JobRequest &request)
+	{
+		JobRequest result("result", request.id);
+
+		result.options["finished"] = std::to_string(finished_jobs);
+		result.options["pending"] = std::to_string(pending_jobs - 1);
+		result.options["cached_leads"] = std::to_string(surface_cache.size());
+		result.options["cache_hits"] = std::to_string(surface_cache.hits());
+		result.options["cache_misses"] = std::to_string(surface_cache.misses());
+
+		return result;
+	}
+};
+
+LoggingObject SolverDaemon::log("Service::SolverDaemon", false);
+
+}
+
+}
+
+#endif
@@ -4,8 +4,19 @@
 
 #include <QuantumMechanics/GreensFormalism/GreensSolver>
 #include <QuantumMechanics/GreensFormalism/ChainSolver>
+#include <QuantumMechanics/GreensFormalism/SurfaceGreensCache>
+#include <QuantumMechanics/GreensFormalism/SparseGreensSolver>
+#include <QuantumMechanics/GreensFormalism/BatchedGreensSolver>
+#include <QuantumMechanics/GreensFormalism/PrincipalLayer>
+#include <QuantumMechanics/GreensFormalism/ComplexBandStructure>
 #include <QuantumMechanics/LanduarFormalism/TwoLeadTransportSolver>
 
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include <sys/stat.h>
+
 namespace QuantumMechanics {
 
 namespace GreensFormalism {
@@ -92,6 +103,250 @@ void test_partial_greens_inversion(std::function<void(std::string,bool)> assert_
 	assert_function("The GreensFormalism::GreensSolver could not solve the first block column of a random hermitian 10x10 matrix.", solver.greensMatrix().matrix().isApprox(M.matrix().inverse().block(0, 0, 10, 2), 1e-11)); // default precision is 1e-12!
 }
 
+void test_planned_greens_inversion(std::function<void(std::string,bool)> assert_function) {
+
+	ArrayXi sizes = Array4i(2,3,2,3);
+	BlockMatrixXcd M = random_hermitian(sizes);
+
+	GreensSolver solver(M);
+	//solver.enableLog();
+	SolverPlanner::disableLog();
+
+	// the budget leaves no room for the dense inverse, but fits the recursive full matrix.
+	solver.setMemoryBudget(4500);
+
+	assert_function("The GreensFormalism::SolverPlanner did not pick the recursive algorithm for a budget too small for the dense inverse.", solver.plan(FullMatrix).feasible() && solver.plan(FullMatrix).choice().algorithm == RecursiveGreens);
+
+	solver.compute(FullMatrix);
+
+	assert_function("The GreensFormalism::GreensSolver could not solve a random hermitian 10x10 matrix recursively.", solver.greensMatrix().matrix().isApprox(M.matrix().inverse(), 1e-11));
+
+	// a chain inside its band without broadening, where only the out-of-core inverse fits.
+	const long n = 248;
+
+	BlockMatrixXcd chain = MatrixXcd(MatrixXcd::Identity(n, n) * 0.3);
+
+	for (long i = 0; i + 1 < n; i++)
+		chain(i, i + 1) = chain(i + 1, i) = 1.0;
+
+	chain.setBlocks(ArrayXi::Ones(n));
+
+	GreensSolver out_of_core(chain);
+
+	out_of_core.setScratchDirectory("", 16);
+	out_of_core.setMemoryBudget(1.5e6);
+	out_of_core.compute(FullMatrix);
+
+	const MatrixXcd reference = chain.matrix().inverse();
+
+	assert_function("The GreensFormalism::GreensSolver did not keep the out-of-core full matrix of a 248x248 chain in its scratch file.", out_of_core.greensMatrix().size() == 0 && out_of_core.tiledGreensMatrix() != nullptr);
+	assert_function("The GreensFormalism::GreensSolver could not solve a 248x248 chain without broadening out of core.", out_of_core.tiledGreensMatrix() != nullptr && (out_of_core.tiledGreensMatrix()->matrix() - reference).norm() < 1e-9 * reference.norm());
+
+	solver.setMemoryBudget(100);
+	solver.compute(FullMatrix);
+
+	assert_function("The GreensFormalism::GreensSolver computed a solution that does not fit the memory budget.", solver.greensMatrix().matrix().size() == 0);
+}
+
+void test_tuned_greens_inversion(std::function<void(std::string,bool)> assert_function) {
+
+	ArrayXi sizes = Array4i(2,3,2,3);
+	BlockMatrixXcd M = random_hermitian(sizes);
+
+	AutoTuner tuner("unittesting_tuning.tmp");
+	tuner.repetitions = 1;
+
+	GreensSolver solver(M);
+	//solver.enableLog();
+
+	solver.setAutoTuner(&tuner);
+	solver.compute(LastBlock);
+
+	assert_function("The GreensFormalism::GreensSolver could not solve the last block of a random hermitian 10x10 matrix while tuning.", solver.greensMatrix().matrix().isApprox(M.matrix().inverse().block(7, 7, 3, 3)));
+
+	AutoTuner reloaded("unittesting_tuning.tmp");
+
+	assert_function("The AutoTuner did not persist the winner of the GreensFormalism::GreensSolver candidates.", !reloaded.lookup("GreensSolver:LastBlock:" + AutoTuner::problemSignature(sizes)).empty());
+
+	// an explicit block inversion is kept and tuned apart.
+	GreensSolver fixed(M);
+
+	fixed.setBlockInversion(LUSolve);
+	fixed.setAutoTuner(&tuner);
+	fixed.compute(LastBlock);
+
+	assert_function("The GreensFormalism::GreensSolver tuner overrode an explicit block inversion.", fixed.blockInversion() == LUSolve && !tuner.lookup("GreensSolver:LastBlock:inversion1:" + AutoTuner::problemSignature(sizes)).empty());
+	assert_function("The GreensFormalism::GreensSolver could not solve the last block with a fixed block inversion while tuning.", fixed.greensMatrix().matrix().isApprox(M.matrix().inverse().block(7, 7, 3, 3)));
+
+	// the chunk size of a batch of problems.
+	std::vector<BlockMatrixXcd> problems(40, M);
+
+	BatchedGreensSolver batched(problems);
+
+	batched.setAutoTuner(&tuner);
+	batched.compute(LastBlock);
+
+	bool correct = batched.greensMatrices().size() == problems.size();
+
+	for (std::size_t e = 0; correct && e < problems.size(); e++)
+		correct = batched.greensMatrices()[e].isApprox(M.matrix().inverse().block(7, 7, 3, 3), 1e-10);
+
+	assert_function("The GreensFormalism::BatchedGreensSolver could not solve 40 problems while tuning the chunk size.", correct && !tuner.lookup("BatchedGreensSolver:LastBlock:problems:40:" + AutoTuner::problemSignature(sizes)).empty());
+
+	std::remove("unittesting_tuning.tmp");
+}
+
+void test_hierarchical_greens_inversion(std::function<void(std::string,bool)> assert_function) {
+
+	ArrayXi sizes = Array4i(6,5,6,5);
+	BlockMatrixXcd M = random_hermitian(sizes);
+
+	GreensSolver solver(M);
+	//solver.enableLog();
+
+	// leafs of 2 make every block hierarchical, a random matrix is not compressed though.
+	solver.setBlockInversion(HierarchicalInverse);
+	solver.setHierarchicalTolerance(1e-14, 2);
+
+	solver.compute(LastBlock);
+
+	assert_function("The GreensFormalism::GreensSolver could not solve the last block of a random hermitian 22x22 matrix with hierarchical block inverses.", solver.greensMatrix().matrix().isApprox(M.matrix().inverse().block(17, 17, 5, 5), 1e-8));
+
+	solver.compute(FirstBlock);
+
+	assert_function("The GreensFormalism::GreensSolver could not solve the first block of a random hermitian 22x22 matrix with hierarchical block inverses.", solver.greensMatrix().matrix().isApprox(M.matrix().inverse().block(0, 0, 6, 6), 1e-8));
+
+	assert_function("The GreensFormalism::GreensSolver kept the self-energy of full-rank random couplings in low-rank form.", solver.selfEnergyRank() == -1);
+
+	// 6 chains of 32 sites, coupled by their two end sites only, keep a self-energy of rank 2.
+	BlockMatrixXcd S = MatrixXcd::Zero(192, 192);
+
+	S.setBlocks(ArrayXi::Constant(6, 32));
+
+	for (long i = 0; i < 192; i++)
+	{
+		S(i, i) = std::complex<double>(0.3, 0.05);
+
+		if (i % 32 != 31)
+			S(i, i + 1) = S(i + 1, i) = 1.0;
+
+		if (i % 32 == 0 && i + 32 < 192)
+		{
+			S(i, i + 32) = S(i + 32, i) = 0.7;
+			S(i + 31, i + 63) = S(i + 63, i + 31) = 0.7;
+		}
+	}
+
+	GreensSolver strip(S);
+
+	strip.setBlockInversion(HierarchicalInverse);
+	strip.setHierarchicalTolerance(1e-12, 8);
+
+	strip.compute(LastBlock);
+
+	const MatrixXcd reference = S.matrix().inverse();
+
+	assert_function("The GreensFormalism::GreensSolver could not solve the last block of an edge coupled strip with a low-rank self-energy.", strip.greensMatrix().matrix().isApprox(reference.block(160, 160, 32, 32), 1e-8));
+	assert_function("The GreensFormalism::GreensSolver did not keep the self-energy of an edge coupled strip in low-rank form.", strip.selfEnergyRank() > 0 && strip.selfEnergyRank() <= 2);
+
+	strip.compute(FirstBlock);
+
+	assert_function("The GreensFormalism::GreensSolver could not solve the first block of an edge coupled strip with a low-rank self-energy.", strip.greensMatrix().matrix().isApprox(reference.block(0, 0, 32, 32), 1e-8));
+	assert_function("The GreensFormalism::GreensSolver did not keep the self-energy of an edge coupled strip in low-rank form from the right.", strip.selfEnergyRank() > 0 && strip.selfEnergyRank() <= 2);
+}
+
+void test_sparse_greens_inversion(std::function<void(std::string,bool)> assert_function) {
+
+	// a strip of 5 cells of 8 sites, in which only the edge sites are coupled between cells.
+	ArrayXi sizes = ArrayXi::Constant(5, 8);
+	BlockMatrixXcd M = MatrixXcd::Zero(40, 40);
+
+	M.setBlocks(sizes);
+
+	for (int b = 0; b < 5; b++)
+	{
+		MatrixXcd cell = MatrixXcd::Zero(8, 8);
+
+		cell.diagonal() = VectorXcd::Random(8) + VectorXcd::Constant(8, std::complex<double>(0, 0.1));
+		cell.diagonal(1).setConstant(-1);
+		cell.diagonal(-1).setConstant(-1);
+
+		M.block(b, b) = cell;
+
+		if (b < 4)
+		{
+			MatrixXcd hopping = MatrixXcd::Zero(8, 8);
+
+			hopping(0, 0) = hopping(7, 7) = -1;
+
+			M.block(b, b + 1) = hopping;
+			M.block(b + 1, b) = hopping.adjoint();
+		}
+	}
+
+	SparseGreensSolver solver(M);
+	//solver.enableLog();
+
+	solver.compute(LastBlock);
+
+	assert_function("The GreensFormalism::SparseGreensSolver could not solve the last block of a sparse 40x40 strip.", solver.greensMatrix().isApprox(M.matrix().inverse().block(32, 32, 8, 8), 1e-10));
+
+	solver.compute(FirstBlock);
+
+	assert_function("The GreensFormalism::SparseGreensSolver could not solve the first block of a sparse 40x40 strip.", solver.greensMatrix().isApprox(M.matrix().inverse().block(0, 0, 8, 8), 1e-10));
+}
+
+void test_batched_greens_inversion(std::function<void(std::string,bool)> assert_function) {
+
+	ArrayXi sizes = Array4i(3,4,3,4);
+	std::vector<BlockMatrixXcd> problems;
+
+	for (int e = 0; e < 100; e++)
+		problems.push_back(random_hermitian(sizes));
+
+	BatchedGreensSolver solver(problems);
+	//solver.enableLog();
+
+	// a chunk size which does not divide the problem count.
+	solver.chunk_size = 32;
+
+	solver.compute(LastBlock);
+
+	bool correct = true;
+
+	for (int e = 0; e < 100; e++)
+		correct = correct && solver.greensMatrices()[e].isApprox(problems[e].matrix().inverse().block(10, 10, 4, 4), 1e-10);
+
+	assert_function("The GreensFormalism::BatchedGreensSolver could not solve the last block of 100 random hermitian 14x14 matrices.", correct);
+
+	solver.compute(FirstBlock);
+
+	for (int e = 0; e < 100; e++)
+		correct = correct && solver.greensMatrices()[e].isApprox(problems[e].matrix().inverse().block(0, 0, 3, 3), 1e-10);
+
+	assert_function("The GreensFormalism::BatchedGreensSolver could not solve the first block of 100 random hermitian 14x14 matrices.", correct);
+
+	// the product may overwrite either of its factors.
+	std::vector<MatrixXcd> left, middle, right;
+
+	for (int e = 0; e < 5; e++)
+	{
+		left.push_back(problems[e].block(0, 1));
+		middle.push_back(problems[e].block(1, 1));
+		right.push_back(problems[e].block(1, 2));
+	}
+
+	LinearAlgebra::PackedBatch A(left), B(right);
+
+	LinearAlgebra::batchedMultiply(A, B, A);
+	LinearAlgebra::batchedMultiply(LinearAlgebra::PackedBatch(middle), B, B);
+
+	for (int e = 0; e < 5; e++)
+		correct = correct && A.get(e).isApprox(left[e] * right[e], 1e-12) && B.get(e).isApprox(middle[e] * right[e], 1e-12);
+
+	assert_function("The LinearAlgebra::batchedMultiply gave a wrong product when it overwrote a factor.", correct);
+}
+
 void test_chain_surface_greens(std::function<void(std::string, bool)> assert_function) {
 
 	ArrayXi sizes = Array4i(2, 2, 2, 2);
@@ -106,6 +361,354 @@ void test_chain_surface_greens(std::function<void(std::string, bool)> assert_fun
 	assert_function("The GreensFormalism::ChainSolver could not solve a random hermitian 10x10 hamilton matrix and a 10x10 hopping matrix.", solver.greensMatrix().matrix().size() > 0);
 }
 
+void test_chain_block_decimation(std::function<void(std::string, bool)> assert_function) {
+
+	// a lead of three 2x2 cells per principal layer, where only the last cell couples onwards.
+	ArrayXi sizes = Array3i(2, 2, 2);
+	BlockMatrixXcd h = random_hermitian(sizes);
+	BlockMatrixXcd v = h.asZero();
+
+	h = (MatrixXcd::Identity(6, 6) * std::complex<double>(0.3, 0.01) - h.matrix()).eval();
+	h.setBlocks(sizes);
+
+	v.block(2, 0) = MatrixXcd::Random(2, 2);
+
+	ChainSolver block_solver(h, v);
+	ChainSolver dense_solver(h, v);
+
+	dense_solver.block_decimation = false;
+
+	block_solver.compute(SurfaceGreensMatrix);
+	dense_solver.compute(SurfaceGreensMatrix);
+
+	const MatrixXcd G = block_solver.greensMatrix();
+
+	assert_function("The GreensFormalism::ChainSolver block decimation did not agree with the dense decimation of a 3 cell principal layer.", G.isApprox(dense_solver.greensMatrix().matrix(), 1e-8));
+
+	assert_function("The GreensFormalism::ChainSolver surface greens matrix did not satisfy the Dyson equation G = (h - v G v*)^-1.", G.isApprox((h.matrix() - v.matrix() * G * v.matrix().adjoint()).inverse(), 1e-8));
+
+	// a corner coupled layer which also couples its own first and last block, such that it is not block tridiagonal.
+	const long n = 3;
+	MatrixXcd ring = MatrixXcd::Identity(n, n) * std::complex<double>(0.3, 0.01);
+
+	for (long i = 0; i + 1 < n; i++)
+		ring(i, i + 1) = ring(i + 1, i) = 1.0;
+
+	ring(0, n - 1) = ring(n - 1, 0) = -0.5;
+
+	BlockMatrixXcd ring_h = ring;
+	BlockMatrixXcd ring_v = MatrixXcd(MatrixXcd::Zero(n, n));
+
+	ring_h.setBlocks(ArrayXi::Ones(n));
+	ring_v.setBlocks(ArrayXi::Ones(n));
+	ring_v.block(n - 1, 0) = MatrixXcd::Constant(1, 1, 1.0);
+
+	ChainSolver ring_solver(ring_h, ring_v);
+	ChainSolver dense_ring_solver(ring_h, ring_v);
+
+	dense_ring_solver.block_decimation = false;
+
+	ring_solver.compute(SurfaceGreensMatrix);
+	dense_ring_solver.compute(SurfaceGreensMatrix);
+
+	const MatrixXcd G_ring = ring_solver.greensMatrix();
+
+	assert_function("The GreensFormalism::ChainSolver decimated a layer block wise although it was not block tridiagonal.", G_ring.isApprox(dense_ring_solver.greensMatrix().matrix(), 1e-8));
+
+	assert_function("The GreensFormalism::ChainSolver surface greens matrix of a layer with a corner coupling inside did not satisfy the Dyson equation.", (G_ring * (ring - ring_v.matrix() * G_ring * ring_v.matrix().adjoint()) - MatrixXcd::Identity(n, n)).norm() < 1e-8);
+}
+
+void test_principal_layer(std::function<void(std::string, bool)> assert_function) {
+
+	// a nearest neighbour chain of 2x2 cells, given as a needlessly thick layer of 3 cells.
+	MatrixXcd t0 = MatrixXcd::Random(2, 2);
+	MatrixXcd t1 = MatrixXcd::Random(2, 2);
+
+	t0 = (MatrixXcd::Identity(2, 2) * std::complex<double>(0.3, 0.01) - t0 - t0.adjoint()).eval();
+
+	MatrixXcd h = MatrixXcd::Zero(6, 6), v = MatrixXcd::Zero(6, 6);
+
+	for (int c = 0; c < 3; c++)
+		h.block(2 * c, 2 * c, 2, 2) = t0;
+
+	for (int c = 0; c < 2; c++)
+	{
+		h.block(2 * c, 2 * c + 2, 2, 2) = t1;
+		h.block(2 * c + 2, 2 * c, 2, 2) = t1.adjoint();
+	}
+
+	v.block(4, 0, 2, 2) = t1;
+
+	PrincipalLayer layer(h, v);
+
+	assert_function("The GreensFormalism::PrincipalLayer did not find the 2x2 cells and nearest neighbour range of a 3 cell layer.", layer.cellSize() == 2 && layer.cellCount() == 3 && layer.range() == 1 && layer.minimalHamiltonian().rows() == 2);
+
+	ChainSolver minimal = layer.chain();
+	ChainSolver thick(h, v);
+
+	minimal.compute(SurfaceGreensMatrix);
+	thick.compute(SurfaceGreensMatrix);
+
+	assert_function("The GreensFormalism::PrincipalLayer did not map the minimal surface greens matrix back to the 3 cell layer.", layer.surfaceGreensMatrix(minimal.greensMatrix()).isApprox(thick.greensMatrix().matrix(), 1e-8));
+}
+
+void test_chain_warm_start(std::function<void(std::string, bool)> assert_function) {
+
+	// the surface greens matrix at the next point of an energy sweep, from the previous one.
+	MatrixXcd h = MatrixXcd::Random(4, 4);
+	MatrixXcd v = MatrixXcd::Random(4, 4);
+
+	h += h.adjoint().eval();
+
+	MatrixXcd previous = MatrixXcd::Identity(4, 4) * std::complex<double>(0.30, 0.05) - h;
+	MatrixXcd next = MatrixXcd::Identity(4, 4) * std::complex<double>(0.31, 0.05) - h;
+
+	ChainSolver previous_solver(previous, v);
+	ChainSolver decimation(next, v);
+	ChainSolver warm(next, v);
+	ChainSolver fallback(next, v);
+
+	previous_solver.compute(SurfaceGreensMatrix);
+	decimation.compute(SurfaceGreensMatrix);
+
+	warm.setInitialGuess(previous_solver.greensMatrix());
+	warm.compute(SurfaceGreensMatrix);
+
+	assert_function("The GreensFormalism::ChainSolver warm start did not converge to the decimated surface greens matrix.", warm.warmStartIterations() > 0 && warm.greensMatrix().matrix().isApprox(decimation.greensMatrix().matrix(), 1e-8));
+
+	fallback.max_warm_start_iterations = 1;
+	fallback.setInitialGuess(previous_solver.greensMatrix());
+	fallback.compute(SurfaceGreensMatrix);
+
+	assert_function("The GreensFormalism::ChainSolver did not fall back to the decimation when the warm start did not converge.", fallback.warmStartIterations() == 0 && fallback.greensMatrix().matrix().isApprox(decimation.greensMatrix().matrix(), 1e-8));
+
+	// a uniform chain, g = (z - g)^-1, has the roots (z +- sqrt(z^2 - 4)) / 2 of product one, and only the smaller decays.
+	const std::complex<double> z(0.5, 0.01);
+	const std::complex<double> root = 0.5 * (z + std::sqrt(z * z - 4.0)), other = 0.5 * (z - std::sqrt(z * z - 4.0));
+	const std::complex<double> growing = (std::abs(root) > 1 ? root : other), decaying = (std::abs(root) > 1 ? other : root);
+
+	ChainSolver chain(MatrixXcd(MatrixXcd::Identity(2, 2) * z), MatrixXcd(MatrixXcd::Identity(2, 2)));
+
+	chain.setInitialGuess(MatrixXcd::Identity(2, 2) * growing);
+	chain.compute(SurfaceGreensMatrix);
+
+	assert_function("The GreensFormalism::ChainSolver warm start accepted the root of a uniform chain which grows into the chain.", chain.warmStartIterations() == 0 && chain.greensMatrix().matrix().isApprox(MatrixXcd::Identity(2, 2) * decaying, 1e-6));
+
+	// the next energy of a sweep is warm started from the stored surface of the previous one.
+	SurfaceGreensCache cache;
+
+	cache.surfaceGreensMatrix(BlockMatrixXcd(previous), BlockMatrixXcd(v));
+
+	const MatrixXcd cached = cache.surfaceGreensMatrix(BlockMatrixXcd(next), BlockMatrixXcd(v));
+
+	assert_function("The GreensFormalism::SurfaceGreensCache did not warm start a miss from the nearest stored lead.", cache.misses() == 2 && cache.warmStarts() == 1 && cached.isApprox(decimation.greensMatrix().matrix(), 1e-8));
+}
+
+void test_chain_all_greens(std::function<void(std::string, bool)> assert_function) {
+
+	// a corner coupled lead of three 2x2 cells, decimated block wise and densely.
+	ArrayXi sizes = Array3i(2, 2, 2);
+	BlockMatrixXcd h = random_hermitian(sizes);
+	BlockMatrixXcd v = h.asZero();
+
+	h = (MatrixXcd::Identity(6, 6) * std::complex<double>(0.3, 0.05) - h.matrix()).eval();
+	h.setBlocks(sizes);
+
+	v.block(2, 0) = MatrixXcd::Random(2, 2);
+
+	ChainSolver block_solver(h, v);
+	ChainSolver dense_solver(h, v);
+
+	dense_solver.block_decimation = false;
+
+	block_solver.compute(AllGreensMatrices);
+	dense_solver.compute(AllGreensMatrices);
+
+	const MatrixXcd left = dense_solver.greensMatrix();
+	const MatrixXcd right = dense_solver.rightSurfaceGreensMatrix();
+	const MatrixXcd bulk = dense_solver.bulkGreensMatrix();
+
+	const MatrixXcd sigma_left = v.matrix() * left * v.matrix().adjoint();
+	const MatrixXcd sigma_right = v.matrix().adjoint() * right * v.matrix();
+
+	assert_function("The GreensFormalism::ChainSolver left and right surface greens matrices did not satisfy their Dyson equations.", left.isApprox((h.matrix() - sigma_left).inverse(), 1e-8) && right.isApprox((h.matrix() - sigma_right).inverse(), 1e-8));
+
+	assert_function("The GreensFormalism::ChainSolver bulk greens matrix was not the layer coupled to both surfaces.", bulk.isApprox((h.matrix() - sigma_left - sigma_right).inverse(), 1e-8));
+
+	assert_function("The GreensFormalism::ChainSolver block decimation did not agree with the dense decimation on all greens matrices.", block_solver.greensMatrix().matrix().isApprox(left, 1e-8) && block_solver.rightSurfaceGreensMatrix().matrix().isApprox(right, 1e-8) && block_solver.bulkGreensMatrix().matrix().isApprox(bulk, 1e-8));
+}
+
+void test_complex_band_structure(std::function<void(std::string, bool)> assert_function) {
+
+	// a chain with hopping -1 and a side coupled orbital, E + 2 cos k = g^2 / (E - e).
+	const double g = 0.4, e = 1.5, E = 0.5;
+
+	MatrixXcd h = MatrixXcd::Zero(2, 2), v = MatrixXcd::Zero(2, 2);
+
+	h(0, 1) = h(1, 0) = g;
+	h(1, 1) = e;
+	v(0, 0) = -1;
+
+	ComplexBandStructure bands(h, v);
+
+	bands.compute(E);
+
+	const double k = std::acos(- (E - g * g / (E - e)) / 2);
+	const double speed = 2 * std::sin(k) / (1 + g * g / ((E - e) * (E - e)));
+
+	assert_function("The GreensFormalism::ComplexBandStructure did not find the two propagating modes of a side coupled chain.", bands.propagatingModeCount() == 2 && bands.channelCount() == 1 && std::abs(std::abs(bands.propagatingWavenumbers()[0]) - k) < 1e-8);
+
+	assert_function("The GreensFormalism::ComplexBandStructure did not find the group velocity of a side coupled chain.", std::abs(bands.velocities().cwiseAbs().maxCoeff() - speed) < 1e-8 && std::abs(bands.velocities().sum()) < 1e-8);
+
+	bands.compute(3.0);
+
+	assert_function("The GreensFormalism::ComplexBandStructure found propagating modes outside the band.", bands.propagatingModeCount() == 0 && bands.blochFactors().size() == 2);
+
+	// two identical chains give degenerate modes.
+	ComplexBandStructure degenerate(MatrixXcd::Zero(2, 2), - MatrixXcd::Identity(2, 2));
+
+	degenerate.compute(E);
+
+	assert_function("The GreensFormalism::ComplexBandStructure did not separate the velocities of degenerate modes.", degenerate.channelCount() == 2 && (degenerate.velocities().cwiseAbs().array() - 2 * std::sin(std::acos(- E / 2))).abs().maxCoeff() < 1e-8);
+}
+
+void test_numa_placement(std::function<void(std::string, bool)> assert_function) {
+
+	// a sysfs tree with a gap in the node ids and a node with memory but no cores.
+	char root[] = "/tmp/numa_nodesXXXXXX";
+
+	if (::mkdtemp(root) == nullptr)
+		return;
+
+	const std::string nodes = root;
+	const std::string lists[3][2] = { { "node0", "0-1" }, { "node1", "" }, { "node3", "2,3" } };
+
+	for (auto &node : lists)
+	{
+		::mkdir((nodes + "/" + node[0]).c_str(), 0700);
+		std::ofstream(nodes + "/" + node[0] + "/cpulist") << node[1] << "\n";
+	}
+
+	const NumaTopology topology(nodes);
+
+	for (auto &node : lists)
+	{
+		std::remove((nodes + "/" + node[0] + "/cpulist").c_str());
+		std::remove((nodes + "/" + node[0]).c_str());
+	}
+
+	std::remove(nodes.c_str());
+
+	assert_function("The NumaTopology did not keep every node of a sysfs tree with gaps and a node without cores.", topology.nodeCount() == 3 && topology.cpuCount() == 4 && topology.nodeId(2) == 3 && topology.nodeCpus(1).empty());
+	assert_function("The NumaTopology did not skip the node without cores for pinning.", topology.cpuNodes() == std::vector<long>({ 0, 2 }) && !topology.pinToNode(1));
+
+	// the placement never changes the surface solution.
+	ArrayXi sizes = Array2i(2, 2);
+	BlockMatrixXcd h = random_hermitian(sizes);
+	BlockMatrixXcd v = random_hermitian(sizes);
+
+	h = (MatrixXcd::Identity(4, 4) * std::complex<double>(0.2, 0.01) - h.matrix()).eval();
+	h.setBlocks(sizes);
+
+	ChainSolver reference(h, v);
+	reference.compute(SurfaceGreensMatrix);
+
+	bool equal = true;
+
+	for (const NumaPolicy &policy : { NumaInterleave, NumaPartition, NumaLocal })
+	{
+		ChainSolver solver(h, v);
+
+		solver.setNumaPolicy(policy);
+		solver.compute(SurfaceGreensMatrix);
+
+		equal = equal && (solver.greensMatrix().matrix() - reference.greensMatrix().matrix()).norm() < 1e-12;
+	}
+
+	assert_function("The GreensFormalism::ChainSolver changed its result with a NUMA policy.", equal);
+
+	// two observers pin the workers of one arena independently, and restore them when destroyed.
+	cpu_set_t original;
+	sched_getaffinity(0, sizeof(cpu_set_t), &original);
+
+	{
+		tbb::task_arena arena(2);
+		NumaThreadPinning compact(arena), scatter(arena, true);
+
+		arena.execute([]() { tbb::parallel_for(0, 1000, [](const int &) { }); });
+
+		assert_function("The NumaThreadPinning observers pinned more threads than there are cores.", compact.pinnedCount() <= NumaTopology().cpuCount() && scatter.pinnedCount() <= NumaTopology().cpuCount());
+	}
+
+	std::atomic<bool> restored(true);
+
+	tbb::parallel_for(0, 1000, [&](const int &) {
+		cpu_set_t current;
+		restored = restored && sched_getaffinity(0, sizeof(cpu_set_t), &current) == 0 && CPU_EQUAL(&current, &original);
+	});
+
+	assert_function("The NumaThreadPinning observers left a worker pinned after they were destroyed.", restored);
+}
+
+void test_two_lead_coupling_orientation(std::function<void(std::string, bool)> assert_function) {
+
+	// single orbital leads on a device of three 2 orbital blocks, where the couplings v_l (1x2) and v_r (2x1) are not square.
+	ArrayXi sizes(7);
+	sizes << 1, 1, 2, 2, 2, 1, 1;
+
+	const std::complex<double> z(-0.5, 1e-9);
+
+	BlockMatrixXcd device = MatrixXcd(MatrixXcd::Zero(10, 10));
+	device.setBlocks(sizes);
+
+	device.diagonal().setConstant(z);
+	device.diagonal().segment(2, 6) -= Eigen::VectorXcd::LinSpaced(6, -0.4, 0.6);
+
+	device(0, 1) = device(1, 0) = 1.0;
+	device(8, 9) = device(9, 8) = 1.0;
+
+	// the left lead reaches both orbitals of the first block, the right lead only the second orbital of the last.
+	device(1, 2) = device(2, 1) = 1.0;
+	device(1, 3) = device(3, 1) = 0.5;
+	device(7, 8) = device(8, 7) = 0.8;
+
+	device(2, 3) = device(3, 2) = 0.7;
+	device(3, 4) = device(4, 3) = 0.9;
+	device(2, 5) = device(5, 2) = 0.3;
+	device(4, 5) = device(5, 4) = 0.6;
+	device(5, 6) = device(6, 5) = 1.1;
+	device(6, 7) = device(7, 6) = 0.4;
+
+	LanduarFormalism::TwoLeadTransportSolver forward(device), backward(device);
+
+	forward.setLeftLeadBlockCount(1);
+	forward.setRightLeadBlockCount(1);
+	forward.compute(LanduarFormalism::LeftToRight);
+
+	backward.setLeftLeadBlockCount(1);
+	backward.setRightLeadBlockCount(1);
+	backward.compute(LanduarFormalism::RightToLeft);
+
+	// the reference assembles sigma_l = v_l* g_l v_l and sigma_r = v_r g_r v_r* on the dense device.
+	const MatrixXcd lead_h = MatrixXcd::Constant(1, 1, z), lead_v = MatrixXcd::Constant(1, 1, 1.0);
+
+	ChainSolver lead(lead_h, lead_v);
+
+	lead.compute(SurfaceGreensMatrix);
+
+	const MatrixXcd v_l = device.matrix().block(1, 2, 1, 6), v_r = device.matrix().block(2, 8, 6, 1);
+	const MatrixXcd sigma_l = v_l.adjoint() * lead.greensMatrix().matrix() * v_l;
+	const MatrixXcd sigma_r = v_r * lead.greensMatrix().matrix() * v_r.adjoint();
+
+	const MatrixXcd G = (device.matrix().block(2, 2, 6, 6) - sigma_l - sigma_r).inverse();
+	const std::complex<double> i_unit(0, 1);
+
+	const double expected = (i_unit * (sigma_r - sigma_r.adjoint()) * G * i_unit * (sigma_l - sigma_l.adjoint()) * G.adjoint()).trace().real();
+
+	assert_function("The LanduarFormalism::TwoLeadTransportSolver did not couple the leads by v_l* and v_r from left to right.", expected > 0.1 && std::abs(forward.transmission() - expected) < 1e-6);
+	assert_function("The LanduarFormalism::TwoLeadTransportSolver did not couple the leads by v_l* and v_r from right to left.", std::abs(backward.transmission() - expected) < 1e-6);
+}
+
 void test_all(std::function<void(std::string,bool)> assert_function) {
 
 	std::cout << "GreensFormalism unittesting: test_full_greens_inversion() ?" << std::endl;
@@ -120,11 +723,83 @@ void test_all(std::function<void(std::string,bool)> assert_function) {
 
 	std::cout << std::endl;
 
+	std::cout << "GreensFormalism unittesting: test_planned_greens_inversion() ?" << std::endl;
+	test_planned_greens_inversion(assert_function);
+	std::cout << "Done! [GreensFormalism unittesting: test_planned_greens_inversion()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "GreensFormalism unittesting: test_tuned_greens_inversion() ?" << std::endl;
+	test_tuned_greens_inversion(assert_function);
+	std::cout << "Done! [GreensFormalism unittesting: test_tuned_greens_inversion()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "GreensFormalism unittesting: test_hierarchical_greens_inversion() ?" << std::endl;
+	test_hierarchical_greens_inversion(assert_function);
+	std::cout << "Done! [GreensFormalism unittesting: test_hierarchical_greens_inversion()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "GreensFormalism unittesting: test_sparse_greens_inversion() ?" << std::endl;
+	test_sparse_greens_inversion(assert_function);
+	std::cout << "Done! [GreensFormalism unittesting: test_sparse_greens_inversion()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "GreensFormalism unittesting: test_batched_greens_inversion() ?" << std::endl;
+	test_batched_greens_inversion(assert_function);
+	std::cout << "Done! [GreensFormalism unittesting: test_batched_greens_inversion()]" << std::endl;
+
+	std::cout << std::endl;
+
 	std::cout << "GreensFormalism unittesting: test_chain_surface_greens() ?" << std::endl;
 	test_chain_surface_greens(assert_function);
 	std::cout << "Done! [GreensFormalism unittesting: test_chain_surface_greens()]" << std::endl;
 
 	std::cout << std::endl;
+
+	std::cout << "GreensFormalism unittesting: test_chain_block_decimation() ?" << std::endl;
+	test_chain_block_decimation(assert_function);
+	std::cout << "Done! [GreensFormalism unittesting: test_chain_block_decimation()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "GreensFormalism unittesting: test_principal_layer() ?" << std::endl;
+	test_principal_layer(assert_function);
+	std::cout << "Done! [GreensFormalism unittesting: test_principal_layer()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "GreensFormalism unittesting: test_chain_warm_start() ?" << std::endl;
+	test_chain_warm_start(assert_function);
+	std::cout << "Done! [GreensFormalism unittesting: test_chain_warm_start()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "GreensFormalism unittesting: test_chain_all_greens() ?" << std::endl;
+	test_chain_all_greens(assert_function);
+	std::cout << "Done! [GreensFormalism unittesting: test_chain_all_greens()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "GreensFormalism unittesting: test_complex_band_structure() ?" << std::endl;
+	test_complex_band_structure(assert_function);
+	std::cout << "Done! [GreensFormalism unittesting: test_complex_band_structure()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "GreensFormalism unittesting: test_numa_placement() ?" << std::endl;
+	test_numa_placement(assert_function);
+	std::cout << "Done! [GreensFormalism unittesting: test_numa_placement()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "GreensFormalism unittesting: test_two_lead_coupling_orientation() ?" << std::endl;
+	test_two_lead_coupling_orientation(assert_function);
+	std::cout << "Done! [GreensFormalism unittesting: test_two_lead_coupling_orientation()]" << std::endl;
+
+	std::cout << std::endl;
 }
 
 } /* namespace UnitTesting */
@@ -0,0 +1,19 @@
+#include "LanduarFormalismUnittesting.hpp"
+
+using namespace QuantumMechanics::LanduarFormalism;
+
+int main()
+{
+	std::function<void(std::string,bool)> assert_function = [&](std::string msg, bool assessment)
+	{
+		if(assessment == true)
+			return;
+		
+		std::cout << "Assessment failed! Message:" << msg << std::endl;
+	};
+	
+    std::cout << "Starting LanduarFormalism Unittesting:" << std::endl << std::endl;
+	Unittesting::test_all(assert_function);
+    std::cout  << std::endl << "Done with LanduarFormalism Unittesting!" << std::endl;
+    return 0;
+}
\ No newline at end of file
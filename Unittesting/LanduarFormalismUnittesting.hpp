@@ -0,0 +1,469 @@
+#ifndef LANDUARFORMALISM_UNITTESTING_H_
+#define LANDUARFORMALISM_UNITTESTING_H_
+
+#include <QuantumMechanics/LanduarFormalism/TwoLeadTransportSolver>
+#include <QuantumMechanics/LanduarFormalism/EnergyGrid>
+#include <QuantumMechanics/LanduarFormalism/NambuTransportSolver>
+#include <QuantumMechanics/LanduarFormalism/PeierlsHamiltonian>
+#include <QuantumMechanics/LanduarFormalism/Thermoelectrics>
+
+namespace QuantumMechanics {
+
+namespace LanduarFormalism {
+
+namespace Unittesting {
+
+	BlockMatrixXcd chain_hamilton(long n) {
+		BlockMatrixXcd result = MatrixXcd(MatrixXcd::Zero(n, n));
+		for (long i = 0; i + 1 < n; i++)
+			result(i, i + 1) = result(i + 1, i) = -1.0;
+		result.setBlocks(ArrayXi::Ones(n));
+		return result;
+	}
+
+	// (E + i eta) - H of an SSH chain of cells (a, b), with t_1 from a to b and t_2 from b to the next a.
+	BlockMatrixXcd ssh_argument(long cells, double E, double eta, double t_1, double t_2) {
+		const long n = 2 * cells;
+		BlockMatrixXcd result = MatrixXcd(MatrixXcd::Identity(n, n) * std::complex<double>(E, eta));
+		for (long c = 0; c < cells; c++)
+		{
+			result(2 * c, 2 * c + 1) = result(2 * c + 1, 2 * c) = t_1;
+			if (c + 1 < cells)
+				result(2 * c + 1, 2 * c + 2) = result(2 * c + 2, 2 * c + 1) = t_2;
+		}
+		result.setBlocks(ArrayXi::Constant(cells, 2));
+		return result;
+	}
+
+void test_two_lead_transport(std::function<void(std::string, bool)> assert_function) {
+
+	// the cells couple by the non-hermitian hopping v = [0 0; t_2 0], and a uniform chain transmits its one channel fully.
+	// at E = t_1 a single cell is singular, and the decimation of the leads loses the sign of eta.
+	const BlockMatrixXcd ssh = ssh_argument(9, 1.2, 1e-9, 1.0, 0.6);
+
+	TwoLeadTransportSolver left_to_right(ssh), right_to_left(ssh), cached(ssh);
+
+	left_to_right.setLeftLeadBlockCount(1);
+	left_to_right.setRightLeadBlockCount(1);
+	left_to_right.compute(LeftToRight);
+
+	right_to_left.setLeftLeadBlockCount(1);
+	right_to_left.setRightLeadBlockCount(1);
+	right_to_left.compute(RightToLeft);
+
+	assert_function("The LanduarFormalism::TwoLeadTransportSolver did not transmit the channel of a uniform SSH chain from left to right.", std::abs(left_to_right.transmission() - 1) < 1e-6);
+	assert_function("The LanduarFormalism::TwoLeadTransportSolver did not transmit the channel of a uniform SSH chain from right to left.", std::abs(right_to_left.transmission() - 1) < 1e-6);
+
+	// the cache decimates both leads separately.
+	GreensFormalism::SurfaceGreensCache cache;
+
+	cached.setSurfaceCache(&cache);
+	cached.setLeftLeadBlockCount(1);
+	cached.setRightLeadBlockCount(1);
+	cached.compute(LeftToRight);
+
+	assert_function("The LanduarFormalism::TwoLeadTransportSolver did not transmit the channel of a uniform SSH chain with cached leads.", std::abs(cached.transmission() - 1) < 1e-6 && cache.misses() == 2);
+
+	// inside the gap, |E| < |t_1 - t_2|, nothing is transmitted.
+	TwoLeadTransportSolver gap(ssh_argument(9, 0.2, 1e-9, 1.0, 0.6));
+
+	gap.setLeftLeadBlockCount(1);
+	gap.setRightLeadBlockCount(1);
+	gap.compute(LeftToRight);
+
+	assert_function("The LanduarFormalism::TwoLeadTransportSolver transmitted inside the gap of a uniform SSH chain.", std::abs(gap.transmission()) < 1e-6);
+
+}
+
+void test_energy_grid(std::function<void(std::string, bool)> assert_function) {
+
+	// a two-leg ladder has the subbands +-1 - 2 cos(k), i.e. thresholds at -3, -1, 1 and 3.
+	MatrixXcd h(2, 2), v = -MatrixXcd::Identity(2, 2);
+	h << 0, 1, 1, 0;
+
+	EnergyGrid ladder(-3.5, 3.5);
+	//ladder.enableLog();
+
+	ladder.addLead(h, v);
+
+	const std::vector<double> &edges = ladder.thresholds();
+
+	bool found = edges.size() == 4;
+
+	for (std::size_t t = 0; found && t < edges.size(); t++)
+		found = std::abs(edges[t] - (2.0 * t - 3.0)) < 1e-10;
+
+	assert_function("The LanduarFormalism::EnergyGrid did not find the four subband thresholds of a two-leg ladder.", found);
+
+	// a smooth function is refined until the linear interpolation is accurate.
+	EnergyGrid smooth(-3, 3);
+
+	smooth.coarse_count = 8;
+	smooth.compute([](const double &E) { return std::exp(- E * E); }, 1e-4);
+
+	const std::vector<double> &x = smooth.energies();
+	const std::vector<double> &y = smooth.values();
+
+	double error = 0;
+
+	for (std::size_t i = 0; i + 1 < x.size(); i++)
+	{
+		const double m = 0.5 * (x[i] + x[i + 1]);
+		error = std::max(error, std::abs(std::exp(- m * m) - 0.5 * (y[i] + y[i + 1])));
+	}
+
+	assert_function("The LanduarFormalism::EnergyGrid did not refine a gaussian to the tolerance.", error < 1e-4 && x.size() < 500);
+
+	// the perfect chain transmits one channel inside the band, and the steps at +-2 are resolved.
+	const BlockMatrixXcd H = chain_hamilton(8);
+
+	EnergyGrid grid(-2.7, 3.1);
+
+	grid.addLeads(H);
+	grid.compute(EnergyGrid::transmissionFunction(H), 1e-3, 400);
+
+	bool transmits = grid.thresholds().size() == 2;
+	double closest = 1;
+
+	for (std::size_t i = 0; i < grid.energies().size(); i++)
+	{
+		const double E = grid.energies()[i];
+		const double T = grid.values()[i];
+
+		if (std::abs(std::abs(E) - 2) > 1e-3)
+			transmits = transmits && std::abs(T - (std::abs(E) < 2 ? 1.0 : 0.0)) < 1e-6;
+
+		closest = std::min(closest, std::abs(E - 2));
+	}
+
+	assert_function("The LanduarFormalism::EnergyGrid sweep of a perfect chain did not give the steps at the band edges.", transmits && closest < 1e-4);
+}
+
+void test_symmetry_sector_transport(std::function<void(std::string, bool)> assert_function) {
+
+	// a spinful chain in a field along x, whose spin sectors are the eigenstates of sigma_x.
+	const long n = 8;
+
+	BlockMatrixXcd H = MatrixXcd(MatrixXcd::Zero(2 * n, 2 * n));
+
+	for (long i = 0; i < n; i++)
+	{
+		H(2 * i, 2 * i + 1) = H(2 * i + 1, 2 * i) = 0.4;
+
+		if (i + 1 < n)
+			for (long spin = 0; spin < 2; spin++)
+				H(2 * i + spin, 2 * i + 2 + spin) = H(2 * i + 2 + spin, 2 * i + spin) = -1.0;
+	}
+
+	H.setBlocks(ArrayXi::Constant(n, 2));
+
+	MatrixXcd U(2, 2);
+	U << 1, 1, 1, -1;
+	U /= std::sqrt(2.0);
+
+	bool equal = true;
+
+	for (const double E : {-2.1, -0.7, 0.3, 1.9})
+	{
+		BlockMatrixXcd argument = MatrixXcd(MatrixXcd::Identity(2 * n, 2 * n) * std::complex<double>(E, 1e-8) - H);
+		argument.withBlocks(H);
+
+		TwoLeadTransportSolver whole(argument), split(argument);
+
+		whole.setLeftLeadBlockCount(1);
+		whole.setRightLeadBlockCount(1);
+		whole.compute(LeftToRight);
+
+		split.setLeftLeadBlockCount(1);
+		split.setRightLeadBlockCount(1);
+		split.setSymmetrySectors(true, std::vector<MatrixXcd>(1, U));
+		split.compute(LeftToRight);
+
+		// the sectors are shifted by -+0.4, so both transmit inside |E| < 1.6.
+		const double expected = (std::abs(E - 0.4) < 2 ? 1.0 : 0.0) + (std::abs(E + 0.4) < 2 ? 1.0 : 0.0);
+
+		equal = equal && std::abs(whole.transmission() - expected) < 1e-6 && std::abs(split.transmission() - expected) < 1e-6;
+	}
+
+	assert_function("The LanduarFormalism::TwoLeadTransportSolver did not give the same transmission from the spin sectors.", equal);
+
+	// a hopping a_i - b_(i+1) and b_i - a_(i+1) splits the finite matrix in two, but no sector holds the same orbital in both lead layers.
+	BlockMatrixXcd swapped = MatrixXcd(MatrixXcd::Zero(2 * n, 2 * n));
+
+	for (long i = 0; i < n; i++)
+	{
+		swapped(2 * i, 2 * i) = 0.5;
+		swapped(2 * i + 1, 2 * i + 1) = -0.5;
+
+		if (i + 1 < n)
+		{
+			swapped(2 * i, 2 * i + 3) = swapped(2 * i + 3, 2 * i) = -1.0;
+			swapped(2 * i + 1, 2 * i + 2) = swapped(2 * i + 2, 2 * i + 1) = -1.0;
+		}
+	}
+
+	swapped.setBlocks(ArrayXi::Constant(n, 2));
+
+	equal = true;
+
+	for (const double E : {0.2, -1.5})
+	{
+		BlockMatrixXcd argument = MatrixXcd(MatrixXcd::Identity(2 * n, 2 * n) * std::complex<double>(E, 1e-8) - swapped);
+		argument.withBlocks(swapped);
+
+		TwoLeadTransportSolver whole(argument), split(argument);
+
+		whole.setLeftLeadBlockCount(1);
+		whole.setRightLeadBlockCount(1);
+		whole.compute(LeftToRight);
+
+		split.setLeftLeadBlockCount(1);
+		split.setRightLeadBlockCount(1);
+		split.setSymmetrySectors(true);
+		split.compute(LeftToRight);
+
+		equal = equal && std::abs(whole.transmission() - split.transmission()) < 1e-8;
+	}
+
+	assert_function("The LanduarFormalism::TwoLeadTransportSolver split a chain whose sectors swap orbitals between the lead layers.", equal);
+}
+
+	// a Bogoliubov-de Gennes chain of n sites, with pairing delta on all but the two lead layers at each end.
+	BlockMatrixXcd nambu_chain_hamilton(long n, double mu, double delta) {
+		BlockMatrixXcd result = MatrixXcd(MatrixXcd::Zero(2 * n, 2 * n));
+		for (long i = 0; i < n; i++)
+		{
+			result(2 * i, 2 * i) = - mu;
+			result(2 * i + 1, 2 * i + 1) = mu;
+			if (i >= 2 && i < n - 2)
+				result(2 * i, 2 * i + 1) = result(2 * i + 1, 2 * i) = delta;
+			if (i + 1 < n)
+			{
+				result(2 * i, 2 * i + 2) = result(2 * i + 2, 2 * i) = -1.0;
+				result(2 * i + 1, 2 * i + 3) = result(2 * i + 3, 2 * i + 1) = 1.0;
+			}
+		}
+		result.setBlocks(ArrayXi::Constant(n, 2));
+		return result;
+	}
+
+void test_nambu_transport(std::function<void(std::string, bool)> assert_function) {
+
+	// without pairing the electrons pass the chain and nothing is Andreev reflected.
+	NambuTransportSolver normal(nambu_chain_hamilton(12, 0.5, 0.0));
+
+	normal.compute(0.2);
+
+	assert_function("The LanduarFormalism::NambuTransportSolver of a normal chain did not transmit one electron channel.", normal.isParticleHoleSymmetric() && std::abs(normal.normalTransmission() - 1) < 1e-6 && normal.andreevReflection() < 1e-10 && normal.electronChannelCount() == 1);
+
+	// inside the gap of a long superconductor an electron is reflected, partly as a hole.
+	NambuTransportSolver solver(nambu_chain_hamilton(80, 0.5, 0.3));
+
+	solver.compute(0.1);
+
+	const double R_he = solver.andreevReflection();
+	const double total = solver.normalReflection() + R_he;
+
+	solver.compute(-0.1);
+
+	assert_function("The LanduarFormalism::NambuTransportSolver did not reflect an electron at a superconductor inside the gap.", solver.isParticleHoleSymmetric() && R_he > 1e-3 && std::abs(total - 1) < 1e-6 && solver.normalTransmission() + solver.crossedAndreevTransmission() < 1e-6);
+
+	assert_function("The LanduarFormalism::NambuTransportSolver did not reuse the electron surfaces at the opposite energy.", solver.cachedSurfaceCount() == 2);
+
+	// the hole surfaces from particle-hole symmetry equal a decimation of the whole lead.
+	const BlockMatrixXcd H = nambu_chain_hamilton(12, 0.5, 0.0);
+	const double E = 0.7;
+
+	BlockMatrixXcd h = MatrixXcd(MatrixXcd::Identity(2, 2) * std::complex<double>(E, 1e-8) - H.block(0, 0));
+	BlockMatrixXcd v = MatrixXcd(- H.block(1, 0));
+
+	h.setBlocks(ArrayXi::Constant(1, 2));
+	v.setBlocks(ArrayXi::Constant(1, 2));
+
+	GreensFormalism::ChainSolver chain(h, v);
+
+	chain.compute(GreensFormalism::SurfaceGreensMatrix);
+
+	BlockMatrixXcd h_e = MatrixXcd(MatrixXcd::Constant(1, 1, std::complex<double>(- E, 1e-8)) - H.block(0, 0).topLeftCorner(1, 1));
+	BlockMatrixXcd v_e = MatrixXcd(- H.block(1, 0).topLeftCorner(1, 1));
+
+	h_e.setBlocks(ArrayXi::Ones(1));
+	v_e.setBlocks(ArrayXi::Ones(1));
+
+	GreensFormalism::ChainSolver electrons(h_e, v_e);
+
+	electrons.compute(GreensFormalism::SurfaceGreensMatrix);
+
+	assert_function("The LanduarFormalism::NambuTransportSolver hole surface -conj(g_e(-E)) did not match the decimated hole lead.", std::abs(chain.greensMatrix()(1, 1) + std::conj(electrons.greensMatrix()(0, 0))) < 1e-8);
+}
+
+void test_peierls_hamiltonian(std::function<void(std::string, bool)> assert_function) {
+
+	// the flux through a unit plaquette is the same in both gauges.
+	MatrixXd corners(4, 2);
+	corners << 0, 0, 1, 0, 1, 1, 0, 1;
+
+	BlockMatrixXcd ring = MatrixXcd(MatrixXcd::Zero(4, 4));
+
+	for (long i = 0; i < 4; i++)
+		ring(i, (i + 1) % 4) = ring((i + 1) % 4, i) = -1.0;
+
+	ring.setBlocks(ArrayXi::Constant(1, 4));
+
+	bool flux = true;
+
+	for (const MagneticGauge gauge : {LandauGauge, SymmetricGauge})
+	{
+		PeierlsHamiltonian peierls(ring, corners, gauge);
+
+		peierls.setField(0.1);
+
+		const BlockMatrixXcd &H = peierls.hamilton();
+
+		const std::complex<double> loop = H(0, 1) * H(1, 2) * H(2, 3) * H(3, 0);
+
+		flux = flux && H.isApprox(H.adjoint()) && std::abs(std::arg(loop) + 0.2 * std::acos(-1.0)) < 1e-12;
+	}
+
+	assert_function("The LanduarFormalism::PeierlsHamiltonian did not give the flux of a plaquette in both gauges.", flux);
+
+	// a ribbon of width 3 along x, with leads of 2 layers on each side of 4 device layers.
+	const long width = 3, layers = 8;
+
+	BlockMatrixXcd ribbon = MatrixXcd(MatrixXcd::Zero(width * layers, width * layers));
+	MatrixXd positions(width * layers, 2);
+
+	for (long x = 0; x < layers; x++)
+		for (long y = 0; y < width; y++)
+		{
+			const long i = x * width + y;
+
+			positions(i, 0) = x;
+			positions(i, 1) = y;
+
+			if (y + 1 < width)
+				ribbon(i, i + 1) = ribbon(i + 1, i) = -1.0;
+
+			if (x + 1 < layers)
+				ribbon(i, i + width) = ribbon(i + width, i) = -1.0;
+		}
+
+	ribbon.setBlocks(ArrayXi::Constant(layers, width));
+
+	PeierlsHamiltonian peierls(ribbon, positions);
+
+	// the same matrix is updated in place for every field.
+	peierls.setField(0.13);
+
+	const double T = EnergyGrid::transmissionFunction(peierls.hamilton())(0.5);
+
+	BlockMatrixXcd argument = MatrixXcd(MatrixXcd::Identity(width * layers, width * layers) * std::complex<double>(0.5, 1e-8) - peierls.hamilton());
+
+	peierls.setField(1.13);
+
+	const double T_periodic = EnergyGrid::transmissionFunction(peierls.hamilton())(0.5);
+
+	peierls.applyField(0.0, argument, -1.0);
+	peierls.setField(0.0);
+
+	const MatrixXcd expected = MatrixXcd::Identity(width * layers, width * layers) * std::complex<double>(0.5, 1e-8) - peierls.hamilton();
+
+	assert_function("The LanduarFormalism::PeierlsHamiltonian transmission of a ribbon was not periodic in one flux quantum per plaquette.", std::abs(T - T_periodic) < 1e-8 && peierls.patternSize() == 2 * width * (layers - 1) - 2 * (layers - 1));
+
+	assert_function("The LanduarFormalism::PeierlsHamiltonian did not update an argument in place.", argument.isApprox(expected) && peierls.hamilton().isApprox(ribbon));
+}
+
+void test_thermoelectrics(std::function<void(std::string, bool)> assert_function) {
+
+	// a linear transmission 1 + a E, for which the Sommerfeld expansion is exact.
+	const double a = 0.2;
+
+	std::vector<double> energies, transmissions;
+
+	for (long k = 0; k <= 4000; k++)
+	{
+		energies.push_back(-2 + k * 1e-3);
+		transmissions.push_back(1 + a * energies.back());
+	}
+
+	Thermoelectrics thermo(energies, transmissions);
+	//thermo.enableLog();
+
+	const std::vector<double> mu = {-0.2, 0.0, 0.3};
+	const std::vector<double> t = {0.02, 0.05};
+
+	thermo.compute(mu, t);
+
+	const MatrixXd G = thermo.conductance(), S = thermo.seebeck(), Pi = thermo.peltier(), kappa = thermo.thermalConductance();
+
+	const double pi = std::acos(-1.0);
+
+	bool sommerfeld = G.rows() == 3 && G.cols() == 2;
+
+	for (long i = 0; i < 3; i++)
+		for (long j = 0; j < 2; j++)
+		{
+			const double L0 = 1 + a * mu[i];
+			const double L1 = a * pi * pi * t[j] * t[j] / 3;
+			const double L2 = L0 * pi * pi * t[j] * t[j] / 3;
+
+			sommerfeld = sommerfeld && std::abs(G(i, j) - L0) < 1e-6;
+			sommerfeld = sommerfeld && std::abs(S(i, j) + L1 / (t[j] * L0)) < 1e-6;
+			sommerfeld = sommerfeld && std::abs(Pi(i, j) - S(i, j) * t[j]) < 1e-12;
+			sommerfeld = sommerfeld && std::abs(kappa(i, j) - (L2 - L1 * L1 / L0) / t[j]) < 1e-6;
+		}
+
+	assert_function("The LanduarFormalism::Thermoelectrics did not reproduce the Sommerfeld moments of a linear transmission.", sommerfeld);
+
+	// at zero temperature only the interpolated conductance remains.
+	thermo.compute({0.0005}, {0.0});
+
+	assert_function("The LanduarFormalism::Thermoelectrics did not interpolate the conductance at zero temperature.", std::abs(thermo.conductance()(0, 0) - (1 + a * 0.0005)) < 1e-12 && thermo.seebeck()(0, 0) == 0);
+}
+
+void test_all(std::function<void(std::string, bool)> assert_function) {
+
+	std::cout << "LanduarFormalism unittesting: test_two_lead_transport() ?" << std::endl;
+	test_two_lead_transport(assert_function);
+	std::cout << "Done! [LanduarFormalism unittesting: test_two_lead_transport()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "LanduarFormalism unittesting: test_energy_grid() ?" << std::endl;
+	test_energy_grid(assert_function);
+	std::cout << "Done! [LanduarFormalism unittesting: test_energy_grid()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "LanduarFormalism unittesting: test_symmetry_sector_transport() ?" << std::endl;
+	test_symmetry_sector_transport(assert_function);
+	std::cout << "Done! [LanduarFormalism unittesting: test_symmetry_sector_transport()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "LanduarFormalism unittesting: test_nambu_transport() ?" << std::endl;
+	test_nambu_transport(assert_function);
+	std::cout << "Done! [LanduarFormalism unittesting: test_nambu_transport()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "LanduarFormalism unittesting: test_peierls_hamiltonian() ?" << std::endl;
+	test_peierls_hamiltonian(assert_function);
+	std::cout << "Done! [LanduarFormalism unittesting: test_peierls_hamiltonian()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "LanduarFormalism unittesting: test_thermoelectrics() ?" << std::endl;
+	test_thermoelectrics(assert_function);
+	std::cout << "Done! [LanduarFormalism unittesting: test_thermoelectrics()]" << std::endl;
+
+	std::cout << std::endl;
+}
+
+} /* namespace UnitTesting */
+
+} /* namespace LanduarFormalism */
+
+} /* namespace QuantumMechanics */
+
+#endif /* LANDUARFORMALISM_UNITTESTING_H_ */
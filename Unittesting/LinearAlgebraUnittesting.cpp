@@ -0,0 +1,19 @@
+#include "LinearAlgebraUnittesting.hpp"
+
+using namespace QuantumMechanics::LinearAlgebra;
+
+int main()
+{
+	std::function<void(std::string,bool)> assert_function = [&](std::string msg, bool assessment)
+	{
+		if(assessment == true)
+			return;
+		
+		std::cout << "Assessment failed! Message:" << msg << std::endl;
+	};
+	
+    std::cout << "Starting LinearAlgebra Unittesting:" << std::endl << std::endl;
+	Unittesting::test_all(assert_function);
+    std::cout  << std::endl << "Done with LinearAlgebra Unittesting!" << std::endl;
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,417 @@
+
+#ifndef LINEARALGEBRA_UNITTESTING_H_
+#define LINEARALGEBRA_UNITTESTING_H_
+
+#include <QuantumMechanics/LinearAlgebra/TiledMatrix>
+#include <QuantumMechanics/LinearAlgebra/TiledLU>
+#include <QuantumMechanics/LinearAlgebra/TiledInverse>
+#include <QuantumMechanics/LinearAlgebra/HierarchicalMatrix>
+#include <QuantumMechanics/LinearAlgebra/LowRankCoupling>
+#include <QuantumMechanics/LinearAlgebra/IndexSelection>
+#include <QuantumMechanics/LinearAlgebra/SparseDirectSolver>
+#include <QuantumMechanics/LinearAlgebra/ComplexProduct>
+#include <QuantumMechanics/LinearAlgebra/HermitianKernels>
+#include <QuantumMechanics/LinearAlgebra/SymmetrySectors>
+
+namespace QuantumMechanics {
+
+namespace LinearAlgebra {
+
+namespace Unittesting {
+
+	MatrixXcd random_greens_argument(long n) {
+		MatrixXcd result = MatrixXcd::Random(n, n);
+		result += result.adjoint().eval();
+		return (MatrixXcd::Identity(n, n) * std::complex<double>(0.5, 0.1) - result);
+	}
+
+void test_out_of_core_inversion(std::function<void(std::string, bool)> assert_function) {
+
+	MatrixXcd M = random_greens_argument(50);
+
+	// 16 does not divide 50, so the last tile row and column are ragged.
+	TiledMatrix A(50, 16);
+	TiledMatrix G(50, 16);
+
+	A.setFrom(M);
+
+	TiledLU lu(A);
+	//lu.enableLog();
+
+	lu.inverse(G);
+
+	assert_function("The LinearAlgebra::TiledLU could not invert a random 50x50 matrix stored in tiles of 16.", G.matrix().isApprox(M.inverse(), 1e-10));
+
+	// a chain inside its band without broadening has small diagonal tiles, so the pivots must come from below them.
+	const long n = 248;
+
+	MatrixXcd chain = MatrixXcd::Identity(n, n) * 0.3;
+
+	for (long i = 0; i + 1 < n; i++)
+		chain(i, i + 1) = chain(i + 1, i) = 1.0;
+
+	TiledMatrix B(n, 31);
+	TiledMatrix chain_inverse(n, 31);
+
+	B.setFrom(chain);
+
+	TiledLU chain_lu(B);
+
+	chain_lu.inverse(chain_inverse);
+
+	const MatrixXcd reference = chain.inverse();
+
+	assert_function("The LinearAlgebra::TiledLU could not invert a 248x248 chain inside its band without broadening.", !chain_lu.isSingular() && (chain_inverse.matrix() - reference).norm() < 1e-9 * reference.norm());
+	assert_function("The LinearAlgebra::tiledInverse could not invert a 248x248 chain inside its band without broadening.", (tiledInverse(chain, 31) - reference).norm() < 1e-9 * reference.norm());
+
+	// a zero column is found as singular.
+	chain.col(100).setZero();
+
+	B.setFrom(chain);
+
+	TiledLU singular_lu(B);
+
+	singular_lu.factorize();
+
+	assert_function("The LinearAlgebra::TiledLU did not find a matrix with a zero column singular.", singular_lu.isSingular());
+}
+
+void test_tiled_inverse(std::function<void(std::string, bool)> assert_function) {
+
+	std::vector<MatrixXcd> M(4), G(4);
+
+	for (auto &m : M)
+		m = random_greens_argument(70);
+
+	// the tile task graphs run nested in an outer loop, as in an energy sweep.
+	tbb::parallel_for(0, 4, [&](const int &e) {
+		G[e] = tiledInverse(M[e], 16);
+	});
+
+	bool correct = true;
+
+	for (int e = 0; e < 4; e++)
+		correct = correct && G[e].isApprox(M[e].inverse(), 1e-10);
+
+	assert_function("The LinearAlgebra::tiledInverse could not invert four random 70x70 matrices in tiles of 16 in parallel.", correct);
+}
+
+void test_hierarchical_inversion(std::function<void(std::string, bool)> assert_function) {
+
+	const long n = 256;
+
+	// a smooth long-ranged interaction, whose off-diagonal parts are numerically low-rank.
+	MatrixXcd M(n, n);
+
+	for (long i = 0; i < n; i++)
+		for (long j = 0; j < n; j++)
+			M(i, j) = (i == j ? std::complex<double>(4, 0.5) : std::complex<double>(1.0 / (1.0 + std::abs(i - j)), 0));
+
+	HierarchicalMatrix A(M, 1e-12, 32);
+
+	assert_function("The LinearAlgebra::HierarchicalMatrix did not compress the off-diagonal parts of a smooth 256x256 matrix.", A.rank() < 32 && A.storage() < n * n);
+
+	assert_function("The LinearAlgebra::HierarchicalMatrix did not reproduce a smooth 256x256 matrix.", A.matrix().isApprox(M, 1e-10));
+
+	HierarchicalMatrix G = A.inverse();
+
+	assert_function("The LinearAlgebra::HierarchicalMatrix could not invert a smooth 256x256 matrix.", G.matrix().isApprox(M.inverse(), 1e-8));
+
+	MatrixXcd X = MatrixXcd::Random(n, 3);
+
+	assert_function("The LinearAlgebra::HierarchicalMatrix could not multiply a smooth 256x256 matrix.", A.multiply(X).isApprox(M * X, 1e-10) && A.adjointMultiply(X).isApprox(M.adjoint() * X, 1e-10));
+}
+
+void test_low_rank_coupling(std::function<void(std::string, bool)> assert_function) {
+
+	// a 12x8 coupling in which 3 device rows see 4 lead orbitals through a rank 2 interaction.
+	MatrixXcd V = MatrixXcd::Zero(12, 8);
+
+	V.block(4, 2, 3, 4) = MatrixXcd::Random(3, 2) * MatrixXcd::Random(2, 4);
+
+	MatrixXcd g = random_greens_argument(8).inverse();
+
+	LowRankCoupling coupling(V);
+
+	assert_function("The LinearAlgebra::LowRankCoupling did not find the coupled rows, columns and rank of a 12x8 coupling.", coupling.coupledRows().size() == 3 && coupling.coupledCols().size() == 4 && coupling.rank() == 2);
+
+	assert_function("The LinearAlgebra::select did not gather the coupled part of a 12x8 coupling.", select(V, coupling.coupledRows(), coupling.coupledCols()) == V.block(4, 2, 3, 4));
+
+	MatrixXcd sigma = MatrixXcd::Zero(12, 12);
+
+	coupling.addSelfEnergy(sigma, g);
+
+	assert_function("The LinearAlgebra::LowRankCoupling did not reproduce the self-energy of a 12x8 coupling.", sigma.isApprox(V * g * V.adjoint(), 1e-10) && coupling.selfEnergyBlock(g, 4, 4).isApprox((V * g * V.adjoint()).block(4, 4, 4, 4), 1e-10));
+}
+
+void test_sparse_direct_solver(std::function<void(std::string, bool)> assert_function) {
+
+	// a ring of 12 by 10 sites, periodic along the ring, with a random potential.
+	const long length = 12, width = 10, n = length * width;
+
+	std::vector<Triplet<std::complex<double> > > entries;
+
+	for (long x = 0; x < length; x++)
+		for (long y = 0; y < width; y++)
+		{
+			const long i = x * width + y;
+
+			entries.push_back(Triplet<std::complex<double> >(i, i, std::complex<double>(std::rand() / double(RAND_MAX) - 0.5, 0.1)));
+
+			const long right = ((x + 1) % length) * width + y;
+
+			entries.push_back(Triplet<std::complex<double> >(i, right, 1.0));
+			entries.push_back(Triplet<std::complex<double> >(right, i, 1.0));
+
+			if (y + 1 < width)
+			{
+				entries.push_back(Triplet<std::complex<double> >(i, i + 1, 1.0));
+				entries.push_back(Triplet<std::complex<double> >(i + 1, i, 1.0));
+			}
+		}
+
+	SparseMatrixXcd A(n, n);
+	A.setFromTriplets(entries.begin(), entries.end());
+
+	const MatrixXcd inverse = MatrixXcd(A).inverse();
+
+	SparseDirectSolver solver(A, 8);
+	//solver.enableLog();
+
+	solver.factorize();
+
+	assert_function("The LinearAlgebra::SparseDirectSolver did not dissect a 12x10 ring.", solver.nodeCount() > 1 && solver.largestSupernode() < n);
+
+	MatrixXcd B = MatrixXcd::Random(n, 2);
+
+	assert_function("The LinearAlgebra::SparseDirectSolver could not solve a 12x10 ring.", solver.solve(B).isApprox(inverse * B, 1e-10));
+
+	assert_function("The LinearAlgebra::SparseDirectSolver could not find the diagonal of the inverse of a 12x10 ring.", solver.inverseDiagonal().isApprox(inverse.diagonal(), 1e-10));
+
+	// the first cell and a column on the opposite side of the ring.
+	std::vector<long> rows, cols;
+
+	for (long y = 0; y < width; y++)
+	{
+		rows.push_back(y);
+		cols.push_back(y);
+	}
+
+	cols.push_back(n / 2);
+
+	MatrixXcd expected(rows.size(), cols.size());
+
+	for (std::size_t j = 0; j < cols.size(); j++)
+		for (std::size_t i = 0; i < rows.size(); i++)
+			expected(i, j) = inverse(rows[i], cols[j]);
+
+	assert_function("The LinearAlgebra::SparseDirectSolver could not find a block of the inverse of a 12x10 ring.", solver.inverseBlock(rows, cols).isApprox(expected, 1e-10));
+}
+
+void test_complex_product(std::function<void(std::string, bool)> assert_function) {
+
+	MatrixXcd A = MatrixXcd::Random(96, 80);
+	MatrixXcd B = MatrixXcd::Random(80, 72);
+
+	MatrixXcd C = A * B;
+
+	assert_function("The LinearAlgebra::gaussProduct of a 96x80 and an 80x72 matrix exceeded its error bound.", (gaussProduct(A, B) - C).norm() <= gaussErrorBound(A, B));
+
+	ProductSettings settings(GaussProduct, 64);
+
+	assert_function("The LinearAlgebra::multiply in 3M mode did not reproduce the product of a 96x80 and an 80x72 matrix.", multiply(A, B, settings).isApprox(C, 1e-12));
+
+	assert_function("The LinearAlgebra::multiply in 3M mode did not keep the standard product below its threshold.", multiply(A.topRows(32), B, settings) == A.topRows(32) * B);
+}
+
+void test_chain_order(std::function<void(std::string, bool)> assert_function) {
+
+	// a 4x60 coupling around a 60x60 greens matrix, with the trace against a 4x4 broadening.
+	MatrixXcd v = MatrixXcd::Random(4, 60);
+	MatrixXcd g = MatrixXcd::Random(60, 60);
+	MatrixXcd v_adjoint = v.adjoint();
+	MatrixXcd gamma = MatrixXcd::Random(4, 4);
+
+	// the 4x60 by 60x60 by 60x50 chain is cheapest from the left.
+	std::vector<long> dimensions = {4, 60, 60, 50};
+
+	ChainOrder order(dimensions);
+
+	assert_function("The LinearAlgebra::ChainOrder did not keep the rectangular coupling out of the 60x50 intermediate.", order.split(0, 2) == 1 && order.cost(0, 2) == 4 * 60 * 60 + 4 * 60 * 50);
+
+	assert_function("The LinearAlgebra::multiply of a chain did not reproduce v g v*.", multiply({&v, &g, &v_adjoint}).isApprox(v * g * v_adjoint, 1e-12));
+
+	assert_function("The LinearAlgebra::traceOfProduct did not reproduce the trace of gamma v g v*.", std::abs(traceOfProduct(gamma, multiply(v, g, v_adjoint)) - (gamma * v * g * v_adjoint).trace()) < 1e-9);
+}
+
+void test_hermitian_kernels(std::function<void(std::string, bool)> assert_function) {
+
+	MatrixXcd v = MatrixXcd::Random(20, 30);
+	MatrixXcd h = MatrixXcd::Random(30, 30);
+
+	h += h.adjoint().eval();
+
+	PackedHermitian packed(h);
+
+	assert_function("The LinearAlgebra::PackedHermitian did not keep a 30x30 hermitian matrix in 465 elements.", packed.storage() == 465 && packed.matrix().isApprox(h) && packed.multiply(v.adjoint()).isApprox(h * v.adjoint()));
+
+	// the broadenings of two rank 3 self-energies from retarded greens matrices.
+	MatrixXcd g = random_greens_argument(30).inverse();
+	MatrixXcd G = random_greens_argument(20).inverse();
+
+	MatrixXcd sigma_left = MatrixXcd::Zero(20, 20), sigma_right = MatrixXcd::Zero(20, 20);
+
+	sigma_left.topLeftCorner(3, 3) = v.topRows(3) * g * v.topRows(3).adjoint();
+	sigma_right.bottomRightCorner(3, 3) = v.bottomRows(3) * g * v.bottomRows(3).adjoint();
+
+	const std::complex<double> i_unit(0, 1);
+
+	MatrixXcd gamma_left = i_unit * (sigma_left - sigma_left.adjoint());
+	MatrixXcd gamma_right = i_unit * (sigma_right - sigma_right.adjoint());
+
+	MatrixXcd F_left = broadeningFactor(gamma_left);
+	MatrixXcd F_right = broadeningFactor(gamma_right);
+
+	const double expected = (gamma_right * G * gamma_left * G.adjoint()).trace().real();
+
+	assert_function("The LinearAlgebra::transmission did not reproduce the trace formula from the rank 3 broadening factors.", F_left.cols() == 3 && F_right.cols() == 3 && std::abs(transmission(G, F_left, F_right) - expected) < 1e-9 * std::abs(expected));
+
+	assert_function("The LinearAlgebra::broadening did not keep i(sigma - sigma*) packed.", broadening(sigma_right).storage() == 210 && broadening(sigma_right).matrix().isApprox(gamma_right, 1e-12));
+
+	assert_function("The LinearAlgebra::transmission did not reproduce the trace formula from a factor and a packed broadening.", std::abs(transmission(G, F_left, broadening(sigma_right)) - expected) < 1e-9 * std::abs(expected));
+
+	assert_function("The LinearAlgebra::transmission did not reproduce the trace formula from two packed broadenings.", std::abs(transmission(G, broadening(sigma_left), broadening(sigma_right)) - expected) < 1e-9 * std::abs(expected));
+
+	// the broadenings of retarded self-energies transmit positively, and an advanced one shows by its sign.
+	const MatrixXcd sigma_advanced = sigma_right.adjoint();
+
+	assert_function("The LinearAlgebra::transmission was not positive for retarded self-energies.", expected > 0 && transmission(G, F_left, F_right) > 0 && transmission(G, F_left, broadening(sigma_right)) > 0 && transmission(G, broadening(sigma_left), broadening(sigma_right)) > 0);
+	assert_function("The LinearAlgebra::transmission hid the sign of an advanced self-energy.", std::abs(transmission(G, F_left, broadening(sigma_advanced)) + expected) < 1e-9 * expected && std::abs(transmission(G, broadening(sigma_left), broadening(sigma_advanced)) + expected) < 1e-9 * expected);
+	assert_function("The LinearAlgebra::broadeningFactor factored the broadening of an advanced self-energy.", broadeningFactor(broadening(sigma_advanced).matrix()).cols() == 0);
+
+	// the same left broadening from the core of its rank 3 coupling.
+	MatrixXcd coupling = MatrixXcd::Zero(20, 30);
+
+	coupling.topRows(3) = v.topRows(3);
+
+	LowRankCoupling low_rank(coupling);
+
+	const MatrixXcd F_core = low_rank.broadeningFactor(g, 0, 20);
+
+	assert_function("The LinearAlgebra::LowRankCoupling did not factor the broadening of its self-energy from the core.", F_core.cols() == 3 && (F_core * F_core.adjoint()).isApprox(F_left * F_left.adjoint(), 1e-9));
+}
+
+void test_symmetry_sectors(std::function<void(std::string, bool)> assert_function) {
+
+	// 4 blocks of 3 sites with a spin each, where a field along x mixes up and down.
+	const long sites = 12;
+
+	MatrixXcd H0 = MatrixXcd::Zero(sites, sites);
+
+	for (long i = 0; i < sites; i++)
+		for (long j = std::max(0L, i - 3); j <= i; j++)
+			H0(i, j) = H0(j, i) = std::complex<double>(std::cos(i + 2.0 * j), i == j ? 0.0 : std::sin(i - 3.0 * j));
+
+	BlockMatrixXcd M = MatrixXcd(MatrixXcd::Zero(2 * sites, 2 * sites));
+
+	for (long i = 0; i < sites; i++)
+	{
+		for (long j = 0; j < sites; j++)
+			for (long spin = 0; spin < 2; spin++)
+				M(2 * i + spin, 2 * j + spin) = - H0(i, j);
+
+		M(2 * i, 2 * i + 1) = M(2 * i + 1, 2 * i) = - 0.3;
+	}
+
+	M += MatrixXcd::Identity(2 * sites, 2 * sites) * std::complex<double>(0.5, 0.1);
+	M.setBlocks(ArrayXi::Constant(4, 6));
+
+	// the eigenstates of the field on every site of a block.
+	MatrixXcd U = MatrixXcd::Zero(6, 6);
+
+	for (long i = 0; i < 3; i++)
+		U.block(2 * i, 2 * i, 2, 2) << 1, 1, 1, -1;
+
+	U /= std::sqrt(2.0);
+
+	const SymmetrySectors mixed(M);
+	const SymmetrySectors sectors(M, std::vector<MatrixXcd>(1, U));
+
+	assert_function("The LinearAlgebra::SymmetrySectors did not find the two spin sectors in the eigenbasis of the field.", mixed.sectorCount() == 1 && sectors.sectorCount() == 2 && (sectors.sectorBlocks(0) == 3).all() && (sectors.sectorBlocks(1) == 3).all());
+
+	std::vector<MatrixXcd> greens(2), first(2);
+
+	sectors.forEach([&](const long &s) {
+		greens[s] = sectors.sector(M, s).inverse();
+		first[s] = greens[s].topLeftCorner(3, 3);
+	});
+
+	const MatrixXcd G = M.inverse();
+
+	assert_function("The LinearAlgebra::SymmetrySectors did not combine the inverses of the sectors to the inverse.", sectors.combine(greens).isApprox(G, 1e-10) && sectors.combine(first, 0, 1).isApprox(G.topLeftCorner(6, 6), 1e-10));
+}
+
+void test_all(std::function<void(std::string, bool)> assert_function) {
+
+	std::cout << "LinearAlgebra unittesting: test_out_of_core_inversion() ?" << std::endl;
+	test_out_of_core_inversion(assert_function);
+	std::cout << "Done! [LinearAlgebra unittesting: test_out_of_core_inversion()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "LinearAlgebra unittesting: test_tiled_inverse() ?" << std::endl;
+	test_tiled_inverse(assert_function);
+	std::cout << "Done! [LinearAlgebra unittesting: test_tiled_inverse()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "LinearAlgebra unittesting: test_hierarchical_inversion() ?" << std::endl;
+	test_hierarchical_inversion(assert_function);
+	std::cout << "Done! [LinearAlgebra unittesting: test_hierarchical_inversion()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "LinearAlgebra unittesting: test_low_rank_coupling() ?" << std::endl;
+	test_low_rank_coupling(assert_function);
+	std::cout << "Done! [LinearAlgebra unittesting: test_low_rank_coupling()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "LinearAlgebra unittesting: test_sparse_direct_solver() ?" << std::endl;
+	test_sparse_direct_solver(assert_function);
+	std::cout << "Done! [LinearAlgebra unittesting: test_sparse_direct_solver()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "LinearAlgebra unittesting: test_complex_product() ?" << std::endl;
+	test_complex_product(assert_function);
+	std::cout << "Done! [LinearAlgebra unittesting: test_complex_product()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "LinearAlgebra unittesting: test_chain_order() ?" << std::endl;
+	test_chain_order(assert_function);
+	std::cout << "Done! [LinearAlgebra unittesting: test_chain_order()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "LinearAlgebra unittesting: test_hermitian_kernels() ?" << std::endl;
+	test_hermitian_kernels(assert_function);
+	std::cout << "Done! [LinearAlgebra unittesting: test_hermitian_kernels()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "LinearAlgebra unittesting: test_symmetry_sectors() ?" << std::endl;
+	test_symmetry_sectors(assert_function);
+	std::cout << "Done! [LinearAlgebra unittesting: test_symmetry_sectors()]" << std::endl;
+
+	std::cout << std::endl;
+}
+
+} /* namespace UnitTesting */
+
+} /* namespace LinearAlgebra */
+
+} /* namespace QuantumMechanics */
+
+#endif /* LINEARALGEBRA_UNITTESTING_H_ */
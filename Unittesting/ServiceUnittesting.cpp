@@ -0,0 +1,19 @@
+#include "ServiceUnittesting.hpp"
+
+using namespace QuantumMechanics::Service;
+
+int main()
+{
+	std::function<void(std::string,bool)> assert_function = [&](std::string msg, bool assessment)
+	{
+		if(assessment == true)
+			return;
+		
+		std::cout << "Assessment failed! Message:" << msg << std::endl;
+	};
+	
+    std::cout << "Starting Service Unittesting:" << std::endl << std::endl;
+	Unittesting::test_all(assert_function);
+    std::cout  << std::endl << "Done with Service Unittesting!" << std::endl;
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,230 @@
+#ifndef SERVICE_UNITTESTING_H_
+#define SERVICE_UNITTESTING_H_
+
+#include <QuantumMechanics/Service/SolverDaemon>
+#include <QuantumMechanics/Service/SolverClient>
+#include <QuantumMechanics/Service/DistributedSweep>
+
+#include <set>
+#include <thread>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace QuantumMechanics {
+
+namespace Service {
+
+namespace Unittesting {
+
+	BlockMatrixXcd chain_argument(long n, std::complex<double> z) {
+		BlockMatrixXcd result = MatrixXcd(MatrixXcd::Identity(n, n) * z);
+		for (long i = 0; i + 1 < n; i++)
+			result(i, i + 1) = result(i + 1, i) = 1.0;
+		result.setBlocks(ArrayXi::Ones(n));
+		return result;
+	}
+
+void test_distributed_sweep(std::function<void(std::string, bool)> assert_function) {
+
+	std::vector<double> points;
+
+	for (long p = 0; p < 97; p++)
+		points.push_back(0.1 * p);
+
+	// the value and the process that computed it.
+	auto function = [](const double &x) {
+		VectorXd value(2);
+		value << std::sin(x) * std::exp(- x), (double) ::getpid();
+		return value;
+	};
+
+	DistributedSweep sweep(3), pool(2);
+	//sweep.enableLog();
+
+	sweep.pin_workers = false;
+	pool.pin_workers = false;
+
+	// forked before any other thread starts, the pool serves the sweeps below.
+	assert_function("Service::DistributedSweep could not start its workers in a single threaded process.", pool.start(function) && pool.workerCount() == 2);
+
+	const std::vector<VectorXd> &results = sweep.compute(points, function);
+
+	bool ordered = results.size() == points.size();
+	std::set<double> processes;
+
+	for (std::size_t p = 0; ordered && p < points.size(); p++)
+	{
+		ordered = results[p].size() == 2 && results[p][0] == std::sin(points[p]) * std::exp(- points[p]);
+		processes.insert(results[p][1]);
+	}
+
+	assert_function("Service::DistributedSweep did not merge the results in the order of the points.", ordered);
+	assert_function("Service::DistributedSweep did not share the points between several workers.", sweep.distributed() && processes.size() > 1 && processes.count((double) ::getpid()) == 0);
+
+	// with another thread running, forking is unsafe and the points are computed in this process.
+	std::mutex held;
+	std::unique_lock<std::mutex> lock(held);
+
+	std::thread other([&held]() { std::lock_guard<std::mutex> wait(held); });
+
+	const std::vector<VectorXd> &local = sweep.compute(points, function);
+
+	bool in_process = !sweep.distributed() && local.size() == points.size();
+
+	for (std::size_t p = 0; in_process && p < points.size(); p++)
+		in_process = local[p][0] == std::sin(points[p]) * std::exp(- points[p]) && local[p][1] == (double) ::getpid();
+
+	assert_function("Service::DistributedSweep forked while another thread was running.", in_process);
+
+	// the started pool still serves sweeps, also of other points and more than once.
+	bool pooled = true;
+
+	for (long s = 1; s <= 2; s++)
+	{
+		std::vector<double> shifted(points.size() - 10 * s);
+
+		for (std::size_t p = 0; p < shifted.size(); p++)
+			shifted[p] = points[p] + s;
+
+		const std::vector<VectorXd> &remote = pool.compute(shifted);
+
+		pooled = pooled && pool.distributed() && remote.size() == shifted.size();
+
+		for (std::size_t p = 0; pooled && p < shifted.size(); p++)
+			pooled = remote[p][0] == std::sin(shifted[p]) * std::exp(- shifted[p]) && remote[p][1] != (double) ::getpid();
+	}
+
+	lock.unlock();
+	other.join();
+
+	assert_function("Service::DistributedSweep did not reuse its started workers while another thread was running.", pooled);
+
+	pool.stop();
+}
+
+void test_solver_daemon(std::function<void(std::string, bool)> assert_function) {
+
+	SolverDaemon daemon("unused.sock", 2);
+	//daemon.enableLog();
+
+	int sockets[2];
+
+	assert_function("Service::SolverDaemon could not create a socket pair.", ::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+
+	daemon.serveSocket(sockets[0]);
+
+	SolverClient client(sockets[1]);
+
+	const std::complex<double> z(0.3, 1e-6);
+
+	JobRequest greens("greens", 0);
+	greens.matrices.push_back(chain_argument(6, z));
+	greens.options["mode"] = "FullMatrix";
+
+	JobRequest chain("chain", 0);
+	chain.matrices.push_back(MatrixXcd::Constant(1, 1, z));
+	chain.matrices.push_back(MatrixXcd::Constant(1, 1, 1.0));
+
+	JobRequest small("transport", 0);
+	small.matrices.push_back(chain_argument(5, z));
+
+	// a uniform chain at an energy inside the band, away from the chain jobs' lead.
+	const std::complex<double> z_band(-0.4, 1e-6);
+
+	JobRequest transport("transport", 0);
+	transport.matrices.push_back(chain_argument(8, z_band));
+
+	const long greens_id = client.submit(greens);
+	const long chain_id = client.submit(chain);
+	const long repeated_id = client.submit(chain);
+	const long small_id = client.submit(small, std::vector<ArrayXi>(1, ArrayXi::Ones(5)));
+	const long transport_id = client.submit(transport, std::vector<ArrayXi>(1, ArrayXi::Ones(8)));
+
+	// the results must still arrive after the client closed its sending direction.
+	client.finishSubmitting();
+
+	std::map<long, JobRequest> results;
+	JobRequest result;
+
+	while (client.receive(result))
+		results[result.id] = result;
+
+	daemon.wait();
+
+	assert_function("Service::SolverDaemon did not return every result after a half-close.", results.size() == 5);
+
+	if (results.size() != 5)
+		return;
+
+	const MatrixXcd argument = chain_argument(6, z);
+	const MatrixXcd G = results[greens_id].matrices[0];
+
+	assert_function("Service::SolverDaemon greens job is not the inverse.", results[greens_id].kind == "result" && (argument * G - MatrixXcd::Identity(6, 6)).norm() < 1e-8);
+
+	const std::complex<double> g = results[chain_id].matrices[0](0, 0);
+
+	assert_function("Service::SolverDaemon chain job is not the surface greens matrix.", std::abs(g * (z - g) - 1.0) < 1e-6 && std::imag(g) < 0);
+	assert_function("Service::SolverDaemon repeated chain job differs.", std::abs(results[repeated_id].matrices[0](0, 0) - g) < 1e-14);
+	// the transport job adds its left and right lead surfaces as two misses.
+	assert_function("Service::SolverDaemon did not find the repeated lead in the SurfaceGreensCache.", daemon.surfaceCache().hits() == 1 && daemon.surfaceCache().misses() == 3);
+
+	assert_function("Service::SolverDaemon accepted a transport job with a single device block.", results[small_id].kind == "error" && results[small_id].option("message") == "transport_needs_leads_and_device");
+	assert_function("Service::SolverDaemon transport job on a uniform chain is not ballistic.", results[transport_id].kind == "result" && std::abs(results[transport_id].matrices[0](0, 0) - 1.0) < 1e-4);
+
+	// a request with absurd dimensions closes its connection without allocating, and the daemon keeps serving.
+	assert_function("Service::SolverDaemon could not create a socket pair.", ::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+
+	daemon.serveSocket(sockets[0]);
+
+	{
+		SocketStream raw(sockets[1]);
+
+		raw << "greens 0 1 mode=FullMatrix\n" << "4000000000 4000000000 0\n";
+		raw.flush();
+
+		assert_function("Service::SolverDaemon answered an oversized request.", !JobRequest::read(raw, result));
+	}
+
+	daemon.wait();
+
+	assert_function("Service::SolverDaemon could not create a socket pair.", ::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+
+	daemon.serveSocket(sockets[0]);
+
+	SolverClient second(sockets[1]);
+
+	const long stats_id = second.submit(JobRequest("stats", 0));
+
+	assert_function("Service::SolverDaemon stopped serving after a malformed request.", second.receive(result) && result.id == stats_id && result.option("finished") == "5");
+
+	second.finishSubmitting();
+
+	while (second.receive(result));
+
+	daemon.wait();
+}
+
+void test_all(std::function<void(std::string, bool)> assert_function) {
+
+	// before anything starts threads, such that the sweep may fork.
+	std::cout << "Service unittesting: test_distributed_sweep() ?" << std::endl;
+	test_distributed_sweep(assert_function);
+	std::cout << "Done! [Service unittesting: test_distributed_sweep()]" << std::endl;
+
+	std::cout << std::endl;
+
+	std::cout << "Service unittesting: test_solver_daemon() ?" << std::endl;
+	test_solver_daemon(assert_function);
+	std::cout << "Done! [Service unittesting: test_solver_daemon()]" << std::endl;
+
+	std::cout << std::endl;
+}
+
+} /* namespace UnitTesting */
+
+} /* namespace Service */
+
+} /* namespace QuantumMechanics */
+
+#endif /* SERVICE_UNITTESTING_H_ */